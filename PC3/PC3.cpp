@@ -6,6 +6,12 @@
 #include <vector>
 #include <mutex>
 #include <limits>
+#include <algorithm>
+#include "order_statistics.h"
+#include "histogram.h"
+#include "contention_bench.h"
+#include "../common/concurrent_counters.h"
+#include <fstream>
 
 std::vector<int> g_values;
 std::mutex g_mutex;
@@ -58,6 +64,15 @@ void atomic_multithread(int* start, int* end, std::atomic<int>& above_n_amount,
 	}
 }
 
+void sharded_multithread(int* start, int* end, sharded_counter& above_n_amount, max_register<int>& max, int N) {
+    for (int* ptr = start; ptr != end; ptr++) {
+        if (*ptr > N) {
+            above_n_amount.add(1);
+        }
+        max.update(*ptr);
+    }
+}
+
 int main() {
     int above_n_amount = 0;
     int max = 0;
@@ -109,5 +124,71 @@ int main() {
     elapsed = end_time - start_time;
     std::cout << "[Atomic multithreading] " << "Above N amount: " << atomic_above_n_amount << "; Maximum: " << atomic_max << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
 
+    sharded_counter sharded_above_n_amount;
+    max_register<int> register_max(INT_MIN);
+
+    start_time = std::chrono::high_resolution_clock::now();
+    size_t sharded_threads_amount = std::thread::hardware_concurrency();
+    std::vector<std::thread> sharded_workers;
+    size_t sharded_chunk_size = g_values.size() / sharded_threads_amount;
+    for (size_t i = 0; i < sharded_threads_amount; i++) {
+        int* start = &g_values[i * sharded_chunk_size];
+        int* end = (i == sharded_threads_amount - 1) ? &g_values.back() + 1 : start + sharded_chunk_size;
+        sharded_workers.push_back(std::thread(sharded_multithread, start, end, std::ref(sharded_above_n_amount), std::ref(register_max), N));
+    }
+    for (auto& worker : sharded_workers) {
+        worker.join();
+    }
+    end_time = std::chrono::high_resolution_clock::now();
+    elapsed = end_time - start_time;
+    std::cout << "[Sharded multithreading] " << "Above N amount: " << sharded_above_n_amount.load() << "; Maximum: " << register_max.load() << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
+
+    parallel_histogram histogram(0, 32);
+    start_time = std::chrono::high_resolution_clock::now();
+    histogram.build(g_values, std::thread::hardware_concurrency());
+    end_time = std::chrono::high_resolution_clock::now();
+    elapsed = end_time - start_time;
+    std::cout << "[Histogram, " << to_string(histogram.used_strategy()) << "] " << "Above N amount: " << histogram.count_above(N) << "; Maximum: " << histogram.max() << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
+    std::cout << "[Histogram] Above 0/16/31 amount: " << histogram.count_above(0) << "/" << histogram.count_above(16) << "/" << histogram.count_above(31) << std::endl;
+
+    // hardware_concurrency() may be 0 or 1: never run with no threads or the same count twice.
+    std::vector<size_t> order_threads_amounts = { 1 };
+    if (std::thread::hardware_concurrency() > 1) {
+        order_threads_amounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (size_t threads_amount : order_threads_amounts) {
+        std::vector<int> sorted = g_values;
+        start_time = std::chrono::high_resolution_clock::now();
+        parallel_radix_sort(sorted, threads_amount);
+        end_time = std::chrono::high_resolution_clock::now();
+        elapsed = end_time - start_time;
+        std::cout << "[Radix sort x" << threads_amount << "] " << "Sorted: " << std::is_sorted(sorted.begin(), sorted.end()) << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
+
+        start_time = std::chrono::high_resolution_clock::now();
+        int median = parallel_percentile(g_values, 50, threads_amount);
+        int p99 = parallel_percentile(g_values, 99, threads_amount);
+        end_time = std::chrono::high_resolution_clock::now();
+        elapsed = end_time - start_time;
+        std::cout << "[Nth element x" << threads_amount << "] " << "Median: " << median << "; P99: " << p99 << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
+
+        start_time = std::chrono::high_resolution_clock::now();
+        std::vector<int> top = parallel_top_k(g_values, 10, threads_amount);
+        end_time = std::chrono::high_resolution_clock::now();
+        elapsed = end_time - start_time;
+        std::cout << "[Top-k x" << threads_amount << "] " << "Top 10:";
+        for (int value : top) { std::cout << " " << value; }
+        std::cout << "; Elapsed time: " << elapsed.count() << " ms" << std::endl;
+    }
+
+    std::vector<size_t> contention_threads_amounts;
+    for (size_t threads_amount = 1; threads_amount <= 2 * std::thread::hardware_concurrency(); threads_amount *= 2) {
+        contention_threads_amounts.push_back(threads_amount);
+    }
+    std::vector<contention_result> contention_results = run_contention_suite(contention_threads_amounts, std::chrono::milliseconds(200));
+    print_contention_results(contention_results, std::cout);
+    std::ofstream log_file("contention_data.csv");
+    write_contention_csv(contention_results, log_file);
+    log_file.close();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+inline size_t effective_threads(size_t size, size_t threads_amount) {
+    if (threads_amount == 0) threads_amount = 1;
+    if (size != 0 && threads_amount > size) threads_amount = size;
+    return threads_amount;
+}
+
+// Calls fn(thread_index, begin, end) on its own thread for every chunk of [0, size),
+// the last chunk takes the remainder.
+template <typename function_t>
+void run_chunked(size_t size, size_t threads_amount, function_t fn) {
+    std::vector<std::thread> workers;
+    size_t chunk_size = size / threads_amount;
+    for (size_t i = 0; i < threads_amount; i++) {
+        size_t begin = i * chunk_size;
+        size_t end = (i == threads_amount - 1) ? size : begin + chunk_size;
+        workers.emplace_back(fn, i, begin, end);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,246 @@
+#include "contention_bench.h"
+#include "sync_primitives.h"
+#include "../common/cache_line.h"
+#include "../common/concurrent_counters.h"
+#include "../common/latency_histogram.h"
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+
+const uint32_t latency_sample_interval = 64;
+
+using bench_clock = std::chrono::steady_clock;
+
+// Runs workload(thread_index) on every thread until the duration is over.
+template <typename workload_t>
+contention_result measure(const char* primitive, size_t threads_amount, std::chrono::milliseconds duration, workload_t& workload) {
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+    std::atomic<bool> stop(false);
+    std::vector<cache_padded<uint64_t>> operations(threads_amount);
+    std::vector<latency_histogram> latencies(threads_amount);
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads_amount; t++) {
+        workers.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            uint64_t local_operations = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (uint32_t i = 1; i < latency_sample_interval; i++) {
+                    workload(t);
+                }
+                auto start = bench_clock::now();
+                workload(t);
+                auto end = bench_clock::now();
+                latencies[t].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                local_operations += latency_sample_interval;
+            }
+            operations[t].value = local_operations;
+        });
+    }
+
+    while (ready.load() != threads_amount) {
+        std::this_thread::yield();
+    }
+    auto start_time = bench_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double, std::micro> elapsed = bench_clock::now() - start_time;
+
+    latency_histogram merged;
+    uint64_t total_operations = 0;
+    for (size_t t = 0; t < threads_amount; t++) {
+        merged.merge(latencies[t]);
+        total_operations += operations[t].value;
+    }
+    return contention_result{ primitive, threads_amount, total_operations, total_operations / elapsed.count(),
+        merged.percentile(50), merged.percentile(99), merged.percentile(99.9), merged.max() };
+}
+
+template <typename lock_t>
+struct locked_increment {
+    lock_t lock;
+    uint64_t counter = 0;
+    void operator()(size_t) {
+        std::lock_guard<lock_t> guard(lock);
+        counter++;
+    }
+};
+
+struct shared_mutex_exclusive {
+    std::shared_mutex lock;
+    uint64_t counter = 0;
+    void operator()(size_t) {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        counter++;
+    }
+};
+
+// The task_queue::size()/empty() pattern: readers only, but they still write the
+// lock word to register themselves.
+struct shared_mutex_shared {
+    std::shared_mutex lock;
+    uint64_t counter = 0;
+    std::vector<cache_padded<uint64_t>> seen;
+    explicit shared_mutex_shared(size_t threads_amount) : seen(threads_amount) {}
+    void operator()(size_t t) {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        seen[t].value += counter;
+    }
+};
+
+struct mcs_increment {
+    mcs_lock lock;
+    uint64_t counter = 0;
+    std::unique_ptr<mcs_lock::node[]> nodes;
+    explicit mcs_increment(size_t threads_amount) : nodes(new mcs_lock::node[threads_amount]) {}
+    void operator()(size_t t) {
+        lock.lock(nodes[t]);
+        counter++;
+        lock.unlock(nodes[t]);
+    }
+};
+
+struct clh_increment {
+    clh_lock lock;
+    uint64_t counter = 0;
+    std::unique_ptr<clh_lock::handle[]> handles;
+    explicit clh_increment(size_t threads_amount) : handles(new clh_lock::handle[threads_amount]) {}
+    void operator()(size_t t) {
+        lock.lock(handles[t]);
+        counter++;
+        lock.unlock(handles[t]);
+    }
+};
+
+template <std::memory_order order>
+struct atomic_fetch_add {
+    std::atomic<uint64_t> counter{ 0 };
+    void operator()(size_t) {
+        counter.fetch_add(1, order);
+    }
+};
+
+// atomic_multithread's max loop with values that keep winning, the worst case.
+struct cas_max {
+    std::atomic<uint64_t> max{ 0 };
+    std::vector<cache_padded<uint64_t>> next;
+    explicit cas_max(size_t threads_amount) : next(threads_amount) {}
+    void operator()(size_t t) {
+        uint64_t value = ++next[t].value * next.size() + t;
+        for (;;) {
+            uint64_t current_max = max.load(std::memory_order_relaxed);
+            if (value <= current_max || max.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) break;
+        }
+    }
+};
+
+// One counter per thread, summed on read. `packed` puts neighbouring threads'
+// counters on the same cache line, `padded` gives each its own line.
+struct per_thread_packed {
+    std::unique_ptr<std::atomic<uint64_t>[]> counters;
+    explicit per_thread_packed(size_t threads_amount) : counters(new std::atomic<uint64_t>[threads_amount]) {
+        for (size_t t = 0; t < threads_amount; t++) counters[t].store(0);
+    }
+    void operator()(size_t t) {
+        counters[t].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct per_thread_padded {
+    std::vector<cache_padded<std::atomic<uint64_t>>> counters;
+    explicit per_thread_padded(size_t threads_amount) : counters(threads_amount) {}
+    void operator()(size_t t) {
+        counters[t].value.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct sharded_increment {
+    sharded_counter counter;
+    void operator()(size_t) {
+        counter.add(1);
+    }
+};
+
+// Same winning values as cas_max, through the register's load-before-CAS path.
+struct register_max_winning {
+    max_register<uint64_t> max{ 0 };
+    std::vector<cache_padded<uint64_t>> next;
+    explicit register_max_winning(size_t threads_amount) : next(threads_amount) {}
+    void operator()(size_t t) {
+        max.update(++next[t].value * next.size() + t);
+    }
+};
+
+// The PC3 data once the maximum is found: no value can win any more.
+struct register_max_settled {
+    max_register<uint64_t> max{ UINT64_MAX };
+    void operator()(size_t t) {
+        max.update(t);
+    }
+};
+
+// Heap-allocates the workload: several of them embed cache-line-aligned members and
+// would otherwise sit on the benchmark thread's stack next to its own hot data.
+template <typename workload_t, typename... arguments>
+void run_one(std::vector<contention_result>& results, const char* primitive, size_t threads_amount,
+    std::chrono::milliseconds duration, arguments&&... parameters) {
+    auto workload = std::make_unique<workload_t>(std::forward<arguments>(parameters)...);
+    results.push_back(measure(primitive, threads_amount, duration, *workload));
+}
+
+}
+
+std::vector<contention_result> run_contention_suite(const std::vector<size_t>& threads_amounts, std::chrono::milliseconds duration) {
+    std::vector<contention_result> results;
+    for (size_t threads_amount : threads_amounts) {
+        run_one<locked_increment<std::mutex>>(results, "std::mutex", threads_amount, duration);
+        run_one<locked_increment<spin_lock>>(results, "spin_lock", threads_amount, duration);
+        run_one<locked_increment<ticket_lock>>(results, "ticket_lock", threads_amount, duration);
+        run_one<mcs_increment>(results, "mcs_lock", threads_amount, duration, threads_amount);
+        run_one<clh_increment>(results, "clh_lock", threads_amount, duration, threads_amount);
+        run_one<shared_mutex_exclusive>(results, "shared_mutex exclusive", threads_amount, duration);
+        run_one<shared_mutex_shared>(results, "shared_mutex shared", threads_amount, duration, threads_amount);
+        run_one<atomic_fetch_add<std::memory_order_relaxed>>(results, "fetch_add relaxed", threads_amount, duration);
+        run_one<atomic_fetch_add<std::memory_order_seq_cst>>(results, "fetch_add seq_cst", threads_amount, duration);
+        run_one<cas_max>(results, "CAS max", threads_amount, duration, threads_amount);
+        run_one<register_max_winning>(results, "max_register winning", threads_amount, duration, threads_amount);
+        run_one<register_max_settled>(results, "max_register settled", threads_amount, duration);
+        run_one<sharded_increment>(results, "sharded_counter", threads_amount, duration);
+        run_one<per_thread_packed>(results, "per-thread packed", threads_amount, duration, threads_amount);
+        run_one<per_thread_padded>(results, "per-thread padded", threads_amount, duration, threads_amount);
+    }
+    return results;
+}
+
+void print_contention_results(const std::vector<contention_result>& results, std::ostream& out) {
+    for (const auto& result : results) {
+        out << "[Contention] " << std::left << std::setw(24) << result.primitive << std::right
+            << "Threads: " << std::setw(3) << result.threads_amount
+            << "; Throughput: " << std::setw(9) << std::fixed << std::setprecision(2) << result.mops_per_second << " Mops/s"
+            << "; p50/p99/p99.9/max: " << result.p50_ns << "/" << result.p99_ns << "/" << result.p999_ns << "/" << result.max_ns << " ns"
+            << std::defaultfloat << std::endl;
+    }
+}
+
+void write_contention_csv(const std::vector<contention_result>& results, std::ostream& csv) {
+    csv << "Primitive,Threads,Operations,Mops per second,p50 ns,p99 ns,p99.9 ns,Max ns\n";
+    for (const auto& result : results) {
+        csv << result.primitive << "," << result.threads_amount << "," << result.operations << ","
+            << result.mops_per_second << "," << result.p50_ns << "," << result.p99_ns << ","
+            << result.p999_ns << "," << result.max_ns << "\n";
+    }
+}
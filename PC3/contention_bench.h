@@ -0,0 +1,26 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct contention_result {
+    std::string primitive;
+    size_t threads_amount;
+    uint64_t operations;
+    double mops_per_second;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+// Every primitive runs a minimal critical section (or a single atomic update) in a
+// tight loop on `threads_amount` threads for `duration`, for each thread count.
+// Latency is sampled on one operation out of every few so the clock reads do not
+// dominate the cheap primitives.
+std::vector<contention_result> run_contention_suite(const std::vector<size_t>& threads_amounts, std::chrono::milliseconds duration);
+
+void print_contention_results(const std::vector<contention_result>& results, std::ostream& out);
+void write_contention_csv(const std::vector<contention_result>& results, std::ostream& csv);
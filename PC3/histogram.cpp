@@ -0,0 +1,235 @@
+#include "histogram.h"
+#include "chunked.h"
+#include "../common/cache_line.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+namespace {
+
+// Up to this many bins a thread keeps several interleaved copies ("lanes") of its
+// bins, so runs of equal values do not serialize on one counter's store-to-load
+// dependency. 33 bins x 4 lanes is about two cache lines per lane.
+const size_t lane_split_bins_limit = 1024;
+const size_t lanes = 4;
+// Private per-thread bins are used while they fit this budget, past it the threads
+// share a few sets of atomic bins instead.
+const size_t private_bins_budget = 16 * 1024 * 1024;
+// uint32_t lane counters are flushed into the size_t totals before they can wrap.
+const size_t lane_flush_interval = size_t(1) << 30;
+
+const size_t counters_per_line = cache_line_size / sizeof(uint32_t);
+const size_t totals_per_line = cache_line_size / sizeof(size_t);
+
+// Lane storage is handed out in whole lines so no two lanes or threads share one.
+struct alignas(cache_line_size) bin_line {
+    uint32_t counts[counters_per_line];
+};
+
+// The same for the size_t bins every thread keeps: all threads' bins live in one
+// block, each thread's starting on a line of its own.
+struct alignas(cache_line_size) total_line {
+    size_t counts[totals_per_line];
+};
+
+size_t lines_for(size_t slots, size_t per_line) {
+    return (slots + per_line - 1) / per_line;
+}
+
+// Index of `value` in the bins, or `bins_count` (the discard slot) when outside.
+inline size_t bin_index(int value, int min_value, size_t bins_count) {
+    size_t index = static_cast<uint32_t>(value) - static_cast<uint32_t>(min_value);
+    return index < bins_count ? index : bins_count;
+}
+
+}
+
+parallel_histogram::parallel_histogram(int min_value, int max_value)
+    : m_min_value(min_value), m_max_value(max_value) {
+    assert(min_value <= max_value);
+    m_bins_count = static_cast<size_t>(static_cast<int64_t>(max_value) - min_value) + 1;
+    m_bins.assign(m_bins_count, 0);
+    m_above.assign(m_bins_count + 1, 0);
+}
+
+parallel_histogram::strategy parallel_histogram::pick_strategy(size_t threads_amount) const {
+    if (m_bins_count <= lane_split_bins_limit) {
+        return strategy::lane_split;
+    }
+    if (threads_amount * (m_bins_count + 1) * sizeof(size_t) <= private_bins_budget) {
+        return strategy::private_bins;
+    }
+    return strategy::sharded_atomic;
+}
+
+void parallel_histogram::build(const std::vector<int>& values, size_t threads_amount) {
+    threads_amount = effective_threads(values.size(), threads_amount);
+    std::fill(m_bins.begin(), m_bins.end(), 0);
+    m_out_of_range = 0;
+
+    m_strategy = pick_strategy(threads_amount);
+    switch (m_strategy) {
+    case strategy::lane_split:
+        build_lane_split(values, threads_amount);
+        break;
+    case strategy::private_bins:
+        build_private(values, threads_amount);
+        break;
+    case strategy::sharded_atomic:
+        build_sharded(values, threads_amount);
+        break;
+    }
+
+    m_above[m_bins_count] = 0;
+    for (size_t i = m_bins_count; i-- > 0;) {
+        m_above[i] = m_above[i + 1] + m_bins[i];
+    }
+}
+
+void parallel_histogram::build_lane_split(const std::vector<int>& values, size_t threads_amount) {
+    // Lane l of thread t starts at line (t * lanes + l) * lines_per_lane; the extra
+    // slot per lane is the discard bin for out-of-domain values.
+    size_t slots = m_bins_count + 1;
+    size_t lines_per_lane = lines_for(slots, counters_per_line);
+    size_t lines_per_thread = lines_per_lane * lanes;
+    size_t total_lines_per_thread = lines_for(slots, totals_per_line);
+    std::vector<bin_line> lines(threads_amount * lines_per_thread);
+    std::vector<total_line> totals(threads_amount * total_lines_per_thread);
+
+    int min_value = m_min_value;
+    size_t bins_count = m_bins_count;
+    run_chunked(values.size(), threads_amount, [&](size_t t, size_t begin, size_t end) {
+        uint32_t* lane[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            lane[l] = reinterpret_cast<uint32_t*>(&lines[t * lines_per_thread + l * lines_per_lane]);
+        }
+        size_t* total = reinterpret_cast<size_t*>(&totals[t * total_lines_per_thread]);
+        const int* data = values.data();
+
+        while (begin < end) {
+            size_t block_end = std::min(end, begin + lane_flush_interval);
+            size_t i = begin;
+            for (; i + lanes <= block_end; i += lanes) {
+                lane[0][bin_index(data[i], min_value, bins_count)]++;
+                lane[1][bin_index(data[i + 1], min_value, bins_count)]++;
+                lane[2][bin_index(data[i + 2], min_value, bins_count)]++;
+                lane[3][bin_index(data[i + 3], min_value, bins_count)]++;
+            }
+            for (; i < block_end; i++) {
+                lane[0][bin_index(data[i], min_value, bins_count)]++;
+            }
+            for (size_t l = 0; l < lanes; l++) {
+                for (size_t b = 0; b < slots; b++) {
+                    total[b] += lane[l][b];
+                    lane[l][b] = 0;
+                }
+            }
+            begin = block_end;
+        }
+    });
+
+    for (size_t t = 0; t < threads_amount; t++) {
+        const size_t* total = reinterpret_cast<const size_t*>(&totals[t * total_lines_per_thread]);
+        for (size_t b = 0; b < m_bins_count; b++) {
+            m_bins[b] += total[b];
+        }
+        m_out_of_range += total[m_bins_count];
+    }
+}
+
+void parallel_histogram::build_private(const std::vector<int>& values, size_t threads_amount) {
+    size_t slots = m_bins_count + 1;
+    size_t lines_per_thread = lines_for(slots, totals_per_line);
+    std::vector<total_line> locals(threads_amount * lines_per_thread);
+    auto local_bins = [&](size_t t) { return reinterpret_cast<size_t*>(&locals[t * lines_per_thread]); };
+
+    int min_value = m_min_value;
+    size_t bins_count = m_bins_count;
+    run_chunked(values.size(), threads_amount, [&](size_t t, size_t begin, size_t end) {
+        size_t* local = local_bins(t);
+        for (size_t i = begin; i < end; i++) {
+            local[bin_index(values[i], min_value, bins_count)]++;
+        }
+    });
+
+    // Every thread sums a disjoint range of bins over all private copies.
+    run_chunked(bins_count, effective_threads(bins_count, threads_amount), [&](size_t, size_t begin, size_t end) {
+        for (size_t t = 0; t < threads_amount; t++) {
+            const size_t* local = local_bins(t);
+            for (size_t b = begin; b < end; b++) {
+                m_bins[b] += local[b];
+            }
+        }
+    });
+    for (size_t t = 0; t < threads_amount; t++) {
+        m_out_of_range += local_bins(t)[bins_count];
+    }
+}
+
+void parallel_histogram::build_sharded(const std::vector<int>& values, size_t threads_amount) {
+    // As many shards as the budget allows, so the fewer threads share a shard the
+    // less the fetch_adds contend on the same lines.
+    size_t slots = m_bins_count + 1;
+    size_t shards = std::max<size_t>(1, private_bins_budget / (slots * sizeof(std::atomic<size_t>)));
+    shards = std::min(shards, threads_amount);
+    std::vector<std::unique_ptr<std::atomic<size_t>[]>> bins(shards);
+    for (auto& shard : bins) {
+        shard.reset(new std::atomic<size_t>[slots]);
+        for (size_t b = 0; b < slots; b++) {
+            shard[b].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    int min_value = m_min_value;
+    size_t bins_count = m_bins_count;
+    run_chunked(values.size(), threads_amount, [&](size_t t, size_t begin, size_t end) {
+        std::atomic<size_t>* shard = bins[t % shards].get();
+        for (size_t i = begin; i < end; i++) {
+            shard[bin_index(values[i], min_value, bins_count)].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    run_chunked(bins_count, effective_threads(bins_count, threads_amount), [&](size_t, size_t begin, size_t end) {
+        for (size_t s = 0; s < shards; s++) {
+            for (size_t b = begin; b < end; b++) {
+                m_bins[b] += bins[s][b].load(std::memory_order_relaxed);
+            }
+        }
+    });
+    for (size_t s = 0; s < shards; s++) {
+        m_out_of_range += bins[s][bins_count].load(std::memory_order_relaxed);
+    }
+}
+
+size_t parallel_histogram::count(int value) const {
+    size_t index = bin_index(value, m_min_value, m_bins_count);
+    return index < m_bins_count ? m_bins[index] : 0;
+}
+
+size_t parallel_histogram::count_above(int threshold) const {
+    if (threshold < m_min_value) return m_above[0];
+    if (threshold >= m_max_value) return 0;
+    return m_above[static_cast<size_t>(static_cast<int64_t>(threshold) - m_min_value) + 1];
+}
+
+size_t parallel_histogram::total() const {
+    return m_above[0];
+}
+
+int parallel_histogram::max() const {
+    for (size_t i = m_bins_count; i-- > 0;) {
+        if (m_bins[i] != 0) return static_cast<int>(m_min_value + static_cast<int64_t>(i));
+    }
+    return m_min_value - 1;
+}
+
+const char* to_string(parallel_histogram::strategy value) {
+    switch (value) {
+    case parallel_histogram::strategy::lane_split: return "lane split";
+    case parallel_histogram::strategy::private_bins: return "private bins";
+    case parallel_histogram::strategy::sharded_atomic: return "sharded atomic";
+    }
+    return "unknown";
+}
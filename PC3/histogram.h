@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Value histogram over a fixed [min_value, max_value] domain. One build answers every
+// "how many values are above N" query, the way single_thread/atomic_multithread
+// answer exactly one N per pass.
+class parallel_histogram {
+public:
+    enum class strategy { lane_split, private_bins, sharded_atomic };
+
+    parallel_histogram(int min_value, int max_value);
+
+    // Counts `values` with `threads_amount` threads. Values outside the domain are
+    // not binned, only counted in out_of_range().
+    void build(const std::vector<int>& values, size_t threads_amount);
+
+    size_t count(int value) const;
+    size_t count_above(int threshold) const;
+    size_t total() const;
+    size_t out_of_range() const { return m_out_of_range; }
+    // Highest value with a non-empty bin, min_value() - 1 if nothing was binned.
+    int max() const;
+    int min_value() const { return m_min_value; }
+    int max_value() const { return m_max_value; }
+    strategy used_strategy() const { return m_strategy; }
+    const std::vector<size_t>& bins() const { return m_bins; }
+
+private:
+    strategy pick_strategy(size_t threads_amount) const;
+    void build_lane_split(const std::vector<int>& values, size_t threads_amount);
+    void build_private(const std::vector<int>& values, size_t threads_amount);
+    void build_sharded(const std::vector<int>& values, size_t threads_amount);
+
+    int m_min_value;
+    int m_max_value;
+    size_t m_bins_count;
+    strategy m_strategy = strategy::lane_split;
+    std::vector<size_t> m_bins;
+    // m_above[i] = values in bins i..end, so count_above is one lookup
+    std::vector<size_t> m_above;
+    size_t m_out_of_range = 0;
+};
+
+const char* to_string(parallel_histogram::strategy value);
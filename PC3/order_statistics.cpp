@@ -0,0 +1,279 @@
+#include "order_statistics.h"
+#include "chunked.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <utility>
+
+namespace {
+
+const uint32_t counting_sort_limit = 1 << 16;
+const size_t radix_buckets = 256;
+const size_t sequential_select_limit = 1 << 15;
+const size_t select_samples = 256;
+const size_t select_margin = 16;
+const int max_bad_select_rounds = 4;
+
+void counting_sort(std::vector<int>& values, int min_value, size_t buckets, size_t threads_amount) {
+    size_t size = values.size();
+    std::vector<size_t> counts(threads_amount * buckets, 0);
+    run_chunked(size, threads_amount, [&](size_t t, size_t begin, size_t end) {
+        size_t* local = &counts[t * buckets];
+        for (size_t i = begin; i < end; i++) {
+            local[values[i] - min_value]++;
+        }
+    });
+
+    // starts[b] is the first output position of bucket b
+    std::vector<size_t> starts(buckets + 1, 0);
+    for (size_t b = 0; b < buckets; b++) {
+        size_t total = 0;
+        for (size_t t = 0; t < threads_amount; t++) {
+            total += counts[t * buckets + b];
+        }
+        starts[b + 1] = starts[b] + total;
+    }
+
+    // Every thread rewrites its own slice of the output, so no write is shared.
+    run_chunked(size, threads_amount, [&](size_t, size_t begin, size_t end) {
+        size_t b = std::upper_bound(starts.begin(), starts.end(), begin) - starts.begin() - 1;
+        for (size_t i = begin; i < end; b++) {
+            size_t stop = std::min(end, starts[b + 1]);
+            std::fill(values.begin() + i, values.begin() + stop, min_value + static_cast<int>(b));
+            i = stop;
+        }
+    });
+}
+
+// Floyd-Rivest style bracket: two sample values that should enclose position n,
+// so the next round only keeps the (usually thin) band between them.
+std::pair<int, int> sample_bracket(const int* data, size_t size, size_t n, std::mt19937& rng) {
+    std::uniform_int_distribution<size_t> dist(0, size - 1);
+    std::vector<int> samples(select_samples);
+    for (int& sample : samples) {
+        sample = data[dist(rng)];
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t target = static_cast<size_t>(static_cast<double>(n) / size * select_samples);
+    size_t lo = target > select_margin ? target - select_margin : 0;
+    size_t hi = std::min(target + select_margin, select_samples - 1);
+    return { samples[lo], samples[hi] };
+}
+
+}
+
+void parallel_radix_sort(std::vector<int>& values, size_t threads_amount) {
+    size_t size = values.size();
+    if (size < 2) return;
+    threads_amount = effective_threads(size, threads_amount);
+
+    std::vector<int> local_min(threads_amount, INT_MAX);
+    std::vector<int> local_max(threads_amount, INT_MIN);
+    run_chunked(size, threads_amount, [&](size_t t, size_t begin, size_t end) {
+        int lo = INT_MAX;
+        int hi = INT_MIN;
+        for (size_t i = begin; i < end; i++) {
+            lo = std::min(lo, values[i]);
+            hi = std::max(hi, values[i]);
+        }
+        local_min[t] = lo;
+        local_max[t] = hi;
+    });
+    int min_value = *std::min_element(local_min.begin(), local_min.end());
+    int max_value = *std::max_element(local_max.begin(), local_max.end());
+    uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max_value) - min_value);
+
+    if (range < counting_sort_limit) {
+        counting_sort(values, min_value, static_cast<size_t>(range) + 1, threads_amount);
+        return;
+    }
+
+    // LSD passes over (value - min), skipping digits the range never reaches.
+    std::vector<int> buffer(size);
+    int* src = values.data();
+    int* dst = buffer.data();
+    std::vector<size_t> offsets(threads_amount * radix_buckets);
+    for (unsigned shift = 0; shift < 32 && (range >> shift) != 0; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        auto digit = [min_value, shift](int value) {
+            return (static_cast<uint32_t>(static_cast<int64_t>(value) - min_value) >> shift) & 0xFF;
+        };
+        run_chunked(size, threads_amount, [&](size_t t, size_t begin, size_t end) {
+            size_t* local = &offsets[t * radix_buckets];
+            for (size_t i = begin; i < end; i++) {
+                local[digit(src[i])]++;
+            }
+        });
+
+        // digit-major, thread-minor prefix keeps every pass stable
+        size_t running = 0;
+        for (size_t d = 0; d < radix_buckets; d++) {
+            for (size_t t = 0; t < threads_amount; t++) {
+                size_t count = offsets[t * radix_buckets + d];
+                offsets[t * radix_buckets + d] = running;
+                running += count;
+            }
+        }
+
+        run_chunked(size, threads_amount, [&](size_t t, size_t begin, size_t end) {
+            size_t* local = &offsets[t * radix_buckets];
+            for (size_t i = begin; i < end; i++) {
+                dst[local[digit(src[i])]++] = src[i];
+            }
+        });
+        std::swap(src, dst);
+    }
+
+    if (src != values.data()) {
+        values.swap(buffer);
+    }
+}
+
+int parallel_nth_element(const std::vector<int>& values, size_t n, size_t threads_amount) {
+    assert(n < values.size());
+    const int* data = values.data();
+    size_t size = values.size();
+    std::vector<int> candidates;
+    std::mt19937 rng(static_cast<unsigned>(size));
+    int bad_rounds = 0;
+
+    while (size > sequential_select_limit && bad_rounds < max_bad_select_rounds) {
+        size_t threads = effective_threads(size, threads_amount);
+        std::pair<int, int> bracket = sample_bracket(data, size, n, rng);
+        int lo = bracket.first;
+        int hi = bracket.second;
+
+        std::vector<size_t> below(threads, 0);
+        std::vector<size_t> inside(threads, 0);
+        std::vector<size_t> above(threads, 0);
+        run_chunked(size, threads, [&](size_t t, size_t begin, size_t end) {
+            size_t local_below = 0;
+            size_t local_inside = 0;
+            uint32_t width = static_cast<uint32_t>(hi) - static_cast<uint32_t>(lo);
+            for (size_t i = begin; i < end; i++) {
+                local_below += data[i] < lo;
+                local_inside += static_cast<uint32_t>(data[i]) - static_cast<uint32_t>(lo) <= width;
+            }
+            below[t] = local_below;
+            inside[t] = local_inside;
+            above[t] = (end - begin) - local_below - local_inside;
+        });
+
+        size_t total_below = 0;
+        size_t total_inside = 0;
+        for (size_t t = 0; t < threads; t++) {
+            total_below += below[t];
+            total_inside += inside[t];
+        }
+
+        std::vector<size_t>* kept = &inside;
+        if (n < total_below) {
+            kept = &below;
+        }
+        else if (n < total_below + total_inside) {
+            // Small-range data usually stops here: one value covers position n.
+            if (lo == hi) return lo;
+            n -= total_below;
+        }
+        else {
+            kept = &above;
+            n -= total_below + total_inside;
+        }
+
+        std::vector<size_t> offsets(threads, 0);
+        size_t next_size = 0;
+        for (size_t t = 0; t < threads; t++) {
+            offsets[t] = next_size;
+            next_size += (*kept)[t];
+        }
+
+        // Branchless compaction: every element is written, only kept ones advance the
+        // cursor. A thread stops once its share is full so it never writes past it.
+        std::vector<int> next(next_size);
+        auto compact = [&](auto keep) {
+            run_chunked(size, threads, [&](size_t t, size_t begin, size_t end) {
+                int* out = next.data() + offsets[t];
+                int* limit = out + (*kept)[t];
+                for (size_t i = begin; i < end && out != limit; i++) {
+                    int value = data[i];
+                    *out = value;
+                    out += keep(value);
+                }
+            });
+        };
+        if (kept == &below) {
+            compact([lo](int value) { return value < lo; });
+        }
+        else if (kept == &above) {
+            compact([hi](int value) { return value > hi; });
+        }
+        else {
+            compact([lo, hi](int value) { return value >= lo && value <= hi; });
+        }
+
+        if (next_size > size / 4 * 3) {
+            bad_rounds++;
+        }
+        candidates.swap(next);
+        data = candidates.data();
+        size = next_size;
+    }
+
+    // std::nth_element is introselect, so a run of bad pivots still ends in O(n).
+    if (candidates.empty() || data != candidates.data()) {
+        candidates.assign(data, data + size);
+    }
+    std::nth_element(candidates.begin(), candidates.begin() + n, candidates.end());
+    return candidates[n];
+}
+
+int parallel_percentile(const std::vector<int>& values, double percent, size_t threads_amount) {
+    assert(!values.empty() && percent >= 0.0 && percent <= 100.0);
+    size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * values.size()));
+    rank = std::clamp<size_t>(rank, 1, values.size());
+    return parallel_nth_element(values, rank - 1, threads_amount);
+}
+
+std::vector<int> parallel_top_k(const std::vector<int>& values, size_t k, size_t threads_amount) {
+    size_t size = values.size();
+    k = std::min(k, size);
+    if (k == 0) return {};
+    threads_amount = effective_threads(size, threads_amount);
+
+    using min_heap = std::priority_queue<int, std::vector<int>, std::greater<int>>;
+    std::vector<std::vector<int>> partial(threads_amount);
+    run_chunked(size, threads_amount, [&](size_t t, size_t begin, size_t end) {
+        std::vector<int> storage;
+        storage.reserve(k);
+        min_heap heap(std::greater<int>(), std::move(storage));
+        for (size_t i = begin; i < end; i++) {
+            if (heap.size() < k) {
+                heap.push(values[i]);
+            }
+            else if (values[i] > heap.top()) {
+                heap.pop();
+                heap.push(values[i]);
+            }
+        }
+        std::vector<int>& out = partial[t];
+        out.reserve(heap.size());
+        while (!heap.empty()) {
+            out.push_back(heap.top());
+            heap.pop();
+        }
+    });
+
+    std::vector<int> merged;
+    merged.reserve(threads_amount * k);
+    for (auto& local : partial) {
+        merged.insert(merged.end(), local.begin(), local.end());
+    }
+    std::partial_sort(merged.begin(), merged.begin() + k, merged.end(), std::greater<int>());
+    merged.resize(k);
+    return merged;
+}
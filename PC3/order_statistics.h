@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Order statistics over plain int vectors, split across `threads_amount` threads
+// the same way the PC3 benchmarks split g_values.
+
+// Sorts in place. Small value ranges (like the 0..32 benchmark data) go through a
+// single counting pass, wider ranges through an LSD radix sort with 8-bit digits.
+void parallel_radix_sort(std::vector<int>& values, size_t threads_amount);
+
+// Returns the value that would sit at position `n` after sorting. The input is not
+// reordered: each round counts the values below, inside and above a sampled bracket
+// in parallel and copies out the band holding `n`, until std::nth_element can finish.
+int parallel_nth_element(const std::vector<int>& values, size_t n, size_t threads_amount);
+
+// Nearest-rank percentile, `percent` in [0, 100]. percentile(v, 50, t) is the median.
+int parallel_percentile(const std::vector<int>& values, double percent, size_t threads_amount);
+
+// The `k` largest values in descending order. Every thread streams its chunk through
+// a bounded min-heap, the heaps are merged once at the end.
+std::vector<int> parallel_top_k(const std::vector<int>& values, size_t k, size_t threads_amount);
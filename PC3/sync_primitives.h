@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "../common/cache_line.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Hand-rolled locks compared against std::mutex/std::shared_mutex by the contention
+// suite. All of them spin with backoff and fall back to yielding, so they stay usable
+// when there are more threads than cores.
+
+inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Exponential pause backoff, switching to yield once the waits get long.
+class spin_backoff {
+public:
+    void pause();
+
+private:
+    static constexpr uint32_t yield_after = 1024;
+    uint32_t m_spins = 1;
+};
+
+// Test-and-test-and-set lock: waiters spin on a plain load and only retry the
+// exchange once the lock looks free.
+class spin_lock {
+public:
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    std::atomic<bool> m_locked{ false };
+};
+
+// FIFO lock: every thread takes a ticket and waits for its number to be served.
+class ticket_lock {
+public:
+    void lock();
+    void unlock();
+
+private:
+    alignas(cache_line_size) std::atomic<uint32_t> m_next{ 0 };
+    alignas(cache_line_size) std::atomic<uint32_t> m_serving{ 0 };
+};
+
+// MCS queue lock: each waiter spins on a flag in its own node, so a release touches
+// exactly one other waiter's cache line. The node must stay alive until unlock().
+class mcs_lock {
+public:
+    struct alignas(cache_line_size) node {
+        std::atomic<node*> next{ nullptr };
+        std::atomic<bool> locked{ false };
+    };
+
+    void lock(node& self);
+    void unlock(node& self);
+
+private:
+    std::atomic<node*> m_tail{ nullptr };
+};
+
+// CLH queue lock: each waiter spins on its predecessor's node. On release a thread
+// keeps its predecessor's node for the next acquisition, so nodes migrate between
+// threads; a handle owns whichever node it holds and the lock owns the tail node.
+class clh_lock {
+public:
+    struct alignas(cache_line_size) node {
+        std::atomic<bool> locked{ false };
+    };
+
+    class handle {
+    public:
+        handle() : m_node(new node()) {}
+        ~handle() { delete m_node; }
+        handle(const handle&) = delete;
+        handle& operator=(const handle&) = delete;
+
+    private:
+        friend class clh_lock;
+        node* m_node;
+        node* m_predecessor = nullptr;
+    };
+
+    clh_lock() : m_tail(new node()) {}
+    ~clh_lock() { delete m_tail.load(); }
+    clh_lock(const clh_lock&) = delete;
+    clh_lock& operator=(const clh_lock&) = delete;
+
+    void lock(handle& self);
+    void unlock(handle& self);
+
+private:
+    std::atomic<node*> m_tail;
+};
+
+inline void spin_backoff::pause() {
+    if (m_spins < yield_after) {
+        for (uint32_t i = 0; i < m_spins; i++) {
+            cpu_relax();
+        }
+        m_spins *= 2;
+    }
+    else {
+        std::this_thread::yield();
+    }
+}
+
+inline void spin_lock::lock() {
+    spin_backoff backoff;
+    for (;;) {
+        if (!m_locked.exchange(true, std::memory_order_acquire)) return;
+        while (m_locked.load(std::memory_order_relaxed)) {
+            backoff.pause();
+        }
+    }
+}
+
+inline bool spin_lock::try_lock() {
+    return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+}
+
+inline void spin_lock::unlock() {
+    m_locked.store(false, std::memory_order_release);
+}
+
+inline void ticket_lock::lock() {
+    uint32_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+    spin_backoff backoff;
+    while (m_serving.load(std::memory_order_acquire) != ticket) {
+        backoff.pause();
+    }
+}
+
+inline void ticket_lock::unlock() {
+    m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+inline void mcs_lock::lock(node& self) {
+    self.next.store(nullptr, std::memory_order_relaxed);
+    self.locked.store(true, std::memory_order_relaxed);
+    node* predecessor = m_tail.exchange(&self, std::memory_order_acq_rel);
+    if (predecessor == nullptr) return;
+
+    predecessor->next.store(&self, std::memory_order_release);
+    spin_backoff backoff;
+    while (self.locked.load(std::memory_order_acquire)) {
+        backoff.pause();
+    }
+}
+
+inline void mcs_lock::unlock(node& self) {
+    node* successor = self.next.load(std::memory_order_acquire);
+    if (successor == nullptr) {
+        node* expected = &self;
+        if (m_tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) return;
+        // A new waiter swapped the tail but has not linked itself in yet.
+        spin_backoff backoff;
+        while ((successor = self.next.load(std::memory_order_acquire)) == nullptr) {
+            backoff.pause();
+        }
+    }
+    successor->locked.store(false, std::memory_order_release);
+}
+
+inline void clh_lock::lock(handle& self) {
+    self.m_node->locked.store(true, std::memory_order_relaxed);
+    self.m_predecessor = m_tail.exchange(self.m_node, std::memory_order_acq_rel);
+    spin_backoff backoff;
+    while (self.m_predecessor->locked.load(std::memory_order_acquire)) {
+        backoff.pause();
+    }
+}
+
+inline void clh_lock::unlock(handle& self) {
+    node* released = self.m_node;
+    self.m_node = self.m_predecessor;
+    released->locked.store(false, std::memory_order_release);
+}
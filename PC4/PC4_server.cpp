@@ -1,153 +1,120 @@
-﻿#include <winsock2.h>
+﻿#ifdef _WIN32
+#include <winsock2.h>
 #include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include "../common/io_ring.h"
+#include "epoll_server.h"
+#include "uring_server.h"
+#endif
 #include <iostream>
 #include <thread>
-#include <unordered_map>
 #include <vector>
 #include <mutex>
-#include <condition_variable>
-#include <sstream>
-
-#pragma comment(lib, "Ws2_32.lib")
+#include <memory>
+#include <climits>
+#include <algorithm>
+#include <string>
+#include "protocol.h"
+#include "server_core.h"
+#include "server_metrics.h"
 
 #define DEFAULT_PORT "27015"
-#define BUFFER_SIZE 1000000 // 10000 x 10000 int req ~400MB
-
-enum TaskStatus { PENDING, COMPLETED };
-
-struct Task {
-    std::string result;
-    int size;
-    TaskStatus status;
-};
+#define BUFFER_SIZE 65536 // recv chunk; frames are reassembled across reads
+#define COMPUTE_QUEUE_CAPACITY 1024 // tasks waiting for a worker before clients get STATUS_BUSY
 
-std::unordered_map<SOCKET, std::unordered_map<int, Task>> clientTasks;
-std::mutex taskMutex;
-std::condition_variable taskCv;
-bool serverRunning = true;
 void dbg_count() {
     static int num = 1;
     std::cout << num << std::endl;
     num++;
 }
 
-void PrintMatrix(const int* matrix, int size, const std::string& matrixName) {
-    std::cout << matrixName << ":\n";
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < size; ++j) {
-            std::cout << matrix[i * size + j] << " ";
-        }
-        std::cout << "\n";
+#ifdef _WIN32
+
+bool SendAll(SOCKET socket, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        int chunk = static_cast<int>(length < INT_MAX ? length : INT_MAX);
+        int sent = send(socket, reinterpret_cast<const char*>(data), chunk, 0);
+        if (sent <= 0) return false;
+        Metrics().bytesSent.add(sent);
+        data += sent;
+        length -= sent;
     }
+    return true;
 }
 
+// Thread-per-connection client on a blocking socket. Workers reply on the same socket as
+// the client thread, so every frame goes out whole under the send lock; `connected`
+// stops late workers from writing to a socket that has already been closed.
+class SocketConnection : public Connection {
+public:
+    explicit SocketConnection(SOCKET socket) : m_socket(socket) {}
+
+    void Send(OutgoingFrame frame) override {
+        FrameQueued(frame);
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (!m_connected) return;
+        if (!SendAll(m_socket, frame.head.data(), frame.head.size()) ||
+            !SendAll(m_socket, frame.body, frame.bodyLength)) {
+            m_connected = false;
+            return;
+        }
+        FrameSent(frame);
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_connected = false;
+        closesocket(m_socket);
+    }
+
+private:
+    SOCKET m_socket;
+    std::mutex m_sendMutex;
+    bool m_connected = true;
+};
+
 void HandleClient(SOCKET clientSocket) {
     std::cout << "Client connected: " << clientSocket << std::endl;
 
-    while (serverRunning) {
-        char buffer[BUFFER_SIZE];
-        int recvResult = recv(clientSocket, buffer, BUFFER_SIZE-1, 0);
-        //std::cout << recvResult << std::endl;
-        if (recvResult <= 0) break;
-        buffer[recvResult] = '\0';
-        std::string command(buffer);
-        std::istringstream iss(command);
-        std::string cmd;
-        iss >> cmd;
-        if (cmd == "process") {
-            int matrixSize, taskId;
-            iss >> matrixSize >> taskId;
-            std::string matrixData;
-            std::getline(iss, matrixData);
-
-            {
-                std::unique_lock<std::mutex> lock(taskMutex);
-                clientTasks[clientSocket][taskId] = Task{ "", matrixSize, PENDING };
-            }
-            std::thread([clientSocket, matrixSize, taskId, matrixData]() {
-                std::istringstream matrixStream(matrixData);
-                int* matrixA = new int[matrixSize * matrixSize];
-                int* matrixB = new int[matrixSize * matrixSize];
-
-                for (int i = 0; i < matrixSize * matrixSize; ++i) {
-                    matrixStream >> matrixA[i];
-                }
-                for (int i = 0; i < matrixSize * matrixSize; ++i) {
-                    matrixStream >> matrixB[i];
-                }
-
-                if (matrixSize <= 5) {
-                    PrintMatrix(matrixA, matrixSize, "Matrix A");
-                    PrintMatrix(matrixB, matrixSize, "Matrix B");
-                }
-
-                int* result = new int[matrixSize * matrixSize];
-                std::ostringstream resultStream;
-                for (int i = 0; i < matrixSize * matrixSize; ++i) {
-                    result[i] = matrixA[i] - matrixB[i];
-                    resultStream << result[i] << " ";
-                }
-
-                if (matrixSize <= 5) {
-                    PrintMatrix(result, matrixSize, "Result Matrix");
-                }
-
-                {
-                    std::unique_lock<std::mutex> lock(taskMutex);
-                    clientTasks[clientSocket][taskId].result = resultStream.str();
-                    clientTasks[clientSocket][taskId].status = COMPLETED;
-                }
-                taskCv.notify_all();
-
-                delete[] matrixA;
-                delete[] matrixB;
-                delete[] result;
-
-                send(clientSocket, "completed", 9, 0);
-                }).detach();
+    auto client = std::make_shared<SocketConnection>(clientSocket);
+    std::shared_ptr<Connection> connection = client;
+    FrameReader reader;
+    Frame frame;
+    std::vector<char> buffer(BUFFER_SIZE);
+
+    while (ServerRunning()) {
+        // Large payload remainders are received in place, small reads go through buffer.
+        size_t remaining = 0;
+        uint8_t* target = reader.PayloadTarget(remaining);
+        if (target != nullptr && remaining >= BUFFER_SIZE) {
+            int recvResult = recv(clientSocket, reinterpret_cast<char*>(target), static_cast<int>(remaining < INT_MAX ? remaining : INT_MAX), 0);
+            if (recvResult <= 0) break;
+            reader.CommitPayload(recvResult);
         }
-        else if (cmd == "status") {
-            int taskId;
-            iss >> taskId;
-            std::unique_lock<std::mutex> lock(taskMutex);
-            if (clientTasks[clientSocket].find(taskId) != clientTasks[clientSocket].end()) {
-                std::string status = clientTasks[clientSocket][taskId].status == PENDING ? "pending" : "completed";
-                send(clientSocket, status.c_str(), status.size(), 0);
-            }
-            else {
-                send(clientSocket, "unknown", 7, 0);
-            }
+        else {
+            int recvResult = recv(clientSocket, buffer.data(), BUFFER_SIZE, 0);
+            if (recvResult <= 0) break;
+            metric_timer timer(Metrics().parseTime);
+            reader.Feed(buffer.data(), recvResult);
         }
-        else if (cmd == "result") {
-            int taskId;
-            iss >> taskId;
-            std::unique_lock<std::mutex> lock(taskMutex);
-            if (clientTasks[clientSocket].find(taskId) != clientTasks[clientSocket].end() && clientTasks[clientSocket][taskId].status == COMPLETED) {
-                send(clientSocket, clientTasks[clientSocket][taskId].result.c_str(), clientTasks[clientSocket][taskId].result.size(), 0);
-            }
-            else if (clientTasks[clientSocket].find(taskId) != clientTasks[clientSocket].end()) {
-                send(clientSocket, "pending", 7, 0);
-            }
-            else {
-                send(clientSocket, "unknown", 7, 0);
-            }
+        bool keepRunning = true;
+        while (keepRunning && reader.Next(frame)) {
+            keepRunning = HandleFrame(connection, frame);
         }
-        else if (cmd == "shutdown") {
-            serverRunning = false;
+        if (!keepRunning) break;
+        if (reader.Failed()) {
+            std::cerr << "Malformed frame from client " << clientSocket << std::endl;
             break;
         }
     }
 
-    {
-        std::unique_lock<std::mutex> lock(taskMutex);
-        clientTasks.erase(clientSocket);
-    }
-
-    closesocket(clientSocket);
+    ConnectionClosed(*client);
+    client->Close();
     std::cout << "Client disconnected: " << clientSocket << std::endl;
 }
 
-int main() {
+int RunWinsockServer() {
     WSADATA wsaData;
     int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (iResult != 0) {
@@ -198,7 +165,7 @@ int main() {
 
     std::cout << "Server is listening on port " << DEFAULT_PORT << std::endl;
 
-    while (serverRunning) {
+    while (ServerRunning()) {
         SOCKET clientSocket = accept(listenSocket, NULL, NULL);
         if (clientSocket == INVALID_SOCKET) {
             std::cerr << "accept failed: " << WSAGetLastError() << std::endl;
@@ -214,3 +181,26 @@ int main() {
 
     return 0;
 }
+
+#endif
+
+int main(int argc, char* argv[]) {
+    // PC4_server [spill directory]: results evicted from memory are written there
+    TaskStore::Config storeConfig;
+    if (argc > 1) {
+        storeConfig.spillDirectory = argv[1];
+    }
+    StartServerCore(0, COMPUTE_QUEUE_CAPACITY, storeConfig);
+#ifdef _WIN32
+    int exitCode = RunWinsockServer();
+#else
+    // A few I/O threads are plenty: they only move bytes, the workers do the compute.
+    size_t ioThreadsAmount = std::max(1u, std::thread::hardware_concurrency() / 4);
+    uint16_t port = static_cast<uint16_t>(std::stoi(DEFAULT_PORT));
+    // io_uring where the kernel has what it needs, unless IO_ENGINE=epoll asks otherwise.
+    bool served = io_ring::enabled() ? RunUringServer(port, ioThreadsAmount) : RunEpollServer(port, ioThreadsAmount);
+    int exitCode = served ? 0 : 1;
+#endif
+    StopServerCore();
+    return exitCode;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Non-blocking TCP client sockets for the programs that talk to PC4_server from a
+// poll loop (the load generator and the client library), on Winsock and POSIX alike.
+// On Windows the caller runs WSAStartup first.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment (lib, "Ws2_32.lib")
+using SocketHandle = SOCKET;
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using SocketHandle = int;
+constexpr SocketHandle INVALID_SOCKET = -1;
+#endif
+
+#ifdef _WIN32
+inline bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+inline void CloseSocket(SocketHandle socket) { closesocket(socket); }
+inline int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs); }
+constexpr int SEND_FLAGS = 0;
+#else
+inline bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+inline void CloseSocket(SocketHandle socket) { close(socket); }
+inline int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return poll(fds, static_cast<nfds_t>(count), timeoutMs); }
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#endif
+
+inline bool SetNonBlocking(SocketHandle socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Blocking connect, then non-blocking from there on.
+inline SocketHandle ConnectTcp(const std::string& host, uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return INVALID_SOCKET;
+    }
+    SocketHandle connected = INVALID_SOCKET;
+    for (addrinfo* address = result; address != nullptr; address = address->ai_next) {
+        SocketHandle candidate = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (candidate == INVALID_SOCKET) continue;
+        if (connect(candidate, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) {
+            connected = candidate;
+            break;
+        }
+        CloseSocket(candidate);
+    }
+    freeaddrinfo(result);
+    if (connected == INVALID_SOCKET) return INVALID_SOCKET;
+
+    int noDelay = 1;
+    setsockopt(connected, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    if (!SetNonBlocking(connected)) {
+        CloseSocket(connected);
+        return INVALID_SOCKET;
+    }
+    return connected;
+}
+
+// A loopback UDP socket connected to itself: sending it a byte wakes a thread blocked in
+// PollSockets on it. Works where pipes and eventfd do not (WSAPoll takes sockets only).
+inline SocketHandle OpenWakeSocket() {
+    SocketHandle wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake == INVALID_SOCKET) return INVALID_SOCKET;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(wake, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || getsockname(wake, reinterpret_cast<sockaddr*>(&address), &length) != 0
+        || connect(wake, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || !SetNonBlocking(wake)) {
+        CloseSocket(wake);
+        return INVALID_SOCKET;
+    }
+    return wake;
+}
+
+inline void WakeSocket(SocketHandle wake) {
+    char byte = 0;
+    send(wake, &byte, 1, 0);
+}
+
+inline void DrainWakeSocket(SocketHandle wake) {
+    char bytes[64];
+    while (recv(wake, bytes, sizeof(bytes), 0) > 0) {
+    }
+}
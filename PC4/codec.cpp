@@ -0,0 +1,356 @@
+#include "codec.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr size_t FOR_HEADER_SIZE = 5;
+// LZ: the last literals of a band are never part of a match, as in LZ4, so the
+// matcher can read 4 bytes ahead without bounds checks.
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_LAST_LITERALS = 5;
+constexpr size_t LZ_MATCH_LIMIT = 12;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr int LZ_HASH_BITS = 12;
+
+uint32_t Load32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+        (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+void Store32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+size_t PackedBytes(size_t count, unsigned width) {
+    return (static_cast<uint64_t>(count) * width + 7) / 8;
+}
+
+size_t EncodeFor(const uint8_t* values, size_t count, uint8_t* out) {
+    uint32_t minimum = 0;
+    uint32_t range = 0;
+    if (count > 0) {
+        int32_t low = static_cast<int32_t>(Load32(values));
+        int32_t high = low;
+        for (size_t i = 1; i < count; i++) {
+            int32_t value = static_cast<int32_t>(Load32(values + i * 4));
+            low = std::min(low, value);
+            high = std::max(high, value);
+        }
+        minimum = static_cast<uint32_t>(low);
+        range = static_cast<uint32_t>(high) - minimum;
+    }
+    unsigned width = 0;
+    while (width < 32 && (range >> width) != 0) width++;
+
+    Store32(out, minimum);
+    out[4] = static_cast<uint8_t>(width);
+    uint8_t* cursor = out + FOR_HEADER_SIZE;
+    uint64_t pending = 0;
+    unsigned bits = 0;
+    for (size_t i = 0; i < count && width > 0; i++) {
+        pending |= static_cast<uint64_t>(Load32(values + i * 4) - minimum) << bits;
+        bits += width;
+        if (bits >= 32) {
+            Store32(cursor, static_cast<uint32_t>(pending));
+            cursor += 4;
+            pending >>= 32;
+            bits -= 32;
+        }
+    }
+    while (bits > 0) {
+        *cursor++ = static_cast<uint8_t>(pending);
+        pending >>= 8;
+        bits = bits > 8 ? bits - 8 : 0;
+    }
+    return cursor - out;
+}
+
+bool DecodeFor(const uint8_t* in, size_t length, uint8_t* values, size_t count) {
+    if (length < FOR_HEADER_SIZE) return false;
+    uint32_t minimum = Load32(in);
+    unsigned width = in[4];
+    if (width > 32 || length - FOR_HEADER_SIZE != PackedBytes(count, width)) return false;
+
+    const uint8_t* cursor = in + FOR_HEADER_SIZE;
+    const uint8_t* end = in + length;
+    uint32_t mask = width == 32 ? 0xFFFFFFFFu : (uint32_t(1) << width) - 1;
+    uint64_t pending = 0;
+    unsigned bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        // The exact length check above guarantees the bytes are there.
+        while (bits < width) {
+            if (end - cursor >= 4) {
+                pending |= static_cast<uint64_t>(Load32(cursor)) << bits;
+                cursor += 4;
+                bits += 32;
+            }
+            else {
+                pending |= static_cast<uint64_t>(*cursor++) << bits;
+                bits += 8;
+            }
+        }
+        Store32(values + i * 4, minimum + (static_cast<uint32_t>(pending) & mask));
+        pending >>= width;
+        bits -= width;
+    }
+    return true;
+}
+
+size_t EncodeDeltaVarint(const uint8_t* values, size_t count, uint8_t* out) {
+    uint8_t* cursor = out;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = Load32(values + i * 4);
+        uint32_t delta = value - previous;
+        previous = value;
+        uint32_t zigzag = (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+        while (zigzag >= 0x80) {
+            *cursor++ = static_cast<uint8_t>(zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        *cursor++ = static_cast<uint8_t>(zigzag);
+    }
+    return cursor - out;
+}
+
+bool DecodeDeltaVarint(const uint8_t* in, size_t length, uint8_t* values, size_t count) {
+    const uint8_t* cursor = in;
+    const uint8_t* end = in + length;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t zigzag = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            if (cursor == end || shift > 28) return false;
+            uint8_t byte = *cursor++;
+            zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) break;
+        }
+        uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+        previous += delta;
+        Store32(values + i * 4, previous);
+    }
+    return cursor == end;
+}
+
+uint8_t* PutLength(uint8_t* cursor, size_t length) {
+    while (length >= 255) {
+        *cursor++ = 255;
+        length -= 255;
+    }
+    *cursor++ = static_cast<uint8_t>(length);
+    return cursor;
+}
+
+uint8_t* PutSequence(uint8_t* cursor, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    uint8_t* token = cursor++;
+    *token = static_cast<uint8_t>(std::min<size_t>(literalLength, 15) << 4);
+    if (literalLength >= 15) cursor = PutLength(cursor, literalLength - 15);
+    std::memcpy(cursor, literals, literalLength);
+    cursor += literalLength;
+    if (matchLength == 0) return cursor; // the closing literals
+    cursor[0] = static_cast<uint8_t>(offset);
+    cursor[1] = static_cast<uint8_t>(offset >> 8);
+    cursor += 2;
+    size_t extra = matchLength - LZ_MIN_MATCH;
+    *token |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+    if (extra >= 15) cursor = PutLength(cursor, extra - 15);
+    return cursor;
+}
+
+size_t EncodeLz(const uint8_t* source, size_t length, uint8_t* out) {
+    std::array<uint32_t, size_t(1) << LZ_HASH_BITS> table{};
+    uint8_t* cursor = out;
+    size_t anchor = 0;
+    size_t position = 0;
+    while (length >= LZ_MATCH_LIMIT && position < length - LZ_MATCH_LIMIT) {
+        uint32_t sequence = Load32(source + position);
+        uint32_t slot = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[slot];
+        table[slot] = static_cast<uint32_t>(position);
+        if (candidate >= position || position - candidate > LZ_MAX_OFFSET || Load32(source + candidate) != sequence) {
+            position++;
+            continue;
+        }
+        size_t matchLength = LZ_MIN_MATCH;
+        while (position + matchLength < length - LZ_LAST_LITERALS && source[candidate + matchLength] == source[position + matchLength]) {
+            matchLength++;
+        }
+        cursor = PutSequence(cursor, source + anchor, position - anchor, position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+    return PutSequence(cursor, source + anchor, length - anchor, 0, 0) - out;
+}
+
+bool GetLength(const uint8_t*& cursor, const uint8_t* end, size_t& length) {
+    while (true) {
+        if (cursor == end) return false;
+        uint8_t byte = *cursor++;
+        length += byte;
+        if (byte != 255) return true;
+    }
+}
+
+bool DecodeLz(const uint8_t* in, size_t length, uint8_t* out, size_t outLength) {
+    const uint8_t* cursor = in;
+    const uint8_t* end = in + length;
+    size_t written = 0;
+    while (cursor < end) {
+        uint8_t token = *cursor++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !GetLength(cursor, end, literalLength)) return false;
+        if (literalLength > static_cast<size_t>(end - cursor) || literalLength > outLength - written) return false;
+        std::memcpy(out + written, cursor, literalLength);
+        cursor += literalLength;
+        written += literalLength;
+        if (cursor == end) break; // closing literals
+
+        if (end - cursor < 2) return false;
+        size_t offset = cursor[0] | (static_cast<size_t>(cursor[1]) << 8);
+        cursor += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !GetLength(cursor, end, matchLength)) return false;
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > written || matchLength > outLength - written) return false;
+        uint8_t* target = out + written;
+        const uint8_t* match = target - offset;
+        if (offset >= matchLength) {
+            std::memcpy(target, match, matchLength);
+        }
+        else {
+            // Overlapping match: repeats the last `offset` bytes.
+            for (size_t i = 0; i < matchLength; i++) target[i] = match[i];
+        }
+        written += matchLength;
+    }
+    return written == outLength;
+}
+
+}
+
+size_t BandLayout::BandSize(size_t band, size_t totalElements) const {
+    return std::min(bandElements, totalElements - BandBegin(band));
+}
+
+size_t BandElements(size_t cols) {
+    size_t rows = std::max<size_t>(1, CODEC_BAND_ELEMENTS / std::max<size_t>(cols, 1));
+    return rows * std::max<size_t>(cols, 1);
+}
+
+size_t HeaderSize(size_t bandCount) {
+    return 8 + 4 * bandCount;
+}
+
+size_t MaxEncodedBandSize(uint8_t codec, size_t count) {
+    size_t bytes = count * 4;
+    switch (codec) {
+    case CODEC_FOR: return FOR_HEADER_SIZE + bytes;
+    case CODEC_DELTA_VARINT: return count * 5;
+    case CODEC_LZ: return bytes + bytes / 255 + 16;
+    default: return bytes;
+    }
+}
+
+uint64_t MaxEncodedPayloadSize(uint8_t codec, uint64_t totalElements) {
+    // A band of n elements never needs more than n one-element bands would, index
+    // entries included, so one-element bands bound every layout.
+    return 8 + totalElements * (4 + MaxEncodedBandSize(codec, 1));
+}
+
+size_t EncodeBand(uint8_t codec, const uint8_t* values, size_t count, uint8_t* out) {
+    switch (codec) {
+    case CODEC_FOR: return EncodeFor(values, count, out);
+    case CODEC_DELTA_VARINT: return EncodeDeltaVarint(values, count, out);
+    case CODEC_LZ: return EncodeLz(values, count * 4, out);
+    default:
+        std::memcpy(out, values, count * 4);
+        return count * 4;
+    }
+}
+
+bool DecodeBand(uint8_t codec, const uint8_t* in, size_t length, uint8_t* values, size_t count) {
+    switch (codec) {
+    case CODEC_FOR: return DecodeFor(in, length, values, count);
+    case CODEC_DELTA_VARINT: return DecodeDeltaVarint(in, length, values, count);
+    case CODEC_LZ: return DecodeLz(in, length, values, count * 4);
+    case CODEC_NONE:
+        if (length != count * 4) return false;
+        std::memcpy(values, in, length);
+        return true;
+    default: return false;
+    }
+}
+
+bool ParseBandLayout(const uint8_t* data, size_t length, size_t totalElements, BandLayout& layout) {
+    if (length < 8) return false;
+    layout.bandElements = Load32(data);
+    layout.bandCount = Load32(data + 4);
+    if (layout.bandElements == 0 || layout.bandCount != (totalElements + layout.bandElements - 1) / layout.bandElements) return false;
+    if ((length - 8) / 4 < layout.bandCount) return false;
+
+    layout.offsets.resize(layout.bandCount + 1);
+    size_t offset = HeaderSize(layout.bandCount);
+    for (size_t band = 0; band < layout.bandCount; band++) {
+        layout.offsets[band] = offset;
+        offset += Load32(data + 8 + band * 4);
+        if (offset > length) return false;
+    }
+    layout.offsets[layout.bandCount] = offset;
+    return offset == length;
+}
+
+std::vector<uint8_t> AssembleBands(size_t bandElements, const std::vector<std::vector<uint8_t>>& bands) {
+    size_t total = HeaderSize(bands.size());
+    for (const auto& band : bands) total += band.size();
+    std::vector<uint8_t> payload(total);
+    Store32(payload.data(), static_cast<uint32_t>(bandElements));
+    Store32(payload.data() + 4, static_cast<uint32_t>(bands.size()));
+    size_t offset = HeaderSize(bands.size());
+    for (size_t i = 0; i < bands.size(); i++) {
+        Store32(payload.data() + 8 + i * 4, static_cast<uint32_t>(bands[i].size()));
+        std::memcpy(payload.data() + offset, bands[i].data(), bands[i].size());
+        offset += bands[i].size();
+    }
+    return payload;
+}
+
+std::vector<uint8_t> EncodePayload(uint8_t codec, const uint8_t* values, size_t totalElements, size_t cols) {
+    size_t bandElements = BandElements(cols);
+    size_t bandCount = (totalElements + bandElements - 1) / bandElements;
+    std::vector<std::vector<uint8_t>> bands(bandCount);
+    for (size_t band = 0; band < bandCount; band++) {
+        size_t begin = band * bandElements;
+        size_t count = std::min(bandElements, totalElements - begin);
+        bands[band].resize(MaxEncodedBandSize(codec, count));
+        bands[band].resize(EncodeBand(codec, values + begin * 4, count, bands[band].data()));
+    }
+    return AssembleBands(bandElements, bands);
+}
+
+bool DecodePayload(uint8_t codec, const uint8_t* data, size_t length, uint8_t* values, size_t totalElements) {
+    BandLayout layout;
+    if (!ParseBandLayout(data, length, totalElements, layout)) return false;
+    for (size_t band = 0; band < layout.bandCount; band++) {
+        size_t begin = layout.BandBegin(band);
+        if (!DecodeBand(codec, data + layout.offsets[band], layout.offsets[band + 1] - layout.offsets[band],
+            values + begin * 4, layout.BandSize(band, totalElements))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* CodecName(uint8_t codec) {
+    switch (codec) {
+    case CODEC_NONE: return "none";
+    case CODEC_FOR: return "for";
+    case CODEC_DELTA_VARINT: return "delta";
+    case CODEC_LZ: return "lz";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compression of int32 matrix payloads. The PC4 inputs are small non-negative numbers
+// and the results small differences, so most of each 32-bit slot is wasted on the wire.
+//
+// An encoded payload is split into bands of whole rows that are coded independently,
+// so the server can encode and decode them in parallel:
+//
+//   u32 bandElements      elements per band (the last one may be shorter)
+//   u32 bandCount         ceil(total elements / bandElements)
+//   u32 bandBytes[count]  encoded length of each band
+//   band data, back to back
+//
+// All integers are little-endian. The element count itself is not stored: it follows
+// from the frame's rows and cols, as for raw payloads.
+enum Codec : uint8_t {
+    CODEC_NONE = 0,
+    // Frame of reference: i32 minimum, u8 bit width, then every value - minimum in
+    // exactly that many bits, LSB first. rand() % 100 inputs take 7 bits per element.
+    CODEC_FOR = 1,
+    // Zigzag LEB128 varints of the differences between neighbours; wins on smooth data.
+    CODEC_DELTA_VARINT = 2,
+    // LZ4-style byte-level matching over the raw little-endian elements, for data with
+    // repeats rather than small ranges.
+    CODEC_LZ = 3,
+};
+
+constexpr uint32_t CodecBit(uint8_t codec) { return uint32_t(1) << codec; }
+constexpr uint32_t SUPPORTED_CODECS = CodecBit(CODEC_NONE) | CodecBit(CODEC_FOR) | CodecBit(CODEC_DELTA_VARINT) | CodecBit(CODEC_LZ);
+// Bands are cut to whole rows of about this many elements.
+constexpr size_t CODEC_BAND_ELEMENTS = size_t(1) << 16;
+
+inline bool CodecSupported(uint8_t codec) { return codec < 32 && (SUPPORTED_CODECS & CodecBit(codec)) != 0; }
+
+// Where the bands of an encoded payload are.
+struct BandLayout {
+    size_t bandElements = 0;
+    size_t bandCount = 0;
+    // Start of each band's data inside the payload, plus the end of the last one.
+    std::vector<size_t> offsets;
+
+    size_t BandBegin(size_t band) const { return band * bandElements; }
+    size_t BandSize(size_t band, size_t totalElements) const;
+};
+
+// Elements per band for rows of `cols` elements.
+size_t BandElements(size_t cols);
+size_t HeaderSize(size_t bandCount);
+
+// Worst-case encoded size of `count` elements, to size band buffers.
+size_t MaxEncodedBandSize(uint8_t codec, size_t count);
+// Largest payload of `totalElements` elements that can be valid in `codec`, whatever
+// band size its encoder picked.
+uint64_t MaxEncodedPayloadSize(uint8_t codec, uint64_t totalElements);
+// `values` and the decoded output are `count` little-endian int32s. EncodeBand returns
+// the bytes written; DecodeBand is false on malformed input, never reading or writing
+// out of bounds.
+size_t EncodeBand(uint8_t codec, const uint8_t* values, size_t count, uint8_t* out);
+bool DecodeBand(uint8_t codec, const uint8_t* in, size_t length, uint8_t* values, size_t count);
+
+// Validates the band index of an encoded payload of `totalElements` elements.
+bool ParseBandLayout(const uint8_t* data, size_t length, size_t totalElements, BandLayout& layout);
+// Joins independently encoded bands into one payload.
+std::vector<uint8_t> AssembleBands(size_t bandElements, const std::vector<std::vector<uint8_t>>& bands);
+
+// Whole payload on the calling thread, for small payloads and the client.
+std::vector<uint8_t> EncodePayload(uint8_t codec, const uint8_t* values, size_t totalElements, size_t cols);
+bool DecodePayload(uint8_t codec, const uint8_t* data, size_t length, uint8_t* values, size_t totalElements);
+
+const char* CodecName(uint8_t codec);
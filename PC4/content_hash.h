@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+// 128-bit fingerprint of a request's input, the key of the result cache. Every 8-byte
+// word is mixed together with its position and the mixes are summed, so ranges can be
+// hashed on any thread in any order and added up. Words and positions are keyed with a
+// seed drawn once per process, so a client cannot build inputs that collide without
+// knowing it.
+struct ContentKey {
+    uint64_t first = 0;
+    uint64_t second = 0;
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+
+    bool operator==(const ContentKey& other) const {
+        return first == other.first && second == other.second && rows == other.rows && cols == other.cols;
+    }
+};
+
+struct ContentKeyHash {
+    size_t operator()(const ContentKey& key) const { return static_cast<size_t>(key.first ^ (key.second >> 7)); }
+};
+
+inline uint64_t MixWord(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+struct ContentHashSeed {
+    uint64_t first;
+    uint64_t firstStride; // odd, so every position gets a different tweak
+    uint64_t second;
+    uint64_t secondStride;
+};
+
+inline const ContentHashSeed& HashSeed() {
+    static const ContentHashSeed seed = []() {
+        std::random_device device;
+        auto next = [&device]() { return static_cast<uint64_t>(device()) << 32 | device(); };
+        ContentHashSeed drawn;
+        drawn.first = next();
+        drawn.firstStride = next() | 1;
+        drawn.second = next();
+        drawn.secondStride = next() | 1;
+        return drawn;
+    }();
+    return seed;
+}
+
+// Adds the hashes of words [firstWord, lastWord) of `data` to `first` and `second`.
+inline void HashWords(const uint8_t* data, size_t firstWord, size_t lastWord, uint64_t& first, uint64_t& second) {
+    const ContentHashSeed& seed = HashSeed();
+    uint64_t sumFirst = 0;
+    uint64_t sumSecond = 0;
+    for (size_t index = firstWord; index < lastWord; ++index) {
+        uint64_t word;
+        std::memcpy(&word, data + index * 8, 8);
+        sumFirst += MixWord(word ^ seed.first ^ (index * seed.firstStride));
+        sumSecond += MixWord(((word ^ seed.second) + index * seed.secondStride) * 0xD6E8FEB86659FD93ULL);
+    }
+    first += sumFirst;
+    second += sumSecond;
+}
@@ -0,0 +1,411 @@
+#include "epoll_server.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "server_core.h"
+#include "server_metrics.h"
+
+namespace {
+
+const int MAX_EVENTS = 256;
+const size_t READ_CHUNK = 65536;
+// Payload remainders at least this large are read into the payload buffer directly.
+const size_t DIRECT_READ_MIN_BYTES = 16384;
+// Smaller bodies are cheaper to copy than to pin and wait for a completion.
+const size_t ZEROCOPY_MIN_BYTES = 256 * 1024;
+// epoll_wait timeout, bounds how long an idle I/O thread takes to notice shutdown.
+const int POLL_TIMEOUT_MS = 200;
+
+// Output that did not fit into the socket buffer waits in `pending` until EPOLLOUT.
+// Workers call Send directly: when nothing is queued they write straight to the socket
+// and only fall back to the queue on EAGAIN, so the common small reply costs one send
+// and no wakeup of the I/O thread. Header and body go out in one sendmsg; bodies of at
+// least ZEROCOPY_MIN_BYTES are sent with MSG_ZEROCOPY after their header, and the
+// frame's owner is kept alive until the kernel reports on the error queue that it is
+// done with the pages.
+class EpollConnection : public Connection {
+public:
+    explicit EpollConnection(int fd) : m_fd(fd) {
+        int enable = 1;
+        m_zeroCopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+    }
+
+    void Send(OutgoingFrame frame) override {
+        FrameQueued(frame);
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (m_closed || m_broken) return;
+        if (m_pending.empty()) {
+            size_t sent = 0;
+            if (!WriteSome(frame, sent)) return;
+            if (sent == frame.Size()) {
+                FrameSent(frame);
+                return;
+            }
+            m_pendingOffset = sent;
+        }
+        m_pending.push_back(std::move(frame));
+        Metrics().sendQueueFrames.add();
+    }
+
+    // EPOLLOUT: the socket has room again.
+    void Flush() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        while (!m_closed && !m_broken && !m_pending.empty()) {
+            OutgoingFrame& front = m_pending.front();
+            if (!WriteSome(front, m_pendingOffset)) return;
+            if (m_pendingOffset < front.Size()) return;
+            FrameSent(front);
+            m_pending.pop_front();
+            Metrics().sendQueueFrames.sub();
+            m_pendingOffset = 0;
+        }
+    }
+
+    // EPOLLERR: drains zero-copy completions from the error queue. False if the socket
+    // has a real error pending.
+    bool ReapErrorQueue() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        while (true) {
+            char control[128];
+            msghdr message{};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (recvmsg(m_fd, &message, MSG_ERRQUEUE) < 0) break;
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+                bool recvError = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                    (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                if (!recvError) continue;
+                auto* error = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+                if (error->ee_errno != 0 || error->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+                // [ee_info, ee_data] is a range of completed sends; they finish in order.
+                while (!m_zeroCopyInFlight.empty() && static_cast<int32_t>(m_zeroCopyInFlight.front().first - error->ee_data) <= 0) {
+                    m_zeroCopyInFlight.pop_front();
+                }
+            }
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        return error == 0;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (m_closed) return;
+        m_closed = true;
+        DropPending();
+        // Pages of in-flight zero-copy sends stay pinned by the kernel; once the socket
+        // is closed their contents no longer matter.
+        m_zeroCopyInFlight.clear();
+        close(m_fd);
+    }
+
+    int Fd() const { return m_fd; }
+    FrameReader& Reader() { return m_reader; }
+
+private:
+    // Writes from `offset` until the frame is done or EAGAIN. False if the peer is gone;
+    // the I/O thread notices the hang-up through epoll and closes the connection.
+    bool WriteSome(const OutgoingFrame& frame, size_t& offset) {
+        while (offset < frame.Size()) {
+            iovec parts[2];
+            int partsAmount = 0;
+            if (offset < frame.head.size()) {
+                parts[partsAmount++] = { const_cast<uint8_t*>(frame.head.data()) + offset, frame.head.size() - offset };
+            }
+            size_t bodyOffset = offset > frame.head.size() ? offset - frame.head.size() : 0;
+            size_t bodyLeft = frame.bodyLength - bodyOffset;
+            if (bodyLeft > 0) {
+                parts[partsAmount++] = { const_cast<uint8_t*>(frame.body) + bodyOffset, bodyLeft };
+            }
+            msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = partsAmount;
+
+            // Only the body is kept alive until the kernel is done with it; the head is
+            // freed as soon as the frame is written, so it must never be sent zero-copy.
+            // It goes out first on its own, corked onto the body by MSG_MORE.
+            bool zeroCopy = m_zeroCopy && bodyLeft >= ZEROCOPY_MIN_BYTES;
+            int flags = MSG_NOSIGNAL;
+            if (zeroCopy && partsAmount == 2) {
+                message.msg_iovlen = 1;
+                zeroCopy = false;
+                flags |= MSG_MORE;
+            }
+            else if (zeroCopy) {
+                flags |= MSG_ZEROCOPY;
+            }
+            ssize_t result = sendmsg(m_fd, &message, flags);
+            if (result < 0 && zeroCopy && errno == ENOBUFS) {
+                // Out of optmem for pinned pages: send this chunk the ordinary way.
+                zeroCopy = false;
+                result = sendmsg(m_fd, &message, MSG_NOSIGNAL);
+            }
+            if (result > 0) {
+                offset += static_cast<size_t>(result);
+                Metrics().bytesSent.add(result);
+                if (zeroCopy) {
+                    m_zeroCopyInFlight.emplace_back(m_zeroCopySequence++, frame.owner);
+                }
+            }
+            else if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            else {
+                DropPending();
+                m_broken = true; // the fd itself is closed by the I/O thread
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void DropPending() {
+        Metrics().sendQueueFrames.sub(static_cast<int64_t>(m_pending.size()));
+        m_pending.clear();
+    }
+
+    int m_fd;
+    FrameReader m_reader; // touched by the owning I/O thread only
+    std::mutex m_sendMutex;
+    std::deque<OutgoingFrame> m_pending;
+    size_t m_pendingOffset = 0;
+    bool m_closed = false;
+    bool m_broken = false;
+    bool m_zeroCopy = false;
+    uint32_t m_zeroCopySequence = 0;
+    std::deque<std::pair<uint32_t, std::shared_ptr<const void>>> m_zeroCopyInFlight;
+};
+
+}
+
+int OpenListenSocket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "socket failed: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        std::cerr << "SO_REUSEPORT failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "bind failed with error: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "Listen failed with error: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+namespace {
+
+class IoThread {
+public:
+    IoThread(int listenFd, int epollFd) : m_listenFd(listenFd), m_epollFd(epollFd), m_buffer(READ_CHUNK) {}
+
+    ~IoThread() {
+        for (auto& entry : m_connections) {
+            ConnectionClosed(*entry.second);
+            entry.second->Close();
+        }
+        close(m_listenFd);
+        close(m_epollFd);
+    }
+
+    void Run() {
+        epoll_event events[MAX_EVENTS];
+        while (ServerRunning()) {
+            int ready = epoll_wait(m_epollFd, events, MAX_EVENTS, POLL_TIMEOUT_MS);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            for (int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if (fd == m_listenFd) {
+                    AcceptAll();
+                }
+                else {
+                    HandleEvent(fd, events[i].events);
+                }
+            }
+        }
+    }
+
+private:
+    void AcceptAll() {
+        while (true) {
+            int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.fd = fd;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                std::cerr << "epoll_ctl failed: " << std::strerror(errno) << std::endl;
+                close(fd);
+                continue;
+            }
+            m_connections[fd] = std::make_shared<EpollConnection>(fd);
+            std::cout << "Client connected: " << fd << std::endl;
+        }
+    }
+
+    void HandleEvent(int fd, uint32_t events) {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end()) return;
+        std::shared_ptr<EpollConnection> connection = it->second;
+
+        bool keep = true;
+        if (events & EPOLLERR) {
+            keep = connection->ReapErrorQueue();
+        }
+        if (keep && (events & EPOLLOUT)) {
+            connection->Flush();
+        }
+        if (keep && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+            keep = ReadAll(connection);
+        }
+        if (!keep) {
+            Drop(fd);
+        }
+    }
+
+    // Edge-triggered: drain the socket until EAGAIN, or the next event never comes.
+    // While a large payload is being received the read lands in the payload buffer
+    // itself, with the shared buffer behind it in the same readv to catch whatever
+    // follows (the next frame's header).
+    bool ReadAll(const std::shared_ptr<EpollConnection>& connection) {
+        FrameReader& reader = connection->Reader();
+        Frame frame;
+        while (true) {
+            iovec parts[2];
+            int partsAmount = 0;
+            size_t direct = 0;
+            uint8_t* target = reader.PayloadTarget(direct);
+            if (target != nullptr && direct >= DIRECT_READ_MIN_BYTES) {
+                parts[partsAmount++] = { target, direct };
+            }
+            else {
+                direct = 0;
+            }
+            parts[partsAmount++] = { m_buffer.data(), m_buffer.size() };
+
+            ssize_t received = readv(connection->Fd(), parts, partsAmount);
+            if (received == 0) return false;
+            if (received < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            size_t intoPayload = std::min(static_cast<size_t>(received), direct);
+            if (intoPayload != 0) {
+                reader.CommitPayload(intoPayload);
+            }
+            if (static_cast<size_t>(received) > intoPayload) {
+                metric_timer timer(Metrics().parseTime);
+                reader.Feed(m_buffer.data(), static_cast<size_t>(received) - intoPayload);
+            }
+            while (reader.Next(frame)) {
+                if (!HandleFrame(connection, frame)) return false;
+            }
+            if (reader.Failed()) {
+                std::cerr << "Malformed frame from client " << connection->Fd() << std::endl;
+                return false;
+            }
+        }
+    }
+
+    void Drop(int fd) {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end()) return;
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ConnectionClosed(*it->second);
+        it->second->Close();
+        m_connections.erase(it);
+        std::cout << "Client disconnected: " << fd << std::endl;
+    }
+
+    int m_listenFd;
+    int m_epollFd;
+    std::vector<char> m_buffer; // one read buffer per thread, shared by its connections
+    std::unordered_map<int, std::shared_ptr<EpollConnection>> m_connections;
+};
+
+}
+
+bool RunEpollServer(uint16_t port, size_t ioThreadsAmount) {
+    if (ioThreadsAmount == 0) ioThreadsAmount = 1;
+
+    std::vector<std::unique_ptr<IoThread>> ioThreads;
+    for (size_t i = 0; i < ioThreadsAmount; i++) {
+        int listenFd = OpenListenSocket(port);
+        if (listenFd < 0) return false;
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = listenFd;
+        if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+            std::cerr << "epoll setup failed: " << std::strerror(errno) << std::endl;
+            close(listenFd);
+            if (epollFd >= 0) close(epollFd);
+            return false;
+        }
+        ioThreads.push_back(std::make_unique<IoThread>(listenFd, epollFd));
+    }
+
+    std::cout << "Server is listening on port " << port << " (epoll, " << ioThreadsAmount << " I/O threads)" << std::endl;
+
+    std::vector<std::thread> threads;
+    for (auto& ioThread : ioThreads) {
+        threads.emplace_back([&ioThread]() { ioThread->Run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+
+// Event-driven backend for Linux. Every I/O thread owns an edge-triggered epoll
+// instance and its own listening socket bound with SO_REUSEPORT, so the kernel spreads
+// new connections over the threads and accept never contends on a shared socket.
+// Sockets are non-blocking; a connection costs its FrameReader buffer and pending
+// output, not a thread. Frames are handed to the server core, whose bounded pool does
+// the compute. Returns when a client sends OP_SHUTDOWN, or false if setup failed.
+bool RunEpollServer(uint16_t port, size_t ioThreadsAmount);
+
+// A non-blocking SO_REUSEPORT socket listening on `port`, or -1 (reported on stderr).
+// Shared with the io_uring backend, whose I/O threads each listen the same way.
+int OpenListenSocket(uint16_t port);
+
+#endif
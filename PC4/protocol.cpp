@@ -0,0 +1,270 @@
+#include "protocol.h"
+#include "codec.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+
+namespace {
+
+void PutU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+void PutU64(uint8_t* out, uint64_t value) {
+    PutU32(out, static_cast<uint32_t>(value));
+    PutU32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t GetU32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 |
+        static_cast<uint32_t>(in[2]) << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+
+uint64_t GetU64(const uint8_t* in) {
+    return static_cast<uint64_t>(GetU32(in)) | static_cast<uint64_t>(GetU32(in + 4)) << 32;
+}
+
+// Most a payload of `elements` int32s may take, raw or in the frame's codec.
+uint64_t MaxMatrixPayload(const FrameHeader& header, uint64_t elements) {
+    elements = std::min(elements, MAX_PAYLOAD_SIZE);
+    if (header.codec == CODEC_NONE) return elements * sizeof(int32_t);
+    return MaxEncodedPayloadSize(header.codec, elements);
+}
+
+// Longest payload the frame's opcode can carry; the handlers check the exact length.
+uint64_t MaxPayloadLength(const FrameHeader& header) {
+    uint64_t count = static_cast<uint64_t>(header.rows) * header.cols;
+    switch (header.opcode) {
+    case OP_PROCESS:
+    case OP_STREAM_CHUNK: return MaxMatrixPayload(header, 2 * std::min(count, MAX_PAYLOAD_SIZE));
+    case OP_RESULT_REPLY:
+    case OP_STREAM_RESULT: return MaxMatrixPayload(header, count);
+    case OP_STATS_REPLY: return MAX_PAYLOAD_SIZE;
+    default: return 0;
+    }
+}
+
+}
+
+void EncodeHeader(const FrameHeader& header, uint8_t* out) {
+    PutU32(out, FRAME_MAGIC);
+    out[4] = header.version;
+    out[5] = header.opcode;
+    out[6] = header.dtype;
+    out[7] = static_cast<uint8_t>((header.flags & 0x0F) | (header.codec << 4));
+    PutU32(out + 8, header.taskId);
+    PutU32(out + 12, header.rows);
+    PutU32(out + 16, header.cols);
+    PutU32(out + 20, CarriesFirstRow(header.opcode) ? header.firstRow : header.status);
+    PutU64(out + 24, header.payloadLength);
+}
+
+bool DecodeHeader(const uint8_t* in, FrameHeader& header) {
+    if (GetU32(in) != FRAME_MAGIC || in[4] != PROTOCOL_VERSION) {
+        return false;
+    }
+    header.version = in[4];
+    header.opcode = in[5];
+    header.dtype = in[6];
+    header.flags = in[7] & 0x0F;
+    header.codec = in[7] >> 4;
+    header.taskId = GetU32(in + 8);
+    header.rows = GetU32(in + 12);
+    header.cols = GetU32(in + 16);
+    if (CarriesFirstRow(header.opcode)) {
+        header.status = STATUS_OK;
+        header.firstRow = GetU32(in + 20);
+    }
+    else {
+        header.status = GetU32(in + 20);
+        header.firstRow = 0;
+    }
+    header.payloadLength = GetU64(in + 24);
+    return header.payloadLength <= MAX_PAYLOAD_SIZE;
+}
+
+std::vector<uint8_t> BuildFrame(const FrameHeader& header, const void* payload, size_t payloadLength) {
+    FrameHeader sized = header;
+    sized.payloadLength = payloadLength;
+    std::vector<uint8_t> frame(FRAME_HEADER_SIZE + payloadLength);
+    EncodeHeader(sized, frame.data());
+    if (payloadLength != 0) {
+        std::memcpy(frame.data() + FRAME_HEADER_SIZE, payload, payloadLength);
+    }
+    return frame;
+}
+
+OutgoingFrame BuildMatrixReply(FrameHeader header, std::shared_ptr<const void> owner, const int32_t* values, size_t count) {
+    header.dtype = DTYPE_INT32;
+    header.payloadLength = count * sizeof(int32_t);
+    OutgoingFrame frame;
+    frame.head.resize(FRAME_HEADER_SIZE);
+    EncodeHeader(header, frame.head.data());
+    frame.owner = std::move(owner);
+    frame.body = reinterpret_cast<const uint8_t*>(values);
+    frame.bodyLength = header.payloadLength;
+    return frame;
+}
+
+OutgoingFrame BuildEncodedReply(FrameHeader header, std::shared_ptr<const void> owner, const uint8_t* payload, size_t length) {
+    header.dtype = DTYPE_INT32;
+    header.payloadLength = length;
+    OutgoingFrame frame;
+    frame.head.resize(FRAME_HEADER_SIZE);
+    EncodeHeader(header, frame.head.data());
+    frame.owner = std::move(owner);
+    frame.body = payload;
+    frame.bodyLength = length;
+    return frame;
+}
+
+void WriteInt32LE(const int* values, size_t count, uint8_t* out) {
+    for (size_t i = 0; i < count; ++i) {
+        PutU32(out + i * 4, static_cast<uint32_t>(values[i]));
+    }
+}
+
+void ReadInt32LE(const uint8_t* in, size_t count, int* values) {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<int>(GetU32(in + i * 4));
+    }
+}
+
+void SwapInt32LEInPlace(int32_t* values, size_t count) {
+    if constexpr (std::endian::native != std::endian::little) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t value = static_cast<uint32_t>(values[i]);
+            values[i] = static_cast<int32_t>((value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24));
+        }
+    }
+}
+
+const char* OpcodeName(uint8_t opcode) {
+    switch (opcode) {
+    case OP_PROCESS: return "process";
+    case OP_STATUS: return "status";
+    case OP_RESULT: return "result";
+    case OP_SHUTDOWN: return "shutdown";
+    case OP_STREAM_BEGIN: return "stream begin";
+    case OP_STREAM_CHUNK: return "stream chunk";
+    case OP_HELLO: return "hello";
+    case OP_STATS: return "stats";
+    case OP_COMPLETED: return "completed";
+    case OP_STATUS_REPLY: return "status reply";
+    case OP_RESULT_REPLY: return "result reply";
+    case OP_ERROR: return "error";
+    case OP_STREAM_RESULT: return "stream result";
+    case OP_HELLO_REPLY: return "hello reply";
+    case OP_STATS_REPLY: return "stats reply";
+    }
+    return "unknown";
+}
+
+const char* StatusName(uint32_t status) {
+    switch (status) {
+    case STATUS_OK: return "ok";
+    case STATUS_PENDING: return "pending";
+    case STATUS_COMPLETED: return "completed";
+    case STATUS_UNKNOWN: return "unknown";
+    case STATUS_BAD_REQUEST: return "bad request";
+    case STATUS_BUSY: return "busy";
+    case STATUS_DUPLICATE: return "duplicate task id";
+    case STATUS_EVICTED: return "evicted";
+    }
+    return "unknown";
+}
+
+void FrameReader::Feed(const char* data, size_t length) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+    while (length > 0 && !m_failed) {
+        if (!m_inPayload) {
+            size_t take = std::min(length, FRAME_HEADER_SIZE - m_headerFill);
+            std::memcpy(m_header + m_headerFill, in, take);
+            m_headerFill += take;
+            in += take;
+            length -= take;
+            if (m_headerFill == FRAME_HEADER_SIZE) {
+                StartPayload();
+            }
+        }
+        else {
+            size_t remaining = 0;
+            uint8_t* target = PayloadTarget(remaining);
+            if (target == nullptr) break;
+            size_t take = std::min(length, remaining);
+            std::memcpy(target, in, take);
+            in += take;
+            length -= take;
+            CommitPayload(take);
+        }
+    }
+}
+
+bool FrameReader::Next(Frame& frame) {
+    if (m_ready.empty()) return false;
+    frame = std::move(m_ready.front());
+    m_ready.pop_front();
+    return true;
+}
+
+uint8_t* FrameReader::PayloadTarget(size_t& remaining) {
+    remaining = 0;
+    if (!m_inPayload) return nullptr;
+    if (m_payloadFill == m_current.payload.size() && !GrowPayload()) return nullptr;
+    remaining = m_current.payload.size() - m_payloadFill;
+    return m_current.payload.data() + m_payloadFill;
+}
+
+void FrameReader::CommitPayload(size_t length) {
+    m_payloadFill += length;
+    if (m_inPayload && m_payloadFill == m_current.header.payloadLength) {
+        FinishFrame();
+    }
+}
+
+void FrameReader::StartPayload() {
+    m_headerFill = 0;
+    if (!DecodeHeader(m_header, m_current.header) || m_current.header.payloadLength > MaxPayloadLength(m_current.header)) {
+        m_failed = true;
+        return;
+    }
+    m_current.payload.reset();
+    m_payloadFill = 0;
+    m_inPayload = true;
+    if (m_current.header.payloadLength == 0) {
+        FinishFrame();
+        return;
+    }
+    GrowPayload();
+}
+
+bool FrameReader::GrowPayload() {
+    // The first part only, then, once it has arrived, the rest in one go: at most
+    // PAYLOAD_RESERVE_SIZE bytes are ever copied.
+    size_t length = static_cast<size_t>(m_current.header.payloadLength);
+    size_t size = m_current.payload.empty() ? std::min(length, PAYLOAD_RESERVE_SIZE) : length;
+    try {
+        pooled_buffer grown = buffer_pool::shared().acquire(size);
+        if (m_payloadFill != 0) {
+            std::memcpy(grown.data(), m_current.payload.data(), m_payloadFill);
+        }
+        m_current.payload = std::move(grown);
+    }
+    catch (const std::bad_alloc&) {
+        m_failed = true;
+        m_inPayload = false;
+        m_current = Frame();
+        return false;
+    }
+    return true;
+}
+
+void FrameReader::FinishFrame() {
+    m_inPayload = false;
+    m_ready.push_back(std::move(m_current));
+    m_current = Frame();
+}
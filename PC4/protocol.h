@@ -0,0 +1,198 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../common/buffer_pool.h"
+
+// Binary framing shared by PC4_server and PC4_client. Every message is a fixed
+// 32-byte header followed by `payloadLength` bytes of payload. All header fields and
+// matrix elements are little-endian.
+//
+//   offset  size  field
+//        0     4  magic ("PC4F")
+//        4     1  version
+//        5     1  opcode
+//        6     1  dtype of the payload elements
+//        7     1  flags (low nibble) and payload codec (high nibble)
+//        8     4  taskId
+//       12     4  rows
+//       16     4  cols
+//       20     4  status (replies) / first row (stream chunks and results) / 0
+//       24     8  payloadLength
+//
+// OP_PROCESS carries matrix A followed by matrix B, rows x cols each. The result of a
+// completed task comes back as OP_RESULT_REPLY with one rows x cols matrix.
+//
+// taskId is the client's correlation id: a connection may have many tasks in flight
+// and may send requests back to back without waiting for replies. Replies carry the
+// id of the request they answer and arrive in completion order, not request order.
+// A submit with FLAG_PUSH_RESULT gets its OP_RESULT_REPLY pushed the moment the task
+// finishes (no OP_COMPLETED, no polling), after which the server forgets the task.
+// Without the flag the server sends OP_COMPLETED and keeps the result for OP_RESULT.
+//
+// Matrices too large for one frame, or that should not be held whole by either side,
+// are streamed: OP_STREAM_BEGIN announces rows x cols, then OP_STREAM_CHUNKs carry row
+// bands in order (firstRow, rows = band height, payload = A band then B band). Each band
+// is computed as soon as it arrives and comes back as an OP_STREAM_RESULT with the same
+// firstRow, in completion order; OP_COMPLETED follows the last one. At most
+// MAX_STREAM_WINDOW bands may be unanswered at a time, which bounds memory on both ends.
+//
+// Matrix payloads may be compressed (codec.h); the frame's codec says how, and rows and
+// cols still give the element count. A client may always send compressed requests in
+// any codec the server supports. To get compressed replies it sends OP_HELLO with the
+// bit mask of codecs it can decode in `status`; OP_HELLO_REPLY returns the mask the
+// server accepts in `status` and, as its codec, the one it will use for this
+// connection's matrix replies from then on (CODEC_NONE if there is no common one).
+//
+// OP_STATS asks for the server's metrics (server_metrics.h). OP_STATS_REPLY carries them
+// as text in the Prometheus exposition format, dtype DTYPE_NONE.
+
+constexpr uint32_t FRAME_MAGIC = 0x46344350; // "PC4F" read as little-endian
+constexpr uint8_t PROTOCOL_VERSION = 1;
+constexpr size_t FRAME_HEADER_SIZE = 32;
+// Anything larger is treated as a corrupt stream rather than allocated.
+constexpr uint64_t MAX_PAYLOAD_SIZE = uint64_t(1) << 31;
+// Payload bytes allocated before any of them have arrived; the full declared length is
+// allocated only once this much has, so a header alone never commits more memory.
+constexpr size_t PAYLOAD_RESERVE_SIZE = size_t(1) << 20;
+// Stream chunks a client may have sent and not yet received results for.
+constexpr uint32_t MAX_STREAM_WINDOW = 16;
+
+enum Opcode : uint8_t {
+    OP_PROCESS = 1,
+    OP_STATUS = 2,
+    OP_RESULT = 3,
+    OP_SHUTDOWN = 4,
+    OP_STREAM_BEGIN = 5,
+    OP_STREAM_CHUNK = 6,
+    OP_HELLO = 7,
+    OP_STATS = 8,
+    OP_COMPLETED = 16,
+    OP_STATUS_REPLY = 17,
+    OP_RESULT_REPLY = 18,
+    OP_ERROR = 19,
+    OP_STREAM_RESULT = 20,
+    OP_HELLO_REPLY = 21,
+    OP_STATS_REPLY = 22,
+};
+
+// Only the low nibble of the flags byte; the high one carries FrameHeader::codec.
+enum FrameFlags : uint8_t {
+    FLAG_PUSH_RESULT = 1 << 0,
+};
+
+enum DataType : uint8_t {
+    DTYPE_NONE = 0,
+    DTYPE_INT32 = 1,
+};
+
+enum ReplyStatus : uint32_t {
+    STATUS_OK = 0,
+    STATUS_PENDING = 1,
+    STATUS_COMPLETED = 2,
+    STATUS_UNKNOWN = 3,
+    STATUS_BAD_REQUEST = 4,
+    STATUS_BUSY = 5, // compute queue or the connection's in-flight limit is full, retry later
+    STATUS_DUPLICATE = 6, // a task with this id is still running on this connection
+    STATUS_EVICTED = 7, // the task completed but its result was dropped to stay within memory budgets
+};
+
+struct FrameHeader {
+    uint8_t version = PROTOCOL_VERSION;
+    uint8_t opcode = 0;
+    uint8_t dtype = DTYPE_NONE;
+    uint8_t flags = 0;
+    uint8_t codec = 0; // a Codec from codec.h, CODEC_NONE for raw little-endian elements
+    uint32_t taskId = 0;
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    uint32_t status = STATUS_OK;
+    uint32_t firstRow = 0; // sent in place of status by OP_STREAM_CHUNK and OP_STREAM_RESULT
+    uint64_t payloadLength = 0;
+};
+
+inline bool CarriesFirstRow(uint8_t opcode) {
+    return opcode == OP_STREAM_CHUNK || opcode == OP_STREAM_RESULT;
+}
+
+// Payloads live in buffers from buffer_pool::shared(), aligned for int32 access, so a
+// matrix payload can be used in place without copying it out.
+struct Frame {
+    FrameHeader header;
+    pooled_buffer payload;
+};
+
+// A frame on its way out: encoded header (plus any small payload) in `head`, and a
+// large payload sent straight from the memory that already holds it. `owner` keeps that
+// memory alive until the last byte has left.
+struct OutgoingFrame {
+    std::vector<uint8_t> head;
+    std::shared_ptr<const void> owner;
+    const uint8_t* body = nullptr;
+    size_t bodyLength = 0;
+    // When the connection got it, for the send timing.
+    std::chrono::steady_clock::time_point queued;
+
+    size_t Size() const { return head.size() + bodyLength; }
+};
+
+void EncodeHeader(const FrameHeader& header, uint8_t* out);
+// False if the bytes do not start a frame this build understands.
+bool DecodeHeader(const uint8_t* in, FrameHeader& header);
+
+// Header plus payload in one buffer, ready for a single send loop.
+std::vector<uint8_t> BuildFrame(const FrameHeader& header, const void* payload = nullptr, size_t payloadLength = 0);
+
+// Header-only frame whose int32 payload is sent from `values` (count elements), which
+// `owner` keeps alive. `values` must already be in wire order.
+OutgoingFrame BuildMatrixReply(FrameHeader header, std::shared_ptr<const void> owner, const int32_t* values, size_t count);
+// Same for a payload that is already encoded (header.codec set by the caller).
+OutgoingFrame BuildEncodedReply(FrameHeader header, std::shared_ptr<const void> owner, const uint8_t* payload, size_t length);
+
+void WriteInt32LE(const int* values, size_t count, uint8_t* out);
+void ReadInt32LE(const uint8_t* in, size_t count, int* values);
+// Converts between wire and host order in place. A no-op on little-endian hosts, which
+// is what lets payload buffers be computed on directly.
+void SwapInt32LEInPlace(int32_t* values, size_t count);
+
+const char* OpcodeName(uint8_t opcode);
+const char* StatusName(uint32_t status);
+
+// Reassembles frames from a byte stream that arrives in arbitrary pieces: a frame may
+// be split over several reads and one read may hold several frames. Bytes go straight
+// into the frame's own payload buffer. For large payloads the caller can skip the
+// intermediate read buffer too: PayloadTarget() tells where the next part of the
+// current payload goes, the socket reads there, and CommitPayload() accounts for it.
+class FrameReader {
+public:
+    void Feed(const char* data, size_t length);
+    // Moves the next complete frame out, false if none is buffered yet.
+    bool Next(Frame& frame);
+    // Set once a header fails to decode, declares more payload than its opcode can
+    // carry, or the payload cannot be allocated; the connection should be dropped.
+    bool Failed() const { return m_failed; }
+
+    // Unfilled part of the payload buffer, nullptr between payloads or once failed.
+    // May be less than the rest of the payload: the first PAYLOAD_RESERVE_SIZE bytes
+    // go into a buffer of their own.
+    uint8_t* PayloadTarget(size_t& remaining);
+    void CommitPayload(size_t length);
+
+private:
+    void StartPayload();
+    // Takes the first buffer of a payload, or moves its first part into a full-size one.
+    bool GrowPayload();
+    void FinishFrame();
+
+    uint8_t m_header[FRAME_HEADER_SIZE];
+    size_t m_headerFill = 0;
+    bool m_inPayload = false;
+    Frame m_current;
+    size_t m_payloadFill = 0;
+    std::deque<Frame> m_ready;
+    bool m_failed = false;
+};
@@ -0,0 +1,640 @@
+#include "server_core.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "../common/compute_scheduler.h"
+#include "codec.h"
+#include "server_metrics.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> serverRunning{ true };
+std::atomic<uint64_t> nextConnectionId{ 1 };
+std::unique_ptr<compute_scheduler> computePool;
+std::unique_ptr<TaskStore> taskStore;
+
+// Both are set before the first connection is accepted and live until exit.
+sampled_gauge computeJobsGauge{ "pc4_compute_queued_jobs", "Jobs accepted by the compute pool and not finished: tasks, bands, codec and hash work.",
+    []() { return computePool ? static_cast<double>(computePool->jobs_in_system()) : 0.0; } };
+sampled_gauge storeMemoryGauge{ "pc4_task_store_bytes", "Memory the task store holds for tasks and their results.",
+    []() { return taskStore ? static_cast<double>(taskStore->MemoryUsed()) : 0.0; } };
+
+// Payloads up to this many 8-byte words are fingerprinted right on the I/O thread;
+// larger ones are hashed in parallel tiles on the compute pool.
+const size_t INLINE_HASH_WORDS = size_t(1) << 15;
+// Compressed payloads up to this many elements are encoded or decoded on the calling
+// thread; larger ones band by band on the compute pool.
+const size_t INLINE_CODEC_ELEMENTS = size_t(1) << 15;
+// Reply codec chosen by OP_HELLO: the first of these the client can decode.
+const uint8_t REPLY_CODEC_PREFERENCE[] = { CODEC_FOR, CODEC_DELTA_VARINT, CODEC_LZ };
+
+// A streamed task: bands arrive in row order and are computed and answered one by one,
+// so the server holds at most MAX_STREAM_WINDOW bands of it.
+struct StreamState {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t nextRow = 0;
+    uint32_t rowsDone = 0;
+    uint32_t bandsInFlight = 0;
+};
+
+std::unordered_map<uint64_t, std::unordered_map<uint32_t, StreamState>> streams;
+std::mutex streamMutex;
+
+struct TaskInfo {
+    std::shared_ptr<Connection> connection;
+    uint32_t taskId;
+    int rows;
+    int cols;
+    Clock::time_point received;
+
+    size_t Count() const { return static_cast<size_t>(rows) * cols; }
+};
+
+void PrintMatrix(const int* matrix, int rows, int cols, const std::string& matrixName) {
+    std::cout << matrixName << ":\n";
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            std::cout << matrix[i * cols + j] << " ";
+        }
+        std::cout << "\n";
+    }
+}
+
+void SendReply(Connection& connection, uint8_t opcode, uint32_t taskId, uint32_t status) {
+    FrameHeader header;
+    header.opcode = opcode;
+    header.taskId = taskId;
+    header.status = status;
+    connection.Send(BuildFrame(header));
+}
+
+void RejectTask(const TaskInfo& task, uint32_t status) {
+    Metrics().tasksRejected.add();
+    taskStore->Abort(task.connection->Id(), task.taskId);
+    SendReply(*task.connection, OP_ERROR, task.taskId, status);
+}
+
+void RejectBusy(const TaskInfo& task) {
+    RejectTask(task, STATUS_BUSY);
+}
+
+// Bands of `layout` that start in elements [begin, end): a compute tile claims the
+// bands starting inside it, so every band is coded exactly once whatever the tiling.
+void BandsStartingIn(const BandLayout& layout, size_t begin, size_t end, size_t& firstBand, size_t& lastBand) {
+    firstBand = std::min((begin + layout.bandElements - 1) / layout.bandElements, layout.bandCount);
+    lastBand = std::min((end + layout.bandElements - 1) / layout.bandElements, layout.bandCount);
+}
+
+bool DecodeBands(uint8_t codec, const pooled_buffer& encoded, const BandLayout& layout, size_t totalElements,
+    size_t firstBand, size_t lastBand, pooled_buffer& decoded) {
+    for (size_t band = firstBand; band < lastBand; band++) {
+        size_t offset = layout.offsets[band];
+        if (!DecodeBand(codec, encoded.data() + offset, layout.offsets[band + 1] - offset,
+            decoded.data() + layout.BandBegin(band) * sizeof(int32_t), layout.BandSize(band, totalElements))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+using PayloadHandler = std::function<void(const std::shared_ptr<pooled_buffer>&)>;
+using FailureHandler = std::function<void(uint32_t status)>;
+
+// Hands a matrix payload of `totalElements` elements to `next` in raw form. Compressed
+// payloads are decoded into a fresh buffer first, in parallel bands on the compute pool
+// when large, so `next` may run on a worker. `failed` gets STATUS_BAD_REQUEST for a
+// malformed payload or STATUS_BUSY when the pool is full.
+void DecodeThen(uint64_t owner, pooled_buffer encoded, uint8_t codec, size_t totalElements, PayloadHandler next, FailureHandler failed) {
+    if (codec == CODEC_NONE) {
+        next(std::make_shared<pooled_buffer>(std::move(encoded)));
+        return;
+    }
+    BandLayout layout;
+    if (!ParseBandLayout(encoded.data(), encoded.size(), totalElements, layout)) {
+        failed(STATUS_BAD_REQUEST);
+        return;
+    }
+    auto decoded = std::make_shared<pooled_buffer>(buffer_pool::shared().acquire(totalElements * sizeof(int32_t)));
+    Clock::time_point started = Clock::now();
+    if (totalElements <= INLINE_CODEC_ELEMENTS) {
+        bool valid = DecodeBands(codec, encoded, layout, totalElements, 0, layout.bandCount, *decoded);
+        Metrics().decodeTime.record_since(started);
+        if (valid) {
+            next(decoded);
+        }
+        else {
+            failed(STATUS_BAD_REQUEST);
+        }
+        return;
+    }
+
+    struct DecodeJob {
+        pooled_buffer encoded;
+        BandLayout layout;
+        std::atomic<bool> malformed{ false };
+    };
+    auto job = std::make_shared<DecodeJob>();
+    job->encoded = std::move(encoded);
+    job->layout = std::move(layout);
+    bool queued = computePool->try_submit(owner, totalElements,
+        [job, decoded, codec, totalElements](size_t begin, size_t end) {
+            size_t firstBand;
+            size_t lastBand;
+            BandsStartingIn(job->layout, begin, end, firstBand, lastBand);
+            if (!DecodeBands(codec, job->encoded, job->layout, totalElements, firstBand, lastBand, *decoded)) {
+                job->malformed.store(true, std::memory_order_relaxed);
+            }
+        },
+        [job, decoded, next, failed, started]() {
+            Metrics().decodeTime.record_since(started);
+            if (job->malformed.load(std::memory_order_relaxed)) {
+                failed(STATUS_BAD_REQUEST);
+            }
+            else {
+                next(decoded);
+            }
+        });
+    if (!queued) {
+        failed(STATUS_BUSY);
+    }
+}
+
+// A matrix reply in `codec`, encoded on the calling thread.
+OutgoingFrame EncodeMatrixReply(FrameHeader header, std::shared_ptr<const void> owner, const int32_t* values, size_t count, uint8_t codec) {
+    if (codec == CODEC_NONE) {
+        return BuildMatrixReply(header, std::move(owner), values, count);
+    }
+    header.codec = codec;
+    auto encoded = std::make_shared<std::vector<uint8_t>>(EncodePayload(codec, reinterpret_cast<const uint8_t*>(values), count, header.cols));
+    return BuildEncodedReply(header, encoded, encoded->data(), encoded->size());
+}
+
+// Sends a matrix reply in the connection's reply codec. Large ones are encoded band by
+// band on the compute pool and sent when the last band is done; if the pool is full
+// they go out raw rather than wait.
+void SendMatrix(const std::shared_ptr<Connection>& connection, FrameHeader header, std::shared_ptr<const void> owner, const int32_t* values, size_t count) {
+    uint8_t codec = connection->ReplyCodec();
+    if (codec == CODEC_NONE || count <= INLINE_CODEC_ELEMENTS) {
+        connection->Send(EncodeMatrixReply(header, std::move(owner), values, count, codec));
+        return;
+    }
+
+    struct EncodeJob {
+        BandLayout layout;
+        std::vector<std::vector<uint8_t>> bands;
+    };
+    auto job = std::make_shared<EncodeJob>();
+    job->layout.bandElements = BandElements(header.cols);
+    job->layout.bandCount = (count + job->layout.bandElements - 1) / job->layout.bandElements;
+    job->bands.resize(job->layout.bandCount);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+    header.codec = codec;
+    bool queued = computePool->try_submit(connection->Id(), count,
+        [job, owner, bytes, count, codec](size_t begin, size_t end) {
+            size_t firstBand;
+            size_t lastBand;
+            BandsStartingIn(job->layout, begin, end, firstBand, lastBand);
+            for (size_t band = firstBand; band < lastBand; band++) {
+                size_t bandSize = job->layout.BandSize(band, count);
+                std::vector<uint8_t>& out = job->bands[band];
+                out.resize(MaxEncodedBandSize(codec, bandSize));
+                out.resize(EncodeBand(codec, bytes + job->layout.BandBegin(band) * sizeof(int32_t), bandSize, out.data()));
+            }
+        },
+        [job, connection, header]() {
+            auto encoded = std::make_shared<std::vector<uint8_t>>(AssembleBands(job->layout.bandElements, job->bands));
+            connection->Send(BuildEncodedReply(header, encoded, encoded->data(), encoded->size()));
+        });
+    if (!queued) {
+        header.codec = CODEC_NONE;
+        connection->Send(BuildMatrixReply(header, std::move(owner), values, count));
+    }
+}
+
+// One tile of a task: result = A - B over [begin, end), written over A.
+void SubtractTile(pooled_buffer& payload, size_t count, size_t begin, size_t end) {
+    int32_t* matrixA = payload.as<int32_t>();
+    int32_t* matrixB = matrixA + count;
+    SwapInt32LEInPlace(matrixA + begin, end - begin);
+    SwapInt32LEInPlace(matrixB + begin, end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        matrixA[i] = matrixA[i] - matrixB[i];
+    }
+    SwapInt32LEInPlace(matrixA + begin, end - begin);
+}
+
+// Pushes or stores a finished result. `owner` keeps `values` alive for the push;
+// `stored` is the compact copy, made only if something keeps the result.
+void DeliverResult(const TaskInfo& task, std::shared_ptr<const void> owner, const int32_t* values,
+    const std::function<std::shared_ptr<const StoredResult>()>& stored) {
+    uint64_t client = task.connection->Id();
+    TaskStore::FinishMode mode = taskStore->Finish(client, task.taskId);
+    Metrics().taskTime.record_since(task.received);
+    if (mode == TaskStore::FINISH_PUSH) {
+        FrameHeader header;
+        header.opcode = OP_RESULT_REPLY;
+        header.taskId = task.taskId;
+        header.status = STATUS_COMPLETED;
+        header.rows = task.rows;
+        header.cols = task.cols;
+        SendMatrix(task.connection, header, std::move(owner), values, task.Count());
+    }
+    else if (mode == TaskStore::FINISH_STORE) {
+        taskStore->Store(client, task.taskId, stored());
+        SendReply(*task.connection, OP_COMPLETED, task.taskId, STATUS_COMPLETED);
+    }
+}
+
+// Runs once all tiles of the task are done.
+void FinishTask(const TaskInfo& task, const std::shared_ptr<pooled_buffer>& payload, const ContentKey* key) {
+    size_t count = task.Count();
+    if (task.rows <= 5 && task.cols <= 5) {
+        std::vector<int> result(count);
+        ReadInt32LE(payload->data(), count, result.data());
+        PrintMatrix(result.data(), task.rows, task.cols, "Result Matrix");
+    }
+
+    // Stored results are copied out of the payload buffer (which also holds B and is
+    // rounded up to a power of two) into an exact-size one; the payload buffer goes
+    // back to the pool. Pushed results are sent straight from the payload.
+    std::shared_ptr<const StoredResult> compact;
+    auto makeCompact = [&]() {
+        if (!compact) {
+            auto result = std::make_shared<StoredResult>();
+            result->rows = task.rows;
+            result->cols = task.cols;
+            result->data.assign(payload->data(), payload->data() + count * sizeof(int32_t));
+            compact = std::move(result);
+        }
+        return compact;
+    };
+    if (key != nullptr) {
+        taskStore->Cache(*key, makeCompact());
+    }
+    DeliverResult(task, payload, payload->as<int32_t>(), makeCompact);
+}
+
+void StartCompute(const TaskInfo& task, const std::shared_ptr<pooled_buffer>& payload, std::shared_ptr<ContentKey> key) {
+    size_t count = task.Count();
+    Clock::time_point started = Clock::now();
+    bool queued = computePool->try_submit(task.connection->Id(), count,
+        [payload, count](size_t begin, size_t end) { SubtractTile(*payload, count, begin, end); },
+        [task, payload, key, started]() {
+            Metrics().computeTime.record_since(started);
+            FinishTask(task, payload, key.get());
+        });
+    if (!queued) {
+        RejectBusy(task);
+    }
+}
+
+void ComputeOrReuse(const TaskInfo& task, const std::shared_ptr<pooled_buffer>& payload, const ContentKey& key) {
+    std::shared_ptr<const StoredResult> cached = taskStore->FindCached(key);
+    if (cached) {
+        Metrics().cacheHits.add();
+        const int32_t* values = reinterpret_cast<const int32_t*>(cached->data.data());
+        DeliverResult(task, cached, values, [&cached]() { return cached; });
+        return;
+    }
+    StartCompute(task, payload, std::make_shared<ContentKey>(key));
+}
+
+// Fingerprints the input, then answers from the result cache or computes.
+void StartHash(const TaskInfo& task, const std::shared_ptr<pooled_buffer>& payload) {
+    size_t words = payload->size() / 8; // 2 * rows * cols int32s, always a whole number of words
+    ContentKey key;
+    key.rows = task.rows;
+    key.cols = task.cols;
+    if (words <= INLINE_HASH_WORDS) {
+        HashWords(payload->data(), 0, words, key.first, key.second);
+        ComputeOrReuse(task, payload, key);
+        return;
+    }
+
+    struct HashSums {
+        std::atomic<uint64_t> first{ 0 };
+        std::atomic<uint64_t> second{ 0 };
+    };
+    auto sums = std::make_shared<HashSums>();
+    bool queued = computePool->try_submit(task.connection->Id(), words,
+        [payload, sums](size_t begin, size_t end) {
+            uint64_t first = 0;
+            uint64_t second = 0;
+            HashWords(payload->data(), begin, end, first, second);
+            sums->first.fetch_add(first, std::memory_order_relaxed);
+            sums->second.fetch_add(second, std::memory_order_relaxed);
+        },
+        [task, payload, sums, key]() mutable {
+            key.first = sums->first.load(std::memory_order_relaxed);
+            key.second = sums->second.load(std::memory_order_relaxed);
+            ComputeOrReuse(task, payload, key);
+        });
+    if (!queued) {
+        RejectBusy(task);
+    }
+}
+
+// A matrix payload of `elements` int32s as the header describes it: raw and exactly
+// that long, or in a supported codec and no larger than the raw form may be.
+bool ValidMatrixPayload(const FrameHeader& header, uint64_t elements) {
+    if (header.dtype != DTYPE_INT32 || elements == 0 || elements * sizeof(int32_t) > MAX_PAYLOAD_SIZE) return false;
+    if (header.codec == CODEC_NONE) return header.payloadLength == elements * sizeof(int32_t);
+    return CodecSupported(header.codec);
+}
+
+// The input is in raw form from here on.
+void StartTask(const TaskInfo& task, const std::shared_ptr<pooled_buffer>& payload) {
+    size_t count = task.Count();
+    if (task.rows <= 5 && task.cols <= 5) {
+        std::vector<int> matrices(2 * count);
+        ReadInt32LE(payload->data(), 2 * count, matrices.data());
+        PrintMatrix(matrices.data(), task.rows, task.cols, "Matrix A");
+        PrintMatrix(matrices.data() + count, task.rows, task.cols, "Matrix B");
+    }
+
+    if (taskStore->CacheEnabled() && count * sizeof(int32_t) <= taskStore->CacheMaxEntry()) {
+        StartHash(task, payload);
+    }
+    else {
+        StartCompute(task, payload, nullptr);
+    }
+}
+
+void HandleProcess(const std::shared_ptr<Connection>& connection, Frame& frame) {
+    const FrameHeader& header = frame.header;
+    uint64_t count64 = static_cast<uint64_t>(header.rows) * header.cols;
+    if (!ValidMatrixPayload(header, 2 * count64)) {
+        Metrics().tasksRejected.add();
+        SendReply(*connection, OP_ERROR, header.taskId, STATUS_BAD_REQUEST);
+        return;
+    }
+
+    TaskInfo task{ connection, header.taskId, static_cast<int>(header.rows), static_cast<int>(header.cols), Clock::now() };
+    uint32_t admission = taskStore->Begin(connection->Id(), task.taskId, header.rows, header.cols, (header.flags & FLAG_PUSH_RESULT) != 0);
+    if (admission != STATUS_OK) {
+        Metrics().tasksRejected.add();
+        SendReply(*connection, OP_ERROR, task.taskId, admission);
+        return;
+    }
+    Metrics().tasksAccepted.add();
+
+    DecodeThen(connection->Id(), std::move(frame.payload), header.codec, 2 * task.Count(),
+        [task](const std::shared_ptr<pooled_buffer>& payload) { StartTask(task, payload); },
+        [task](uint32_t status) { RejectTask(task, status); });
+}
+
+void HandleStreamBegin(const std::shared_ptr<Connection>& connection, const FrameHeader& header) {
+    if (header.rows == 0 || header.cols == 0 || header.payloadLength != 0) {
+        Metrics().tasksRejected.add();
+        SendReply(*connection, OP_ERROR, header.taskId, STATUS_BAD_REQUEST);
+        return;
+    }
+    // The task store reserves the id and counts the stream against the in-flight limit;
+    // the result itself is never stored, it goes back band by band.
+    uint32_t admission = taskStore->Begin(connection->Id(), header.taskId, header.rows, header.cols, true);
+    if (admission != STATUS_OK) {
+        Metrics().tasksRejected.add();
+        SendReply(*connection, OP_ERROR, header.taskId, admission);
+        return;
+    }
+    Metrics().tasksAccepted.add();
+    std::unique_lock<std::mutex> lock(streamMutex);
+    streams[connection->Id()][header.taskId] = StreamState{ header.rows, header.cols };
+}
+
+void AbortStream(const std::shared_ptr<Connection>& connection, uint32_t taskId, uint32_t status) {
+    {
+        std::unique_lock<std::mutex> lock(streamMutex);
+        auto clientIt = streams.find(connection->Id());
+        if (clientIt != streams.end()) {
+            clientIt->second.erase(taskId);
+        }
+    }
+    Metrics().tasksRejected.add();
+    taskStore->Abort(connection->Id(), taskId);
+    SendReply(*connection, OP_ERROR, taskId, status);
+}
+
+StreamState* FindStream(uint64_t client, uint32_t taskId) {
+    auto clientIt = streams.find(client);
+    if (clientIt == streams.end()) return nullptr;
+    auto it = clientIt->second.find(taskId);
+    return it == clientIt->second.end() ? nullptr : &it->second;
+}
+
+void FinishBand(const std::shared_ptr<Connection>& connection, const FrameHeader& band, const std::shared_ptr<pooled_buffer>& payload) {
+    {
+        std::unique_lock<std::mutex> lock(streamMutex);
+        if (FindStream(connection->Id(), band.taskId) == nullptr) return; // aborted meanwhile
+    }
+
+    FrameHeader header;
+    header.opcode = OP_STREAM_RESULT;
+    header.taskId = band.taskId;
+    header.firstRow = band.firstRow;
+    header.rows = band.rows;
+    header.cols = band.cols;
+    size_t count = static_cast<size_t>(band.rows) * band.cols;
+    // Encoded right here, not on the pool: OP_COMPLETED must not overtake the band.
+    connection->Send(EncodeMatrixReply(header, payload, payload->as<int32_t>(), count, connection->ReplyCodec()));
+
+    // Counted only after the band is sent, so whoever counts the last one knows every
+    // result is out and OP_COMPLETED comes after them.
+    bool streamDone = false;
+    {
+        std::unique_lock<std::mutex> lock(streamMutex);
+        StreamState* stream = FindStream(connection->Id(), band.taskId);
+        if (stream == nullptr) return;
+        stream->bandsInFlight--;
+        stream->rowsDone += band.rows;
+        if (stream->rowsDone == stream->rows) {
+            streams[connection->Id()].erase(band.taskId);
+            streamDone = true;
+        }
+    }
+    if (streamDone && taskStore->Finish(connection->Id(), band.taskId) != TaskStore::FINISH_GONE) {
+        SendReply(*connection, OP_COMPLETED, band.taskId, STATUS_COMPLETED);
+    }
+}
+
+void HandleStreamChunk(const std::shared_ptr<Connection>& connection, Frame& frame) {
+    const FrameHeader& header = frame.header;
+    uint32_t rejection = STATUS_OK;
+    {
+        std::unique_lock<std::mutex> lock(streamMutex);
+        StreamState* stream = FindStream(connection->Id(), header.taskId);
+        uint64_t count = static_cast<uint64_t>(header.rows) * header.cols;
+        if (stream == nullptr) {
+            rejection = STATUS_UNKNOWN;
+        }
+        else if (!ValidMatrixPayload(header, 2 * count) || header.cols != stream->cols ||
+            header.firstRow != stream->nextRow || header.rows > stream->rows - stream->nextRow) {
+            rejection = STATUS_BAD_REQUEST;
+        }
+        else if (stream->bandsInFlight >= MAX_STREAM_WINDOW) {
+            rejection = STATUS_BUSY;
+        }
+        else {
+            stream->nextRow += header.rows;
+            stream->bandsInFlight++;
+        }
+    }
+    if (rejection == STATUS_UNKNOWN) {
+        SendReply(*connection, OP_ERROR, header.taskId, STATUS_UNKNOWN);
+        return;
+    }
+    if (rejection != STATUS_OK) {
+        AbortStream(connection, header.taskId, rejection);
+        return;
+    }
+
+    size_t count = static_cast<size_t>(header.rows) * header.cols;
+    FrameHeader band = header;
+    DecodeThen(connection->Id(), std::move(frame.payload), header.codec, 2 * count,
+        [connection, band, count](const std::shared_ptr<pooled_buffer>& payload) {
+            Clock::time_point started = Clock::now();
+            bool queued = computePool->try_submit(connection->Id(), count,
+                [payload, count](size_t begin, size_t end) { SubtractTile(*payload, count, begin, end); },
+                [connection, band, payload, started]() {
+                    Metrics().computeTime.record_since(started);
+                    FinishBand(connection, band, payload);
+                });
+            if (!queued) {
+                AbortStream(connection, band.taskId, STATUS_BUSY);
+            }
+        },
+        [connection, band](uint32_t status) { AbortStream(connection, band.taskId, status); });
+}
+
+void HandleStatus(Connection& connection, const FrameHeader& header) {
+    SendReply(connection, OP_STATUS_REPLY, header.taskId, taskStore->Status(connection.Id(), header.taskId));
+}
+
+void HandleResult(const std::shared_ptr<Connection>& connection, const FrameHeader& header) {
+    std::shared_ptr<const StoredResult> result;
+    FrameHeader replyHeader;
+    replyHeader.opcode = OP_RESULT_REPLY;
+    replyHeader.taskId = header.taskId;
+    replyHeader.status = taskStore->Fetch(connection->Id(), header.taskId, result);
+    if (replyHeader.status == STATUS_COMPLETED) {
+        replyHeader.rows = result->rows;
+        replyHeader.cols = result->cols;
+        const int32_t* values = reinterpret_cast<const int32_t*>(result->data.data());
+        size_t count = static_cast<size_t>(result->rows) * result->cols;
+        SendMatrix(connection, replyHeader, result, values, count);
+    }
+    else {
+        connection->Send(BuildFrame(replyHeader));
+    }
+}
+
+void HandleStats(Connection& connection, const FrameHeader& header) {
+    std::string text = metrics_text();
+    FrameHeader reply;
+    reply.opcode = OP_STATS_REPLY;
+    reply.taskId = header.taskId;
+    connection.Send(BuildFrame(reply, text.data(), text.size()));
+}
+
+void HandleHello(Connection& connection, const FrameHeader& header) {
+    uint8_t replyCodec = CODEC_NONE;
+    for (uint8_t codec : REPLY_CODEC_PREFERENCE) {
+        if ((header.status & CodecBit(codec)) != 0) {
+            replyCodec = codec;
+            break;
+        }
+    }
+    connection.SetReplyCodec(replyCodec);
+    FrameHeader reply;
+    reply.opcode = OP_HELLO_REPLY;
+    reply.taskId = header.taskId;
+    reply.status = SUPPORTED_CODECS;
+    reply.codec = replyCodec;
+    connection.Send(BuildFrame(reply));
+}
+
+}
+
+Connection::Connection() : m_id(nextConnectionId.fetch_add(1, std::memory_order_relaxed)) {
+    Metrics().connectionsAccepted.add();
+    Metrics().connectionsOpen.add();
+}
+
+void Connection::Send(std::vector<uint8_t> frame) {
+    OutgoingFrame outgoing;
+    outgoing.head = std::move(frame);
+    Send(std::move(outgoing));
+}
+
+void StartServerCore(size_t workersAmount, size_t queueCapacity, const TaskStore::Config& storeConfig) {
+    compute_scheduler::config config;
+    config.workers = workersAmount;
+    config.max_jobs = queueCapacity;
+    computePool = std::make_unique<compute_scheduler>(config);
+    taskStore = std::make_unique<TaskStore>(storeConfig);
+}
+
+void StopServerCore() {
+    if (computePool) {
+        computePool->shutdown();
+    }
+}
+
+bool HandleFrame(const std::shared_ptr<Connection>& connection, Frame& frame) {
+    const FrameHeader& header = frame.header;
+    const ServerMetrics& metrics = Metrics();
+    metric_timer timer(metrics.handleTime);
+    metrics.framesReceived.add();
+    metrics.bytesReceived.add(static_cast<int64_t>(FRAME_HEADER_SIZE + header.payloadLength));
+
+    if (header.opcode == OP_PROCESS) {
+        HandleProcess(connection, frame);
+    }
+    else if (header.opcode == OP_STATUS) {
+        HandleStatus(*connection, header);
+    }
+    else if (header.opcode == OP_RESULT) {
+        HandleResult(connection, header);
+    }
+    else if (header.opcode == OP_STREAM_BEGIN) {
+        HandleStreamBegin(connection, header);
+    }
+    else if (header.opcode == OP_STREAM_CHUNK) {
+        HandleStreamChunk(connection, frame);
+    }
+    else if (header.opcode == OP_HELLO) {
+        HandleHello(*connection, header);
+    }
+    else if (header.opcode == OP_STATS) {
+        HandleStats(*connection, header);
+    }
+    else if (header.opcode == OP_SHUTDOWN) {
+        serverRunning = false;
+        return false;
+    }
+    else {
+        SendReply(*connection, OP_ERROR, header.taskId, STATUS_BAD_REQUEST);
+    }
+    return true;
+}
+
+void ConnectionClosed(const Connection& connection) {
+    Metrics().connectionsOpen.sub();
+    {
+        std::unique_lock<std::mutex> lock(streamMutex);
+        streams.erase(connection.Id());
+    }
+    taskStore->RemoveClient(connection.Id());
+}
+
+bool ServerRunning() {
+    return serverRunning.load();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "protocol.h"
+#include "task_store.h"
+
+// Request handling shared by the socket backends. A backend owns the sockets and turns
+// bytes into frames; everything that happens to a frame afterwards (task bookkeeping,
+// compute, replies) lives here and only talks back through Connection::Send.
+
+// One client as seen by the request handler. Send may be called from any thread
+// (workers reply when a task finishes) and must put the frame on the wire whole, or
+// drop it silently once the connection is gone. A frame's body is sent from where it
+// lives (a task's result buffer); implementations gather head and body in one write.
+class Connection {
+public:
+    Connection();
+    virtual ~Connection() = default;
+
+    virtual void Send(OutgoingFrame frame) = 0;
+    void Send(std::vector<uint8_t> frame);
+    // Unique for the lifetime of the process, unlike the socket handle, which the OS
+    // reuses as soon as it is closed.
+    uint64_t Id() const { return m_id; }
+    // Codec of this connection's matrix replies, agreed on with OP_HELLO.
+    uint8_t ReplyCodec() const { return m_replyCodec.load(std::memory_order_relaxed); }
+    void SetReplyCodec(uint8_t codec) { m_replyCodec.store(codec, std::memory_order_relaxed); }
+
+private:
+    uint64_t m_id;
+    std::atomic<uint8_t> m_replyCodec{ 0 };
+};
+
+// Starts the compute pool: `workersAmount` threads (0 = hardware concurrency) shared by
+// all connections, and at most `queueCapacity` tasks accepted and unfinished. Requests
+// beyond that are answered STATUS_BUSY. Large tasks are split into tiles that run in
+// parallel; connections are served round-robin, tile by tile. `storeConfig` sets the
+// memory budgets, spilling and result cache of the task store.
+void StartServerCore(size_t workersAmount, size_t queueCapacity, const TaskStore::Config& storeConfig = TaskStore::Config());
+// Lets queued tasks finish and joins the workers.
+void StopServerCore();
+
+// Returns false when the client asked the server to shut down.
+bool HandleFrame(const std::shared_ptr<Connection>& connection, Frame& frame);
+// Forgets the client's tasks; results of tasks still running are dropped. Called once
+// per connection, when its socket is closed.
+void ConnectionClosed(const Connection& connection);
+
+bool ServerRunning();
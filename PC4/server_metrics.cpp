@@ -0,0 +1,6 @@
+#include "server_metrics.h"
+
+const ServerMetrics& Metrics() {
+    static const ServerMetrics metrics;
+    return metrics;
+}
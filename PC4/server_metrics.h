@@ -0,0 +1,41 @@
+#pragma once
+#include "../common/metrics.h"
+#include "protocol.h"
+
+// What the server measures, sent back to OP_STATS. The phases of a task are timed apart,
+// so a slow reply can be put down to the network, framing, the codecs or compute:
+//   parse    reassembling frames from what one read returned
+//   handle   dispatching a frame on the I/O thread: checks, admission, inline work
+//   decode   decompressing a request payload, on the pool when it is large
+//   compute  a task or stream band from being queued on the pool to its result
+//   send     a reply from being handed to the connection to its last byte written
+// and pc4_task_seconds spans a task from its request to its reply being queued.
+struct ServerMetrics {
+    metric_counter connectionsAccepted{ "pc4_connections_accepted_total", "Connections accepted." };
+    metric_gauge connectionsOpen{ "pc4_connections_open", "Connections open." };
+    metric_counter bytesReceived{ "pc4_received_bytes_total", "Bytes of the frames received." };
+    metric_counter bytesSent{ "pc4_sent_bytes_total", "Bytes written to clients." };
+    metric_counter framesReceived{ "pc4_frames_received_total", "Frames received." };
+    metric_counter tasksAccepted{ "pc4_tasks_accepted_total", "Tasks and streams admitted." };
+    metric_counter tasksRejected{ "pc4_tasks_rejected_total", "Tasks answered with an error instead of a result." };
+    metric_counter cacheHits{ "pc4_result_cache_hits_total", "Tasks answered from the result cache." };
+    metric_gauge sendQueueFrames{ "pc4_send_queue_frames", "Reply frames waiting for room in the socket buffer." };
+    metric_histogram parseTime{ "pc4_phase_seconds", "Time spent in each phase.", "phase=\"parse\"" };
+    metric_histogram handleTime{ "pc4_phase_seconds", "Time spent in each phase.", "phase=\"handle\"" };
+    metric_histogram decodeTime{ "pc4_phase_seconds", "Time spent in each phase.", "phase=\"decode\"" };
+    metric_histogram computeTime{ "pc4_phase_seconds", "Time spent in each phase.", "phase=\"compute\"" };
+    metric_histogram sendTime{ "pc4_phase_seconds", "Time spent in each phase.", "phase=\"send\"" };
+    metric_histogram taskTime{ "pc4_task_seconds", "From a task's request being received to its reply being queued." };
+};
+
+const ServerMetrics& Metrics();
+
+// Stamps a reply frame as handed to the connection, for the send timing.
+inline void FrameQueued(OutgoingFrame& frame) {
+    frame.queued = std::chrono::steady_clock::now();
+}
+
+// The last byte of a reply frame has been written.
+inline void FrameSent(const OutgoingFrame& frame) {
+    Metrics().sendTime.record_since(frame.queued);
+}
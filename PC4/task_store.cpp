@@ -0,0 +1,386 @@
+#include "task_store.h"
+#include <filesystem>
+#include <fstream>
+#include "protocol.h"
+
+namespace {
+
+const size_t SHARDS_AMOUNT = 16;
+// Tombstones of evicted results kept per client, so OP_RESULT can say "evicted" rather
+// than "unknown" for a while. Past this the oldest are forgotten.
+const size_t MAX_PARKED_PER_CLIENT = 4096;
+
+}
+
+TaskStore::TaskStore(const Config& config) : m_config(config), m_shards(SHARDS_AMOUNT) {
+    if (!m_config.spillDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(m_config.spillDirectory, error);
+    }
+    m_sweeper = std::thread([this]() { SweepLoop(); });
+}
+
+TaskStore::~TaskStore() {
+    {
+        std::unique_lock<std::mutex> lock(m_sweepLock);
+        m_stopping = true;
+    }
+    m_sweepWake.notify_one();
+    m_sweeper.join();
+
+    for (auto& shard : m_shards) {
+        for (auto& client : shard.clients) {
+            for (auto& task : client.second.tasks) {
+                if (task.second.state == ENTRY_SPILLED) {
+                    std::error_code error;
+                    std::filesystem::remove(task.second.spillPath, error);
+                }
+            }
+        }
+    }
+}
+
+uint32_t TaskStore::Begin(uint64_t client, uint32_t taskId, uint32_t rows, uint32_t cols, bool pushResult) {
+    Shard& shard = ShardOf(client);
+    std::unique_lock<std::mutex> lock(shard.lock);
+    ClientState& state = shard.clients[client];
+    ExpireOld(state);
+
+    auto it = state.tasks.find(taskId);
+    if (it != state.tasks.end() && it->second.state == ENTRY_PENDING) {
+        return STATUS_DUPLICATE;
+    }
+    if (state.inFlight >= m_config.maxInFlightPerClient) {
+        return STATUS_BUSY;
+    }
+    if (it != state.tasks.end()) {
+        // Resubmitting the id of a finished task replaces its result.
+        Erase(state, taskId);
+    }
+
+    Entry& entry = state.tasks[taskId];
+    entry.pushResult = pushResult;
+    entry.rows = rows;
+    entry.cols = cols;
+    state.inFlight++;
+    return STATUS_OK;
+}
+
+void TaskStore::Abort(uint64_t client, uint32_t taskId) {
+    Shard& shard = ShardOf(client);
+    std::unique_lock<std::mutex> lock(shard.lock);
+    auto clientIt = shard.clients.find(client);
+    if (clientIt == shard.clients.end()) return;
+    auto it = clientIt->second.tasks.find(taskId);
+    if (it == clientIt->second.tasks.end() || it->second.state != ENTRY_PENDING) return;
+    clientIt->second.tasks.erase(it);
+    clientIt->second.inFlight--;
+}
+
+TaskStore::FinishMode TaskStore::Finish(uint64_t client, uint32_t taskId) {
+    Shard& shard = ShardOf(client);
+    std::unique_lock<std::mutex> lock(shard.lock);
+    auto clientIt = shard.clients.find(client);
+    if (clientIt == shard.clients.end()) return FINISH_GONE; // client disconnected while the task was running
+    ClientState& state = clientIt->second;
+    auto it = state.tasks.find(taskId);
+    if (it == state.tasks.end() || it->second.state != ENTRY_PENDING) return FINISH_GONE;
+
+    state.inFlight--;
+    if (it->second.pushResult) {
+        state.tasks.erase(it);
+        return FINISH_PUSH;
+    }
+    return FINISH_STORE;
+}
+
+void TaskStore::Store(uint64_t client, uint32_t taskId, std::shared_ptr<const StoredResult> result) {
+    std::vector<SpillJob> spills;
+    {
+        Shard& shard = ShardOf(client);
+        std::unique_lock<std::mutex> lock(shard.lock);
+        auto clientIt = shard.clients.find(client);
+        if (clientIt == shard.clients.end()) return;
+        ClientState& state = clientIt->second;
+        auto it = state.tasks.find(taskId);
+        if (it == state.tasks.end() || it->second.state != ENTRY_PENDING) return;
+
+        Entry& entry = it->second;
+        entry.state = ENTRY_IN_MEMORY;
+        entry.bytes = result->data.size();
+        entry.result = std::move(result);
+        entry.lastAccess = Clock::now();
+        entry.position = state.inMemory.insert(state.inMemory.end(), taskId);
+        state.bytes += entry.bytes;
+        m_memoryUsed.fetch_add(entry.bytes, std::memory_order_relaxed);
+
+        // The new result is the most recent, so it goes last, and only if it alone is
+        // over the client's budget.
+        while (state.bytes > m_config.clientBudget && !state.inMemory.empty()) {
+            EvictOldest(client, state, spills);
+        }
+    }
+    RunSpills(spills);
+    EnforceGlobalBudget();
+}
+
+uint32_t TaskStore::Status(uint64_t client, uint32_t taskId) {
+    Shard& shard = ShardOf(client);
+    std::unique_lock<std::mutex> lock(shard.lock);
+    auto clientIt = shard.clients.find(client);
+    if (clientIt == shard.clients.end()) return STATUS_UNKNOWN;
+    ExpireOld(clientIt->second);
+    auto it = clientIt->second.tasks.find(taskId);
+    if (it == clientIt->second.tasks.end()) return STATUS_UNKNOWN;
+    switch (it->second.state) {
+    case ENTRY_PENDING: return STATUS_PENDING;
+    case ENTRY_EVICTED: return STATUS_EVICTED;
+    default: return STATUS_COMPLETED;
+    }
+}
+
+uint32_t TaskStore::Fetch(uint64_t client, uint32_t taskId, std::shared_ptr<const StoredResult>& result) {
+    std::string spillPath;
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    {
+        Shard& shard = ShardOf(client);
+        std::unique_lock<std::mutex> lock(shard.lock);
+        auto clientIt = shard.clients.find(client);
+        if (clientIt == shard.clients.end()) return STATUS_UNKNOWN;
+        ClientState& state = clientIt->second;
+        ExpireOld(state);
+        auto it = state.tasks.find(taskId);
+        if (it == state.tasks.end()) return STATUS_UNKNOWN;
+
+        Entry& entry = it->second;
+        if (entry.state == ENTRY_PENDING) return STATUS_PENDING;
+        if (entry.state == ENTRY_EVICTED) return STATUS_EVICTED;
+        Touch(state, entry);
+        if (entry.result) {
+            result = entry.result;
+            return STATUS_COMPLETED;
+        }
+        spillPath = entry.spillPath;
+        rows = entry.rows;
+        cols = entry.cols;
+    }
+
+    result = ReadSpillFile(spillPath, rows, cols);
+    return result ? STATUS_COMPLETED : STATUS_EVICTED;
+}
+
+void TaskStore::RemoveClient(uint64_t client) {
+    Shard& shard = ShardOf(client);
+    std::unique_lock<std::mutex> lock(shard.lock);
+    auto clientIt = shard.clients.find(client);
+    if (clientIt == shard.clients.end()) return;
+    ClientState& state = clientIt->second;
+    while (!state.tasks.empty()) {
+        Erase(state, state.tasks.begin()->first);
+    }
+    shard.clients.erase(clientIt);
+}
+
+std::shared_ptr<const StoredResult> TaskStore::FindCached(const ContentKey& key) {
+    if (!CacheEnabled()) return nullptr;
+    std::unique_lock<std::mutex> lock(m_cacheLock);
+    auto it = m_cache.find(key);
+    if (it == m_cache.end()) return nullptr;
+    m_cacheOrder.splice(m_cacheOrder.end(), m_cacheOrder, it->second.position);
+    return it->second.result;
+}
+
+void TaskStore::Cache(const ContentKey& key, std::shared_ptr<const StoredResult> result) {
+    size_t bytes = result->data.size();
+    if (!CacheEnabled() || bytes > m_config.cacheMaxEntry || bytes > m_config.cacheBudget) return;
+    std::unique_lock<std::mutex> lock(m_cacheLock);
+    if (m_cache.count(key) != 0) return;
+    auto position = m_cacheOrder.insert(m_cacheOrder.end(), key);
+    m_cache.emplace(key, CacheEntry{ std::move(result), position });
+    m_cacheUsed += bytes;
+    while (m_cacheUsed > m_config.cacheBudget) {
+        auto oldest = m_cache.find(m_cacheOrder.front());
+        m_cacheUsed -= oldest->second.result->data.size();
+        m_cache.erase(oldest);
+        m_cacheOrder.pop_front();
+    }
+}
+
+void TaskStore::Touch(ClientState& state, Entry& entry) {
+    entry.lastAccess = Clock::now();
+    std::list<uint32_t>& list = entry.state == ENTRY_IN_MEMORY ? state.inMemory : state.parked;
+    list.splice(list.end(), list, entry.position);
+}
+
+void TaskStore::Unlink(ClientState& state, Entry& entry) {
+    if (entry.state == ENTRY_IN_MEMORY) {
+        state.inMemory.erase(entry.position);
+    }
+    else if (entry.state != ENTRY_PENDING) {
+        state.parked.erase(entry.position);
+    }
+}
+
+void TaskStore::Erase(ClientState& state, uint32_t taskId) {
+    auto it = state.tasks.find(taskId);
+    if (it == state.tasks.end()) return;
+    Entry& entry = it->second;
+    Unlink(state, entry);
+    if (entry.state == ENTRY_PENDING) {
+        state.inFlight--;
+    }
+    else if (entry.state == ENTRY_IN_MEMORY) {
+        state.bytes -= entry.bytes;
+        m_memoryUsed.fetch_sub(entry.bytes, std::memory_order_relaxed);
+    }
+    else if (entry.state == ENTRY_SPILLED && !entry.result) {
+        // While the write is still running RunSpills cleans up after it instead.
+        RemoveSpillFile(entry.spillPath, entry.bytes);
+    }
+    state.tasks.erase(it);
+}
+
+void TaskStore::EvictOldest(uint64_t client, ClientState& state, std::vector<SpillJob>& spills) {
+    uint32_t taskId = state.inMemory.front();
+    Entry& entry = state.tasks[taskId];
+    state.inMemory.pop_front();
+    state.bytes -= entry.bytes;
+    m_memoryUsed.fetch_sub(entry.bytes, std::memory_order_relaxed);
+
+    bool spill = !m_config.spillDirectory.empty() &&
+        m_spillUsed.fetch_add(entry.bytes, std::memory_order_relaxed) + entry.bytes <= m_config.spillBudget;
+    if (spill) {
+        std::string name = "pc4_" + std::to_string(client) + "_" + std::to_string(taskId) + "_" +
+            std::to_string(m_spillSequence.fetch_add(1, std::memory_order_relaxed)) + ".bin";
+        entry.state = ENTRY_SPILLED;
+        entry.spillPath = (std::filesystem::path(m_config.spillDirectory) / name).string();
+        // entry.result stays set until the file is written, so reads in between still work
+        spills.push_back(SpillJob{ client, taskId, entry.spillPath, entry.result });
+    }
+    else {
+        if (!m_config.spillDirectory.empty()) {
+            m_spillUsed.fetch_sub(entry.bytes, std::memory_order_relaxed);
+        }
+        entry.state = ENTRY_EVICTED;
+        entry.result.reset();
+    }
+    entry.position = state.parked.insert(state.parked.end(), taskId);
+
+    if (state.parked.size() > MAX_PARKED_PER_CLIENT) {
+        Erase(state, state.parked.front());
+    }
+}
+
+void TaskStore::ExpireOld(ClientState& state) {
+    Clock::time_point deadline = Clock::now() - m_config.resultTtl;
+    while (!state.inMemory.empty() && state.tasks[state.inMemory.front()].lastAccess < deadline) {
+        Erase(state, state.inMemory.front());
+    }
+    while (!state.parked.empty() && state.tasks[state.parked.front()].lastAccess < deadline) {
+        Erase(state, state.parked.front());
+    }
+}
+
+void TaskStore::SweepLoop() {
+    std::unique_lock<std::mutex> lock(m_sweepLock);
+    while (!m_sweepWake.wait_for(lock, m_config.sweepInterval, [this]() { return m_stopping; })) {
+        lock.unlock();
+        ExpireAll();
+        lock.lock();
+    }
+}
+
+// One shard at a time, so clients of the other shards are not held up.
+void TaskStore::ExpireAll() {
+    for (Shard& shard : m_shards) {
+        std::unique_lock<std::mutex> lock(shard.lock);
+        for (auto& client : shard.clients) {
+            ExpireOld(client.second);
+        }
+    }
+}
+
+void TaskStore::EnforceGlobalBudget() {
+    size_t idlePasses = 0;
+    while (MemoryUsed() > m_config.globalBudget && idlePasses < m_shards.size()) {
+        Shard& shard = m_shards[m_evictionCursor.fetch_add(1, std::memory_order_relaxed) % m_shards.size()];
+        std::vector<SpillJob> spills;
+        {
+            std::unique_lock<std::mutex> lock(shard.lock);
+            // The least recently used result of this shard, whichever client holds it.
+            uint64_t victim = 0;
+            ClientState* victimState = nullptr;
+            Clock::time_point oldest = Clock::time_point::max();
+            for (auto& client : shard.clients) {
+                ClientState& state = client.second;
+                if (state.inMemory.empty()) continue;
+                Clock::time_point lastAccess = state.tasks[state.inMemory.front()].lastAccess;
+                if (lastAccess < oldest) {
+                    oldest = lastAccess;
+                    victim = client.first;
+                    victimState = &state;
+                }
+            }
+            if (victimState == nullptr) {
+                idlePasses++;
+                continue;
+            }
+            idlePasses = 0;
+            EvictOldest(victim, *victimState, spills);
+        }
+        RunSpills(spills);
+    }
+}
+
+void TaskStore::RunSpills(std::vector<SpillJob>& spills) {
+    for (SpillJob& job : spills) {
+        bool written = WriteSpillFile(job.path, *job.result);
+        size_t bytes = job.result->data.size();
+        job.result.reset();
+
+        Shard& shard = ShardOf(job.client);
+        std::unique_lock<std::mutex> lock(shard.lock);
+        Entry* entry = nullptr;
+        auto clientIt = shard.clients.find(job.client);
+        if (clientIt != shard.clients.end()) {
+            auto it = clientIt->second.tasks.find(job.taskId);
+            if (it != clientIt->second.tasks.end() && it->second.state == ENTRY_SPILLED && it->second.spillPath == job.path) {
+                entry = &it->second;
+            }
+        }
+        if (entry != nullptr && written) {
+            entry->result.reset();
+            continue;
+        }
+        RemoveSpillFile(job.path, bytes);
+        if (entry != nullptr) {
+            entry->state = ENTRY_EVICTED;
+            entry->result.reset();
+            entry->spillPath.clear();
+        }
+    }
+}
+
+bool TaskStore::WriteSpillFile(const std::string& path, const StoredResult& result) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(result.data.data()), static_cast<std::streamsize>(result.data.size()));
+    return static_cast<bool>(file);
+}
+
+std::shared_ptr<const StoredResult> TaskStore::ReadSpillFile(const std::string& path, uint32_t rows, uint32_t cols) {
+    auto result = std::make_shared<StoredResult>();
+    result->rows = rows;
+    result->cols = cols;
+    result->data.resize(static_cast<size_t>(rows) * cols * sizeof(int32_t));
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char*>(result->data.data()), static_cast<std::streamsize>(result->data.size()));
+    if (!file || file.gcount() != static_cast<std::streamsize>(result->data.size())) return nullptr;
+    return result;
+}
+
+void TaskStore::RemoveSpillFile(const std::string& path, size_t bytes) {
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    m_spillUsed.fetch_sub(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "content_hash.h"
+
+// A finished result kept for OP_RESULT: just the rows x cols int32 matrix in wire
+// order, sized exactly, so it can be sent as-is and costs 4 bytes per element.
+struct StoredResult {
+    uint32_t rows;
+    uint32_t cols;
+    std::vector<uint8_t> data;
+};
+
+// Per-connection task table behind a fixed number of independently locked shards.
+//
+// Results are charged against a per-client and a global memory budget. When a budget is
+// exceeded the least recently used results are evicted: written to the spill directory
+// if one is configured (and its own budget allows), dropped otherwise. A dropped result
+// answers OP_RESULT with STATUS_EVICTED. Results not read for `resultTtl` expire: a
+// client's own calls drop its stale results, and a background thread sweeps every shard
+// each `sweepInterval`, so the results of clients that went quiet go too.
+//
+// It also holds the cross-client result cache keyed by ContentKey, with its own budget,
+// so a request whose input was seen before is answered without computing it again.
+class TaskStore {
+public:
+    struct Config {
+        size_t clientBudget = size_t(256) << 20;
+        size_t globalBudget = size_t(1) << 30;
+        std::chrono::seconds resultTtl{ 600 };
+        std::chrono::milliseconds sweepInterval{ 1000 };
+        std::string spillDirectory; // empty: no spilling
+        size_t spillBudget = size_t(4) << 30;
+        size_t cacheBudget = size_t(256) << 20; // 0 turns the result cache off
+        size_t cacheMaxEntry = size_t(8) << 20; // a full-size entry is 1/32 of the default budget
+        size_t maxInFlightPerClient = 256;
+    };
+
+    // What Finish found.
+    enum FinishMode { FINISH_GONE, FINISH_PUSH, FINISH_STORE };
+
+    explicit TaskStore(const Config& config);
+    ~TaskStore();
+    TaskStore(const TaskStore&) = delete;
+    TaskStore& operator=(const TaskStore&) = delete;
+
+    // Registers a submitted task: STATUS_OK, STATUS_DUPLICATE or STATUS_BUSY.
+    uint32_t Begin(uint64_t client, uint32_t taskId, uint32_t rows, uint32_t cols, bool pushResult);
+    // The submit was rejected after Begin.
+    void Abort(uint64_t client, uint32_t taskId);
+    // The task's compute is done. Push tasks are forgotten here; for FINISH_STORE the
+    // caller follows up with Store.
+    FinishMode Finish(uint64_t client, uint32_t taskId);
+    void Store(uint64_t client, uint32_t taskId, std::shared_ptr<const StoredResult> result);
+
+    // STATUS_PENDING, STATUS_COMPLETED, STATUS_EVICTED or STATUS_UNKNOWN.
+    uint32_t Status(uint64_t client, uint32_t taskId);
+    // Like Status; on STATUS_COMPLETED `result` is set, read back from disk if spilled.
+    uint32_t Fetch(uint64_t client, uint32_t taskId, std::shared_ptr<const StoredResult>& result);
+    void RemoveClient(uint64_t client);
+
+    bool CacheEnabled() const { return m_config.cacheBudget != 0; }
+    size_t CacheMaxEntry() const { return m_config.cacheMaxEntry; }
+    std::shared_ptr<const StoredResult> FindCached(const ContentKey& key);
+    void Cache(const ContentKey& key, std::shared_ptr<const StoredResult> result);
+
+    size_t MemoryUsed() const { return m_memoryUsed.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    enum EntryState { ENTRY_PENDING, ENTRY_IN_MEMORY, ENTRY_SPILLED, ENTRY_EVICTED };
+
+    struct Entry {
+        EntryState state = ENTRY_PENDING;
+        bool pushResult = false;
+        uint32_t rows = 0;
+        uint32_t cols = 0;
+        // In memory, or still being written out while spilling.
+        std::shared_ptr<const StoredResult> result;
+        std::string spillPath;
+        size_t bytes = 0;
+        Clock::time_point lastAccess;
+        // Position in the client's memory list (ENTRY_IN_MEMORY) or parked list
+        // (spilled and evicted), both oldest first.
+        std::list<uint32_t>::iterator position;
+    };
+
+    struct ClientState {
+        std::unordered_map<uint32_t, Entry> tasks;
+        std::list<uint32_t> inMemory;
+        std::list<uint32_t> parked;
+        size_t inFlight = 0;
+        size_t bytes = 0;
+    };
+
+    struct SpillJob {
+        uint64_t client;
+        uint32_t taskId;
+        std::string path;
+        std::shared_ptr<const StoredResult> result;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<uint64_t, ClientState> clients;
+    };
+
+    struct CacheEntry {
+        std::shared_ptr<const StoredResult> result;
+        std::list<ContentKey>::iterator position;
+    };
+
+    Shard& ShardOf(uint64_t client) { return m_shards[client % m_shards.size()]; }
+
+    // All below expect the shard lock to be held.
+    void Touch(ClientState& state, Entry& entry);
+    void Unlink(ClientState& state, Entry& entry);
+    void Erase(ClientState& state, uint32_t taskId);
+    void EvictOldest(uint64_t client, ClientState& state, std::vector<SpillJob>& spills);
+    void ExpireOld(ClientState& state);
+
+    // Runs on m_sweeper until the destructor stops it.
+    void SweepLoop();
+    void ExpireAll();
+
+    // Without any lock held.
+    void EnforceGlobalBudget();
+    void RunSpills(std::vector<SpillJob>& spills);
+    static bool WriteSpillFile(const std::string& path, const StoredResult& result);
+    static std::shared_ptr<const StoredResult> ReadSpillFile(const std::string& path, uint32_t rows, uint32_t cols);
+    void RemoveSpillFile(const std::string& path, size_t bytes);
+
+    Config m_config;
+    std::vector<Shard> m_shards;
+    std::atomic<size_t> m_memoryUsed{ 0 };
+    std::atomic<size_t> m_spillUsed{ 0 };
+    std::atomic<uint64_t> m_spillSequence{ 0 };
+    std::atomic<size_t> m_evictionCursor{ 0 };
+
+    std::mutex m_cacheLock;
+    std::unordered_map<ContentKey, CacheEntry, ContentKeyHash> m_cache;
+    std::list<ContentKey> m_cacheOrder; // least recently used first
+    size_t m_cacheUsed = 0;
+
+    std::mutex m_sweepLock;
+    std::condition_variable m_sweepWake;
+    bool m_stopping = false;
+    std::thread m_sweeper; // last, so it starts after everything it touches
+};
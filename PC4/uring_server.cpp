@@ -0,0 +1,489 @@
+#include "uring_server.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "../common/io_ring.h"
+#include "epoll_server.h"
+#include "server_core.h"
+#include "server_metrics.h"
+
+namespace {
+
+const unsigned RING_ENTRIES = 1024;
+const unsigned RECEIVE_BUFFERS = 128;
+const size_t RECEIVE_BUFFER_SIZE = 32768;
+const int MAX_IOVECS = 64;
+// Smaller bodies are cheaper to copy than to pin and wait for a notification.
+const size_t ZEROCOPY_MIN_BYTES = 256 * 1024;
+// Longest wait for completions, bounds how long an idle I/O thread takes to notice shutdown.
+const int POLL_TIMEOUT_MS = 200;
+// Before a failed multishot accept is armed again.
+const auto ACCEPT_RETRY_DELAY = std::chrono::milliseconds(100);
+
+// user_data of an SQE: what it was for, and the socket it was for.
+enum Operation : uint64_t {
+    OP_IGNORE, // cancels, nothing waits for them
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,
+    OP_WAKE,
+};
+
+uint64_t UserData(Operation operation, int fd) {
+    return (static_cast<uint64_t>(operation) << 32) | static_cast<uint32_t>(fd);
+}
+
+class UringConnection;
+
+// Connections whose backlog the I/O thread should send. Workers add to it and wake the
+// thread through an eventfd that the ring always has a read pending on.
+class FlushQueue {
+public:
+    FlushQueue() : m_eventFd(eventfd(0, EFD_CLOEXEC)) {}
+    ~FlushQueue() { close(m_eventFd); }
+
+    void Push(std::weak_ptr<UringConnection> connection) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connections.push_back(std::move(connection));
+        }
+        uint64_t one = 1;
+        while (write(m_eventFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+
+    std::vector<std::weak_ptr<UringConnection>> Take() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::weak_ptr<UringConnection>> taken;
+        taken.swap(m_connections);
+        return taken;
+    }
+
+    int Fd() const { return m_eventFd; }
+
+private:
+    int m_eventFd;
+    std::mutex m_mutex;
+    std::vector<std::weak_ptr<UringConnection>> m_connections;
+};
+
+// Like EpollConnection, workers write a reply straight to the socket when nothing is
+// queued or in flight ahead of it. Whatever does not fit waits in `pending` for the I/O
+// thread, which sends it through the ring, one sendmsg at a time and as much of the
+// backlog as fits in MAX_IOVECS per sendmsg. Frames sent zero-copy are kept alive until
+// the kernel's notification that it is done with their pages.
+class UringConnection : public Connection, public std::enable_shared_from_this<UringConnection> {
+public:
+    UringConnection(int fd, FlushQueue& flushQueue, bool zeroCopy) : m_fd(fd), m_flushQueue(flushQueue), m_zeroCopy(zeroCopy) {}
+
+    void Send(OutgoingFrame frame) override {
+        FrameQueued(frame);
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (m_closed || m_broken) return;
+        if (m_pending.empty() && !m_sending) {
+            size_t sent = WriteNow(frame);
+            if (m_broken) return;
+            if (sent == frame.Size()) {
+                FrameSent(frame);
+                return;
+            }
+            m_pendingOffset = sent;
+        }
+        m_pending.push_back(std::move(frame));
+        Metrics().sendQueueFrames.add();
+        if (!m_sending && !m_flushRequested) {
+            m_flushRequested = true;
+            m_flushQueue.Push(weak_from_this());
+        }
+    }
+
+    // I/O thread: describes the next sendmsg of the backlog in `message`. False if there
+    // is nothing to send or a send is already in flight.
+    bool PrepareSend(const msghdr*& message, bool& zeroCopy) {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_flushRequested = false;
+        if (m_closed || m_broken || m_sending || m_pending.empty()) return false;
+        int partsAmount = 0;
+        size_t offset = m_pendingOffset;
+        zeroCopy = false;
+        for (const OutgoingFrame& frame : m_pending) {
+            if (partsAmount + 2 > MAX_IOVECS) break;
+            if (offset < frame.head.size()) {
+                m_parts[partsAmount++] = { const_cast<uint8_t*>(frame.head.data()) + offset, frame.head.size() - offset };
+            }
+            size_t bodyOffset = offset > frame.head.size() ? offset - frame.head.size() : 0;
+            if (bodyOffset < frame.bodyLength) {
+                m_parts[partsAmount++] = { const_cast<uint8_t*>(frame.body) + bodyOffset, frame.bodyLength - bodyOffset };
+                zeroCopy = zeroCopy || (m_zeroCopy && frame.bodyLength - bodyOffset >= ZEROCOPY_MIN_BYTES);
+            }
+            offset = 0;
+        }
+        m_message = msghdr{};
+        m_message.msg_iov = m_parts;
+        m_message.msg_iovlen = partsAmount;
+        message = &m_message;
+        m_sending = true;
+        return true;
+    }
+
+    // I/O thread: the sendmsg finished with `result`. With zero-copy the frames it
+    // completed stay alive until ZeroCopyDone. False if the connection broke.
+    bool SendCompleted(int result, bool zeroCopy) {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_sending = false;
+        if (zeroCopy) m_zeroCopyHeld.emplace_back();
+        size_t left = result > 0 ? static_cast<size_t>(result) : 0;
+        Metrics().bytesSent.add(static_cast<int64_t>(left));
+        while (left > 0 && !m_pending.empty()) {
+            OutgoingFrame& front = m_pending.front();
+            size_t remaining = front.Size() - m_pendingOffset;
+            if (left < remaining) {
+                m_pendingOffset += left;
+                break;
+            }
+            left -= remaining;
+            FrameSent(front);
+            if (zeroCopy) m_zeroCopyHeld.back().push_back(std::move(front));
+            m_pending.pop_front();
+            Metrics().sendQueueFrames.sub();
+            m_pendingOffset = 0;
+        }
+        if (result < 0) {
+            m_broken = true;
+            ReleasePending(zeroCopy);
+        }
+        else if (m_closed) {
+            ReleasePending(zeroCopy);
+        }
+        return !m_broken;
+    }
+
+    // I/O thread: the kernel is done with the pages of the oldest zero-copy send.
+    void ZeroCopyDone() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (!m_zeroCopyHeld.empty()) m_zeroCopyHeld.pop_front();
+    }
+
+    // I/O thread: stops all sending. The socket stays open until Busy() is false.
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_closed = true;
+        if (!m_sending) {
+            Metrics().sendQueueFrames.sub(static_cast<int64_t>(m_pending.size()));
+            m_pending.clear();
+        }
+    }
+
+    // I/O thread: a send in flight, or frames the kernel may still read zero-copy.
+    bool Busy() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        return m_sending || !m_zeroCopyHeld.empty();
+    }
+
+    int Fd() const { return m_fd; }
+    FrameReader& Reader() { return m_reader; }
+
+    // I/O thread only.
+    bool recvArmed = false;
+    bool dropped = false;
+
+private:
+    // Non-blocking writes of `frame` until done or EAGAIN; the number of bytes written.
+    size_t WriteNow(const OutgoingFrame& frame) {
+        size_t offset = 0;
+        while (offset < frame.Size()) {
+            iovec parts[2];
+            int partsAmount = 0;
+            if (offset < frame.head.size()) {
+                parts[partsAmount++] = { const_cast<uint8_t*>(frame.head.data()) + offset, frame.head.size() - offset };
+            }
+            size_t bodyOffset = offset > frame.head.size() ? offset - frame.head.size() : 0;
+            if (bodyOffset < frame.bodyLength) {
+                parts[partsAmount++] = { const_cast<uint8_t*>(frame.body) + bodyOffset, frame.bodyLength - bodyOffset };
+            }
+            msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = partsAmount;
+            ssize_t result = sendmsg(m_fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (result > 0) {
+                offset += static_cast<size_t>(result);
+                Metrics().bytesSent.add(result);
+            }
+            else if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            else {
+                m_broken = true; // the recv sees the hang-up and the I/O thread drops us
+                break;
+            }
+        }
+        return offset;
+    }
+
+    void ReleasePending(bool zeroCopy) {
+        if (zeroCopy) {
+            for (OutgoingFrame& frame : m_pending) m_zeroCopyHeld.back().push_back(std::move(frame));
+        }
+        Metrics().sendQueueFrames.sub(static_cast<int64_t>(m_pending.size()));
+        m_pending.clear();
+        m_pendingOffset = 0;
+    }
+
+    int m_fd;
+    FlushQueue& m_flushQueue;
+    bool m_zeroCopy;
+    FrameReader m_reader; // touched by the owning I/O thread only
+    std::mutex m_sendMutex;
+    std::deque<OutgoingFrame> m_pending;
+    size_t m_pendingOffset = 0;
+    bool m_sending = false;
+    bool m_flushRequested = false;
+    bool m_closed = false;
+    bool m_broken = false;
+    iovec m_parts[MAX_IOVECS];
+    msghdr m_message{};
+    std::deque<std::vector<OutgoingFrame>> m_zeroCopyHeld;
+};
+
+class UringIoThread {
+public:
+    explicit UringIoThread(int listenFd) : m_listenFd(listenFd) {}
+
+    ~UringIoThread() {
+        for (auto& entry : m_connections) {
+            if (!entry.second->dropped) ConnectionClosed(*entry.second);
+            entry.second->Close();
+        }
+        // Closing the ring ends the operations still in flight before the sockets go.
+        m_ring.reset();
+        for (auto& entry : m_connections) {
+            close(entry.first);
+        }
+        close(m_listenFd);
+    }
+
+    // Runs on the I/O thread itself, which the ring is created on and tied to.
+    void Run() {
+        io_ring::config settings;
+        settings.entries = RING_ENTRIES;
+        settings.recv_buffers = RECEIVE_BUFFERS;
+        settings.recv_buffer_size = RECEIVE_BUFFER_SIZE;
+        m_ring = io_ring::create(settings);
+        if (m_ring == nullptr) {
+            std::cerr << "io_uring setup failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        m_zeroCopy = m_ring->supports(IORING_OP_SENDMSG_ZC);
+        ArmAccept();
+        ArmWake();
+
+        while (ServerRunning()) {
+            if (!m_ring->submit_and_wait(POLL_TIMEOUT_MS)) {
+                std::cerr << "io_uring_enter failed: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            m_ring->reap([this](const io_uring_cqe& cqe) { Complete(cqe); });
+            if (!m_acceptArmed && std::chrono::steady_clock::now() >= m_acceptRetry) ArmAccept();
+        }
+    }
+
+private:
+    void Complete(const io_uring_cqe& cqe) {
+        int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+        switch (static_cast<Operation>(cqe.user_data >> 32)) {
+        case OP_ACCEPT:
+            Accepted(cqe);
+            break;
+        case OP_RECV:
+            Received(fd, cqe);
+            break;
+        case OP_SEND:
+            Sent(fd, cqe);
+            break;
+        case OP_WAKE:
+            for (const std::weak_ptr<UringConnection>& weak : m_flushQueue.Take()) {
+                std::shared_ptr<UringConnection> connection = weak.lock();
+                if (connection != nullptr && !connection->dropped) SubmitSend(*connection);
+            }
+            ArmWake();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ArmAccept() {
+        m_ring->multishot_accept(m_listenFd, UserData(OP_ACCEPT, 0));
+        m_acceptArmed = true;
+    }
+
+    void ArmWake() {
+        m_ring->read(m_flushQueue.Fd(), false, &m_wakeCount, sizeof(m_wakeCount), UINT64_MAX, UserData(OP_WAKE, 0));
+    }
+
+    void ArmRecv(UringConnection& connection) {
+        m_ring->multishot_recv(connection.Fd(), false, UserData(OP_RECV, connection.Fd()));
+        connection.recvArmed = true;
+    }
+
+    void Accepted(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            m_acceptArmed = false;
+            m_acceptRetry = std::chrono::steady_clock::now() + (cqe.res < 0 ? ACCEPT_RETRY_DELAY : std::chrono::steady_clock::duration::zero());
+        }
+        if (cqe.res < 0) {
+            std::cerr << "accept failed: " << std::strerror(-cqe.res) << std::endl;
+            return;
+        }
+        int fd = cqe.res;
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        auto connection = std::make_shared<UringConnection>(fd, m_flushQueue, m_zeroCopy);
+        ArmRecv(*connection);
+        m_connections[fd] = std::move(connection);
+        std::cout << "Client connected: " << fd << std::endl;
+    }
+
+    void Received(int fd, const io_uring_cqe& cqe) {
+        std::shared_ptr<UringConnection> connection = m_connections.at(fd);
+        bool keep = true;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned id = io_ring::recv_buffer_id(cqe);
+            if (cqe.res > 0 && !connection->dropped) {
+                keep = Feed(connection, reinterpret_cast<const char*>(m_ring->recv_buffer(id)), static_cast<size_t>(cqe.res));
+            }
+            m_ring->recycle_recv_buffer(id);
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) connection->recvArmed = false;
+        // ENOBUFS: the provided buffers ran out and the recv stopped; by the time the
+        // recv armed again is submitted they have been recycled.
+        if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) keep = false;
+        if (!keep) {
+            Drop(*connection);
+        }
+        else if (!connection->recvArmed && !connection->dropped) {
+            ArmRecv(*connection);
+        }
+        Settle(*connection);
+    }
+
+    bool Feed(const std::shared_ptr<UringConnection>& connection, const char* data, size_t length) {
+        FrameReader& reader = connection->Reader();
+        {
+            metric_timer timer(Metrics().parseTime);
+            reader.Feed(data, length);
+        }
+        Frame frame;
+        while (reader.Next(frame)) {
+            if (!HandleFrame(connection, frame)) return false;
+        }
+        if (reader.Failed()) {
+            std::cerr << "Malformed frame from client " << connection->Fd() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void SubmitSend(UringConnection& connection) {
+        const msghdr* message = nullptr;
+        bool zeroCopy = false;
+        if (!connection.PrepareSend(message, zeroCopy)) return;
+        int flags = MSG_NOSIGNAL | MSG_WAITALL;
+        if (zeroCopy) {
+            m_ring->sendmsg_zc(connection.Fd(), false, message, flags, UserData(OP_SEND, connection.Fd()));
+        }
+        else {
+            m_ring->sendmsg(connection.Fd(), false, message, flags, UserData(OP_SEND, connection.Fd()));
+        }
+    }
+
+    void Sent(int fd, const io_uring_cqe& cqe) {
+        std::shared_ptr<UringConnection> connection = m_connections.at(fd);
+        if (cqe.flags & IORING_CQE_F_NOTIF) {
+            connection->ZeroCopyDone();
+        }
+        else {
+            // A zero-copy send is followed by a notification iff F_MORE is set; with no
+            // notification coming the frames need not wait for one.
+            bool zeroCopy = (cqe.flags & IORING_CQE_F_MORE) != 0;
+            if (!connection->SendCompleted(cqe.res, zeroCopy)) {
+                Drop(*connection);
+            }
+            else if (!connection->dropped) {
+                SubmitSend(*connection);
+            }
+        }
+        Settle(*connection);
+    }
+
+    void Drop(UringConnection& connection) {
+        if (connection.dropped) return;
+        connection.dropped = true;
+        ConnectionClosed(connection);
+        connection.Close();
+        m_ring->cancel_fd(connection.Fd(), false, UserData(OP_IGNORE, 0));
+        std::cout << "Client disconnected: " << connection.Fd() << std::endl;
+    }
+
+    // Closes a dropped connection's socket once nothing of it is in flight.
+    void Settle(UringConnection& connection) {
+        if (!connection.dropped || connection.recvArmed || connection.Busy()) return;
+        int fd = connection.Fd();
+        close(fd);
+        m_connections.erase(fd);
+    }
+
+    int m_listenFd;
+    std::unique_ptr<io_ring> m_ring;
+    bool m_zeroCopy = false;
+    bool m_acceptArmed = false;
+    std::chrono::steady_clock::time_point m_acceptRetry;
+    FlushQueue m_flushQueue;
+    uint64_t m_wakeCount = 0;
+    std::unordered_map<int, std::shared_ptr<UringConnection>> m_connections;
+};
+
+}
+
+bool RunUringServer(uint16_t port, size_t ioThreadsAmount) {
+    if (ioThreadsAmount == 0) ioThreadsAmount = 1;
+
+    std::vector<std::unique_ptr<UringIoThread>> ioThreads;
+    for (size_t i = 0; i < ioThreadsAmount; i++) {
+        int listenFd = OpenListenSocket(port);
+        if (listenFd < 0) return false;
+        ioThreads.push_back(std::make_unique<UringIoThread>(listenFd));
+    }
+
+    std::cout << "Server is listening on port " << port << " (io_uring, " << ioThreadsAmount << " I/O threads)" << std::endl;
+
+    std::vector<std::thread> threads;
+    for (auto& ioThread : ioThreads) {
+        threads.emplace_back([&ioThread]() { ioThread->Run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+
+// The epoll backend's I/O threads on io_uring (see common/io_ring.h): each thread's
+// SO_REUSEPORT socket is served by a multishot accept, every connection by a multishot
+// recv into the thread's pool of provided buffers, and a thread submits its I/O and
+// reaps the results in one syscall per loop iteration. Workers still write a reply
+// straight to the socket when nothing is queued ahead of it; what does not fit is
+// handed to the I/O thread, which sends the backlog of each connection as one
+// sendmsg (zero-copy for large bodies where the kernel has it). Same contract as
+// RunEpollServer; needs Linux 6.0, so call only when io_ring::enabled().
+bool RunUringServer(uint16_t port, size_t ioThreadsAmount);
+
+#endif
@@ -6,17 +6,44 @@
 #include <vector>
 #include <ctime>
 #include <sstream>
+#include <climits>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include "../PC4/protocol.h"
+#include "../PC4/codec.h"
+#include "matrix_client.h"
 
 #pragma comment(lib, "Ws2_32.lib")
 
 #define DEFAULT_PORT "27015"
-#define BUFFER_SIZE 1000000 // 10000 x 10000 int матриця потребує 400MB
+#define BUFFER_SIZE 65536 // розмір одного recv, кадри збираються з кількох читань
+#define STREAM_WINDOW 4 // смуг без відповіді під час stream, не більше MAX_STREAM_WINDOW
+#define STREAM_BAND_ELEMENTS (1 << 20) // елементів у смузі за замовчуванням
 
-void PrintMatrix(const int* matrix, int size, const std::string& matrixName) {
+// Стан потокової задачі: скільки смуг ще без відповіді і контрольні суми для перевірки.
+// Повних матриць клієнт не тримає, тому результат перевіряється сумою A - B по смузі.
+struct StreamProgress {
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool active = false;
+    uint32_t taskId = 0;
+    uint32_t outstanding = 0;
+    uint32_t received = 0;
+    uint32_t mismatches = 0;
+    std::unordered_map<uint32_t, int64_t> expected; // перший рядок смуги -> сума
+};
+
+StreamProgress streamProgress;
+// Кодек матриць у запитах, задається командою compress; CODEC_NONE - сирі int32
+uint8_t payloadCodec = CODEC_NONE;
+
+void PrintMatrix(const int* matrix, int rows, int cols, const std::string& matrixName) {
     std::cout << matrixName << ":\n";
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < size; ++j) {
-            std::cout << matrix[i * size + j] << " ";
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            std::cout << matrix[i * cols + j] << " ";
         }
         std::cout << "\n";
     }
@@ -28,50 +55,312 @@ void GenerateMatrix(int* matrix, int size) {
     }
 }
 
-void SendCommand(SOCKET connectSocket, const std::string& command) {
-    send(connectSocket, command.c_str(), command.size(), 0);
+bool SendBytes(SOCKET connectSocket, const void* bytes, size_t length) {
+    const char* data = static_cast<const char*>(bytes);
+    while (length > 0) {
+        int sent = send(connectSocket, data, static_cast<int>(length < INT_MAX ? length : INT_MAX), 0);
+        if (sent <= 0) {
+            std::cerr << "send failed: " << WSAGetLastError() << std::endl;
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+void SendFrame(SOCKET connectSocket, const std::vector<uint8_t>& frame) {
+    SendBytes(connectSocket, frame.data(), frame.size());
+}
+
+// Заголовок і матриці (count елементів у порядку мережі) в поточному кодеку.
+bool SendMatrices(SOCKET connectSocket, FrameHeader header, const int* values, size_t count) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+    std::vector<uint8_t> compressed;
+    header.dtype = DTYPE_INT32;
+    header.payloadLength = count * sizeof(int32_t);
+    if (payloadCodec != CODEC_NONE) {
+        compressed = EncodePayload(payloadCodec, bytes, count, header.cols);
+        header.codec = payloadCodec;
+        header.payloadLength = compressed.size();
+        bytes = compressed.data();
+    }
+    uint8_t encoded[FRAME_HEADER_SIZE];
+    EncodeHeader(header, encoded);
+    return SendBytes(connectSocket, encoded, sizeof(encoded)) && SendBytes(connectSocket, bytes, header.payloadLength);
+}
+
+// Стиснуту відповідь розпаковує на місці, далі кадр обробляється як звичайний.
+bool DecodeReply(Frame& frame) {
+    FrameHeader& header = frame.header;
+    if (header.codec == CODEC_NONE || frame.payload.empty()) return true;
+    size_t count = static_cast<size_t>(header.rows) * header.cols;
+    if (count * sizeof(int32_t) > MAX_PAYLOAD_SIZE) return false;
+    pooled_buffer raw = buffer_pool::shared().acquire(count * sizeof(int32_t));
+    if (!DecodePayload(header.codec, frame.payload.data(), frame.payload.size(), raw.data(), count)) return false;
+    frame.payload = std::move(raw);
+    header.codec = CODEC_NONE;
+    header.payloadLength = count * sizeof(int32_t);
+    return true;
+}
+
+void SendRequest(SOCKET connectSocket, uint8_t opcode, int taskId) {
+    FrameHeader header;
+    header.opcode = opcode;
+    header.taskId = taskId;
+    SendFrame(connectSocket, BuildFrame(header));
+}
+
+void PrintReply(const Frame& frame) {
+    const FrameHeader& header = frame.header;
+    if (header.opcode == OP_HELLO_REPLY) {
+        std::cout << "Server response: matrix replies compressed with " << CodecName(header.codec) << "\n> ";
+        std::cout.flush();
+        return;
+    }
+    if (header.opcode == OP_STATS_REPLY) {
+        std::cout << "Server stats:\n";
+        std::cout.write(reinterpret_cast<const char*>(frame.payload.data()), frame.payload.size());
+        std::cout << "> ";
+        std::cout.flush();
+        return;
+    }
+    std::cout << "Server response: task " << header.taskId << " " << OpcodeName(header.opcode) << ": " << StatusName(header.status);
+    if (header.opcode == OP_RESULT_REPLY && header.status == STATUS_COMPLETED) {
+        size_t count = static_cast<size_t>(header.rows) * header.cols;
+        std::cout << " (" << header.rows << "x" << header.cols << ")\n";
+        if (header.rows <= 5 && header.cols <= 5 && frame.payload.size() == count * sizeof(int32_t)) {
+            std::vector<int> result(count);
+            ReadInt32LE(frame.payload.data(), count, result.data());
+            PrintMatrix(result.data(), header.rows, header.cols, "Result Matrix");
+        }
+    }
+    else {
+        std::cout << "\n";
+    }
+    std::cout << "> ";
+    std::cout.flush();
+}
+
+void OnStreamResult(const Frame& frame) {
+    const FrameHeader& header = frame.header;
+    size_t count = static_cast<size_t>(header.rows) * header.cols;
+    std::vector<int> band(count);
+    if (frame.payload.size() == count * sizeof(int32_t)) {
+        ReadInt32LE(frame.payload.data(), count, band.data());
+    }
+    int64_t sum = 0;
+    for (int value : band) sum += value;
+
+    std::lock_guard<std::mutex> lock(streamProgress.mutex);
+    auto it = streamProgress.expected.find(header.firstRow);
+    if (it == streamProgress.expected.end() || it->second != sum) {
+        streamProgress.mismatches++;
+    }
+    if (it != streamProgress.expected.end()) {
+        streamProgress.expected.erase(it);
+    }
+    streamProgress.outstanding--;
+    streamProgress.received++;
+    streamProgress.changed.notify_all();
 }
 
-void ReceiveResponses(SOCKET connectSocket) { //TODO: Add timeout;
-    char buffer[BUFFER_SIZE];
+// OP_COMPLETED або OP_ERROR для потокової задачі завершують її.
+void OnStreamEnd(const Frame& frame) {
+    std::lock_guard<std::mutex> lock(streamProgress.mutex);
+    if (!streamProgress.active || frame.header.taskId != streamProgress.taskId) return;
+    if (frame.header.opcode != OP_COMPLETED && frame.header.opcode != OP_ERROR) return;
+    streamProgress.active = false;
+    streamProgress.changed.notify_all();
+    std::cout << "Stream task " << streamProgress.taskId << ": " << streamProgress.received << " bands received, "
+        << streamProgress.mismatches << " mismatched" << std::endl;
+}
+
+// Відповіді на команди цього сокета, без тайм-аутів; задачі з тайм-аутом і повторами
+// надсилає MatrixClient (команда async).
+void ReceiveResponses(SOCKET connectSocket) {
+    std::vector<char> buffer(BUFFER_SIZE);
+    FrameReader reader;
+    Frame frame;
     while (true) {
-        int recvResult = recv(connectSocket, buffer, BUFFER_SIZE-1, 0);
-        if (recvResult <= 0) break;
-        buffer[recvResult] = '\0';
-        std::string response(buffer);
-        std::cout << "Server response: " << response << "\n> ";
+        // великий результат читається одразу в буфер кадру
+        size_t remaining = 0;
+        uint8_t* target = reader.PayloadTarget(remaining);
+        if (target != nullptr && remaining >= BUFFER_SIZE) {
+            int recvResult = recv(connectSocket, reinterpret_cast<char*>(target), static_cast<int>(remaining < INT_MAX ? remaining : INT_MAX), 0);
+            if (recvResult <= 0) break;
+            reader.CommitPayload(recvResult);
+        }
+        else {
+            int recvResult = recv(connectSocket, buffer.data(), BUFFER_SIZE, 0);
+            if (recvResult <= 0) break;
+            reader.Feed(buffer.data(), recvResult);
+        }
+        while (reader.Next(frame)) {
+            if (!DecodeReply(frame)) {
+                std::cerr << "Malformed compressed reply for task " << frame.header.taskId << std::endl;
+                continue;
+            }
+            if (frame.header.opcode == OP_STREAM_RESULT) {
+                OnStreamResult(frame);
+                continue;
+            }
+            OnStreamEnd(frame);
+            PrintReply(frame);
+        }
+        if (reader.Failed()) {
+            std::cerr << "Malformed frame from server." << std::endl;
+            break;
+        }
     }
     std::cout << "Connection closed." << std::endl;
 }
 
-void ProcessCommand(SOCKET connectSocket, int size, int taskId) {
-    int* matrixA = new int[size * size];
-    int* matrixB = new int[size * size];
+void ProcessCommand(SOCKET connectSocket, int size, int taskId, uint8_t flags = 0) {
+    size_t count = static_cast<size_t>(size) * size;
+    if (size <= 0 || 2 * count * sizeof(int32_t) > MAX_PAYLOAD_SIZE) {
+        std::cerr << "Error: sending data is too large." << std::endl;
+        return;
+    }
+
+    // A і B йдуть одним кадром, одна за одною
+    std::vector<int> matrices(2 * count);
+    int* matrixA = matrices.data();
+    int* matrixB = matrices.data() + count;
     GenerateMatrix(matrixA, size);
     GenerateMatrix(matrixB, size);
 
     if (size <= 5) {
-        PrintMatrix(matrixA, size, "Matrix A");
-        PrintMatrix(matrixB, size, "Matrix B");
+        PrintMatrix(matrixA, size, size, "Matrix A");
+        PrintMatrix(matrixB, size, size, "Matrix B");
     }
 
-    std::ostringstream oss;
-    oss << "process " << size << " " << taskId << " ";
-    for (int i = 0; i < size * size; ++i) {
-        oss << matrixA[i] << " ";
+    FrameHeader header;
+    header.opcode = OP_PROCESS;
+    header.flags = flags;
+    header.taskId = taskId;
+    header.rows = size;
+    header.cols = size;
+
+    // без стиснення матриці йдуть у сокет прямо з вектора, без копії в окремий кадр
+    SwapInt32LEInPlace(matrices.data(), matrices.size());
+    SendMatrices(connectSocket, header, matrices.data(), matrices.size());
+}
+
+// Матриця size x size передається смугами по bandRows рядків: кожна смуга генерується,
+// надсилається і забувається, сервер рахує її одразу і повертає результат смуги.
+void StreamCommand(SOCKET connectSocket, int size, int taskId, int bandRows) {
+    if (size <= 0 || bandRows <= 0) {
+        std::cerr << "Error: size and band rows must be positive." << std::endl;
+        return;
     }
-    for (int i = 0; i < size * size; ++i) {
-        oss << matrixB[i] << " ";
+    {
+        std::lock_guard<std::mutex> lock(streamProgress.mutex);
+        if (streamProgress.active) {
+            std::cerr << "Error: another stream is still running." << std::endl;
+            return;
+        }
+        streamProgress.active = true;
+        streamProgress.taskId = taskId;
+        streamProgress.outstanding = 0;
+        streamProgress.received = 0;
+        streamProgress.mismatches = 0;
+        streamProgress.expected.clear();
+    }
+
+    FrameHeader begin;
+    begin.opcode = OP_STREAM_BEGIN;
+    begin.taskId = taskId;
+    begin.rows = size;
+    begin.cols = size;
+    SendFrame(connectSocket, BuildFrame(begin));
+
+    for (int firstRow = 0; firstRow < size; firstRow += bandRows) {
+        int rows = std::min(bandRows, size - firstRow);
+        size_t count = static_cast<size_t>(rows) * size;
+        std::vector<int> band(2 * count);
+        for (size_t i = 0; i < band.size(); ++i) {
+            band[i] = rand() % 100;
+        }
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            sum += band[i] - band[count + i];
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(streamProgress.mutex);
+            streamProgress.changed.wait(lock, []() { return !streamProgress.active || streamProgress.outstanding < STREAM_WINDOW; });
+            if (!streamProgress.active) return; // сервер відхилив потік
+            streamProgress.expected[firstRow] = sum;
+            streamProgress.outstanding++;
+        }
+
+        FrameHeader header;
+        header.opcode = OP_STREAM_CHUNK;
+        header.taskId = taskId;
+        header.firstRow = firstRow;
+        header.rows = rows;
+        header.cols = size;
+        SwapInt32LEInPlace(band.data(), band.size());
+        if (!SendMatrices(connectSocket, header, band.data(), band.size())) {
+            return;
+        }
     }
+}
 
-    if (sizeof(char) * BUFFER_SIZE > sizeof(oss.str())) {
-        SendCommand(connectSocket, oss.str());
+// COUNT задач N x N через MatrixClient: пул окремих з'єднань, конвеєр, тайм-аут кожної
+// задачі і повтори, коли сервер зайнятий. Результати перевіряються на клієнті.
+void AsyncCommand(int size, int count, int timeoutMs) {
+    if (size <= 0 || count <= 0) {
+        std::cerr << "Error: size and count must be positive." << std::endl;
+        return;
     }
-    else std::cerr << "Error: sending data is too large." << std::endl;
-    
+    MatrixClient::Config config;
+    config.port = static_cast<uint16_t>(std::stoi(DEFAULT_PORT));
+    config.codec = payloadCodec;
+    if (timeoutMs > 0) config.timeout = std::chrono::milliseconds(timeoutMs);
+    MatrixClient client(config);
+    if (!client.Connect()) {
+        std::cerr << "Unable to connect to server!" << std::endl;
+        return;
+    }
+
+    Matrix a, b;
+    a.rows = a.cols = b.rows = b.cols = size;
+    a.values.resize(static_cast<size_t>(size) * size);
+    b.values.resize(a.values.size());
+    GenerateMatrix(a.values.data(), size);
+    GenerateMatrix(b.values.data(), size);
 
-    delete[] matrixA;
-    delete[] matrixB;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<MatrixResult>> results;
+    for (int i = 0; i < count; ++i) {
+        results.push_back(client.Submit(a, b));
+    }
+    int completed = 0, mismatched = 0, retried = 0;
+    std::unordered_map<std::string, int> failures;
+    for (auto& future : results) {
+        MatrixResult result = future.get();
+        if (result.attempts > 1) retried++;
+        if (!result.Ok()) {
+            failures[RequestErrorName(result.error)]++;
+            continue;
+        }
+        completed++;
+        for (size_t i = 0; i < a.values.size(); ++i) {
+            if (result.matrix.values[i] != a.values[i] - b.values[i]) {
+                mismatched++;
+                break;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << completed << "/" << count << " completed in " << seconds << " s, " << mismatched << " mismatched, "
+        << retried << " retried";
+    for (const auto& [error, amount] : failures) {
+        std::cout << ", " << error << ": " << amount;
+    }
+    std::cout << std::endl;
 }
 
 int main() {
@@ -140,6 +429,58 @@ int main() {
             }
             ProcessCommand(connectSocket, matrixSize, taskId);
         }
+        else if (cmd == "submit") {
+            // COUNT задач підряд без очікування відповідей, результати сервер надсилає сам
+            int matrixSize, taskId, count = 1;
+            iss >> matrixSize >> taskId;
+            if (iss.fail()) {
+                std::cerr << "Invalid command format. Use 'submit N ID [COUNT]'." << std::endl;
+                continue;
+            }
+            iss >> count;
+            for (int i = 0; i < count; ++i) {
+                ProcessCommand(connectSocket, matrixSize, taskId + i, FLAG_PUSH_RESULT);
+            }
+        }
+        else if (cmd == "stream") {
+            int matrixSize, taskId, bandRows = 0;
+            iss >> matrixSize >> taskId;
+            if (iss.fail()) {
+                std::cerr << "Invalid command format. Use 'stream N ID [BAND_ROWS]'." << std::endl;
+                continue;
+            }
+            iss >> bandRows;
+            if (bandRows <= 0) {
+                bandRows = std::max(1, STREAM_BAND_ELEMENTS / std::max(matrixSize, 1));
+            }
+            StreamCommand(connectSocket, matrixSize, taskId, bandRows);
+        }
+        else if (cmd == "async") {
+            int matrixSize, count, timeoutMs = 0;
+            iss >> matrixSize >> count;
+            if (iss.fail()) {
+                std::cerr << "Invalid command format. Use 'async N COUNT [TIMEOUT_MS]'." << std::endl;
+                continue;
+            }
+            iss >> timeoutMs;
+            AsyncCommand(matrixSize, count, timeoutMs);
+        }
+        else if (cmd == "compress") {
+            // compress none|for|delta|lz: кодек для запитів і відповідей сервера
+            std::string name;
+            iss >> name;
+            uint8_t codec = 0;
+            while (CodecSupported(codec) && name != CodecName(codec)) ++codec;
+            if (!CodecSupported(codec)) {
+                std::cerr << "Invalid command format. Use 'compress none|for|delta|lz'." << std::endl;
+                continue;
+            }
+            payloadCodec = codec;
+            FrameHeader hello;
+            hello.opcode = OP_HELLO;
+            hello.status = CodecBit(codec);
+            SendFrame(connectSocket, BuildFrame(hello));
+        }
         else if (cmd == "status" || cmd == "result") {
             int taskId;
             iss >> taskId;
@@ -148,13 +489,17 @@ int main() {
                 std::cerr << "Invalid command format. Use 'status ID' or 'result ID'." << std::endl;
                 continue;
             }
-            SendCommand(connectSocket, command);
+            SendRequest(connectSocket, cmd == "status" ? OP_STATUS : OP_RESULT, taskId);
+        }
+        else if (cmd == "stats") {
+            // метрики сервера: лічильники, черги і гістограми часу по фазах
+            SendRequest(connectSocket, OP_STATS, 0);
         }
         else if (cmd == "exit") {
             break;
         }
         else {
-            std::cout << "Unknown command. Please use 'process N ID', 'status ID', 'result ID', or 'exit'." << std::endl;
+            std::cout << "Unknown command. Please use 'process N ID', 'submit N ID [COUNT]', 'stream N ID [BAND_ROWS]', 'async N COUNT [TIMEOUT_MS]', 'compress CODEC', 'status ID', 'result ID', 'stats', or 'exit'." << std::endl;
         }
     }
 
@@ -1,10 +1,84 @@
+import random
 import socket
+import struct
 import threading
 import time
 
 SERVER_ADDRESS = '127.0.0.1'
 PORT = 27015
-BUFFER_SIZE = 1024
+BUFFER_SIZE = 65536
+
+# Frame header from PC4/protocol.h: magic, version, opcode, dtype, flags,
+# task id, rows, cols, status, payload length. Little-endian, 32 bytes.
+HEADER = struct.Struct('<IBBBBIIIIQ')
+MAGIC = 0x46344350
+VERSION = 1
+OP_PROCESS, OP_STATUS, OP_RESULT = 1, 2, 3
+OP_STREAM_BEGIN, OP_STREAM_CHUNK, OP_STREAM_RESULT = 5, 6, 20
+OP_STATS, OP_STATS_REPLY = 8, 22
+OP_COMPLETED, OP_ERROR = 16, 19
+OP_NAMES = {16: 'completed', 17: 'status reply', 18: 'result reply', 19: 'error', 20: 'stream result'}
+STATUS_NAMES = {0: 'ok', 1: 'pending', 2: 'completed', 3: 'unknown', 4: 'bad request', 5: 'busy', 6: 'duplicate task id', 7: 'evicted'}
+DTYPE_NONE, DTYPE_INT32 = 0, 1
+# Server pushes the result as soon as the task finishes, no status/result polling.
+FLAG_PUSH_RESULT = 1
+# Row bands of a stream sent before their results come back; the server allows 16.
+STREAM_WINDOW = 4
+STREAM_BAND_ELEMENTS = 1 << 20
+
+
+# Bands of one stream waiting for their results. A new one per OP_STREAM_BEGIN; it
+# fails, and lets the sender stop, when the server answers the stream with OP_ERROR.
+class StreamWindow:
+    def __init__(self):
+        self.condition = threading.Condition()
+        self.in_flight = 0
+        self.failed = False
+
+    # False once the stream failed: no more bands should be sent.
+    def acquire(self):
+        with self.condition:
+            self.condition.wait_for(lambda: self.failed or self.in_flight < STREAM_WINDOW)
+            if self.failed:
+                return False
+            self.in_flight += 1
+            return True
+
+    def release(self):
+        with self.condition:
+            self.in_flight = max(0, self.in_flight - 1)
+            self.condition.notify()
+
+    def fail(self):
+        with self.condition:
+            self.failed = True
+            self.condition.notify_all()
+
+
+# Streams in progress by task id, until OP_COMPLETED or OP_ERROR ends them.
+streams = {}
+streams_lock = threading.Lock()
+
+
+# `status` is the first row of the band for OP_STREAM_CHUNK and OP_STREAM_RESULT.
+def build_frame(opcode, task_id, rows=0, cols=0, payload=b'', flags=0, status=0):
+    dtype = DTYPE_INT32 if payload else DTYPE_NONE
+    return HEADER.pack(MAGIC, VERSION, opcode, dtype, flags, task_id, rows, cols, status, len(payload)) + payload
+
+
+def stream(client_socket, n, task_id, band_rows):
+    window = StreamWindow()
+    with streams_lock:
+        streams[task_id] = window
+    client_socket.sendall(build_frame(OP_STREAM_BEGIN, task_id, n, n))
+    for first_row in range(0, n, band_rows):
+        rows = min(band_rows, n - first_row)
+        values = [random.randrange(100) for _ in range(2 * rows * n)]
+        if not window.acquire():
+            print(f"Stream {task_id} stopped at row {first_row}: the server rejected it.")
+            return
+        client_socket.sendall(build_frame(OP_STREAM_CHUNK, task_id, rows, n, struct.pack(f'<{len(values)}i', *values), status=first_row))
+
 
 def connect_and_send():
     while True:
@@ -16,43 +90,101 @@ def connect_and_send():
             print(f"Connection failed: {e}. Retrying in 5 seconds...")
             time.sleep(5)
 
+
+def print_frame(header, payload):
+    _, _, opcode, _, _, task_id, rows, cols, status, _ = header
+    if opcode == OP_STATS_REPLY:
+        print("\nServer stats:\n" + payload.decode())
+        return
+    line = f"\nResponse: task {task_id} {OP_NAMES.get(opcode, opcode)}: {STATUS_NAMES.get(status, status)}"
+    if payload:
+        values = struct.unpack(f'<{rows * cols}i', payload)
+        line += f" ({rows}x{cols})"
+        if rows <= 5 and cols <= 5:
+            line += ''.join('\n' + ' '.join(map(str, values[r * cols:(r + 1) * cols])) for r in range(rows))
+    print(line)
+
+
+# Frees a window slot for stream results; ends the stream on its last reply.
+def track_stream(opcode, task_id):
+    with streams_lock:
+        window = streams.get(task_id)
+        if window is not None and opcode in (OP_COMPLETED, OP_ERROR):
+            del streams[task_id]
+    if window is None:
+        return
+    if opcode == OP_STREAM_RESULT:
+        window.release()
+    elif opcode == OP_ERROR:
+        window.fail()
+
+
 def handle_response(client_socket):
+    buffer = bytearray()
     while True:
         try:
             response = client_socket.recv(BUFFER_SIZE)
-            if response:
-                print(f"\nResponse: {response.decode()}")
-            else:
+            if not response:
                 print("Connection closed by server.")
                 client_socket.close()
-                client_socket = connect_and_send()
+                return
+            buffer += response
+            # Frames are read in place; the consumed bytes are dropped once per recv.
+            offset = 0
+            while len(buffer) - offset >= HEADER.size:
+                header = HEADER.unpack_from(buffer, offset)
+                end = offset + HEADER.size + header[-1]
+                if len(buffer) < end:
+                    break
+                opcode, task_id = header[2], header[5]
+                track_stream(opcode, task_id)
+                if opcode != OP_STREAM_RESULT:
+                    print_frame(header, buffer[offset + HEADER.size:end])
+                offset = end
+            del buffer[:offset]
         except socket.error as e:
             print(f"Recv failed: {e}")
             client_socket.close()
-            client_socket = connect_and_send()
+            return
+
 
 def main():
     client_socket = connect_and_send()
     threading.Thread(target=handle_response, args=(client_socket,), daemon=True).start()
 
     while True:
-        command = input("Enter command (process N / status / exit): ")
+        command = input("Enter command (process N ID / submit N ID [COUNT] / stream N ID [BAND_ROWS] / status ID / result ID / stats / exit): ")
+        parts = command.split()
 
         if command == "exit":
             break
-        elif command.startswith("process"):
-            try:
-                _, n = command.split()
-                n = int(n)
-                client_socket.sendall(command.encode())
-            except ValueError:
-                print("Invalid command: N must be a number.")
-        elif command == "status":
-            client_socket.sendall(command.encode())
-        else:
-            print("Invalid command.")
+        try:
+            if len(parts) == 3 and parts[0] == "process":
+                n, task_id = int(parts[1]), int(parts[2])
+                values = [random.randrange(100) for _ in range(2 * n * n)]
+                client_socket.sendall(build_frame(OP_PROCESS, task_id, n, n, struct.pack(f'<{len(values)}i', *values)))
+            elif len(parts) in (3, 4) and parts[0] == "submit":
+                n, task_id = int(parts[1]), int(parts[2])
+                count = int(parts[3]) if len(parts) == 4 else 1
+                for i in range(count):
+                    values = [random.randrange(100) for _ in range(2 * n * n)]
+                    client_socket.sendall(build_frame(OP_PROCESS, task_id + i, n, n, struct.pack(f'<{len(values)}i', *values), FLAG_PUSH_RESULT))
+            elif len(parts) in (3, 4) and parts[0] == "stream":
+                n, task_id = int(parts[1]), int(parts[2])
+                band_rows = int(parts[3]) if len(parts) == 4 else max(1, STREAM_BAND_ELEMENTS // max(n, 1))
+                stream(client_socket, n, task_id, band_rows)
+            elif parts == ["stats"]:
+                client_socket.sendall(build_frame(OP_STATS, 0))
+            elif len(parts) == 2 and parts[0] in ("status", "result"):
+                opcode = OP_STATUS if parts[0] == "status" else OP_RESULT
+                client_socket.sendall(build_frame(opcode, int(parts[1])))
+            else:
+                print("Invalid command.")
+        except ValueError:
+            print("Invalid command: N and ID must be numbers.")
 
     client_socket.close()
 
+
 if __name__ == "__main__":
     main()
@@ -0,0 +1,576 @@
+#include "matrix_client.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t RECEIVE_BUFFER_SIZE = 65536;
+// Payload remainders at least this large are received in place, not through the buffer.
+constexpr size_t DIRECT_RECEIVE_THRESHOLD = 16384;
+// Longest the I/O thread sleeps while tasks are pending, which bounds how late a
+// deadline or a retry can fire.
+constexpr int POLL_INTERVAL_MS = 5;
+constexpr int IDLE_POLL_INTERVAL_MS = 100;
+
+void FailRequest(MatrixResult& result, RequestError error, uint32_t status = 0) {
+    result.error = error;
+    result.status = status;
+}
+
+}
+
+struct MatrixClient::Request {
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    uint8_t codec = CODEC_NONE;
+    // A then B as sent, kept for retries.
+    std::shared_ptr<const std::vector<uint8_t>> payload;
+    Clock::time_point deadline;
+    uint32_t attempts = 0;
+    Callback done;
+};
+
+struct MatrixClient::PooledConnection {
+    // Replaced and closed only under sendLock, so a sender never writes to a handle the
+    // OS has already given to someone else.
+    SocketHandle socket = INVALID_SOCKET;
+    std::mutex sendLock;
+    std::deque<std::pair<OutgoingFrame, size_t>> sendQueue; // frame, bytes already sent
+    FrameReader reader; // I/O thread only
+
+    // Under MatrixClient::m_lock.
+    bool connected = false;
+    // Bumped on every reconnect: a task dispatched to the previous socket is not sent
+    // on the new one, where the server would not know it.
+    uint64_t generation = 0;
+    Clock::time_point reconnectAt;
+    uint32_t nextTaskId = 1;
+    std::unordered_map<uint32_t, RequestPtr> inFlight;
+};
+
+const char* RequestErrorName(RequestError error) {
+    switch (error) {
+    case REQUEST_OK: return "ok";
+    case REQUEST_INVALID: return "invalid";
+    case REQUEST_REJECTED: return "rejected";
+    case REQUEST_TIMEOUT: return "timeout";
+    case REQUEST_CONNECTION_LOST: return "connection lost";
+    case REQUEST_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+bool CompletionQueue::Next(Completion& completion, std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (!m_ready.wait_for(lock, wait, [this]() { return !m_completions.empty(); })) return false;
+    completion = std::move(m_completions.front());
+    m_completions.pop_front();
+    return true;
+}
+
+void CompletionQueue::Push(uint64_t tag, MatrixResult result) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_completions.push_back(Completion{ tag, std::move(result) });
+    }
+    m_ready.notify_one();
+}
+
+MatrixClient::MatrixClient(Config config) : m_config(std::move(config)), m_buffer(RECEIVE_BUFFER_SIZE) {
+    m_config.connections = std::max<size_t>(m_config.connections, 1);
+    m_config.maxInFlight = std::max<size_t>(m_config.maxInFlight, 1);
+    if (!CodecSupported(m_config.codec)) m_config.codec = CODEC_NONE;
+    for (size_t i = 0; i < m_config.connections; i++) {
+        m_connections.push_back(std::make_unique<PooledConnection>());
+    }
+}
+
+MatrixClient::~MatrixClient() {
+    Close();
+}
+
+bool MatrixClient::Connect() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_running) return true;
+    }
+    m_wake = OpenWakeSocket();
+    if (m_wake == INVALID_SOCKET) return false;
+    size_t opened = 0;
+    for (auto& connection : m_connections) {
+        if (Open(*connection)) opened++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = true;
+    }
+    m_thread = std::thread(&MatrixClient::Run, this);
+    return opened > 0;
+}
+
+void MatrixClient::Close() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_running) return;
+        m_running = false;
+    }
+    WakeSocket(m_wake);
+    m_thread.join();
+
+    for (auto& connection : m_connections) {
+        std::lock_guard<std::mutex> sendLock(connection->sendLock);
+        if (connection->socket != INVALID_SOCKET) CloseSocket(connection->socket);
+        connection->socket = INVALID_SOCKET;
+        connection->sendQueue.clear();
+    }
+    Finished finished;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto& connection : m_connections) {
+            connection->connected = false;
+            for (auto& [taskId, request] : connection->inFlight) {
+                finished.emplace_back(std::move(request), MatrixResult());
+            }
+            connection->inFlight.clear();
+        }
+        for (RequestPtr& request : m_waiting) finished.emplace_back(std::move(request), MatrixResult());
+        for (auto& [at, request] : m_retries) finished.emplace_back(std::move(request), MatrixResult());
+        m_waiting.clear();
+        m_retries.clear();
+    }
+    for (auto& [request, result] : finished) FailRequest(result, REQUEST_CANCELLED);
+    Deliver(finished);
+    CloseSocket(m_wake);
+    m_wake = INVALID_SOCKET;
+}
+
+std::future<MatrixResult> MatrixClient::Submit(Matrix a, Matrix b, std::chrono::milliseconds timeout) {
+    auto promise = std::make_shared<std::promise<MatrixResult>>();
+    std::future<MatrixResult> future = promise->get_future();
+    Submit(std::move(a), std::move(b), [promise](MatrixResult&& result) { promise->set_value(std::move(result)); }, timeout);
+    return future;
+}
+
+void MatrixClient::Submit(Matrix a, Matrix b, CompletionQueue& queue, uint64_t tag, std::chrono::milliseconds timeout) {
+    Submit(std::move(a), std::move(b), [&queue, tag](MatrixResult&& result) { queue.Push(tag, std::move(result)); }, timeout);
+}
+
+void MatrixClient::Submit(Matrix a, Matrix b, Callback done, std::chrono::milliseconds timeout) {
+    auto request = std::make_shared<Request>();
+    request->rows = a.rows;
+    request->cols = a.cols;
+    request->codec = m_config.codec;
+    request->deadline = Clock::now() + (timeout.count() > 0 ? timeout : m_config.timeout);
+    request->done = std::move(done);
+
+    size_t count = static_cast<size_t>(a.rows) * a.cols;
+    if (count == 0 || a.rows != b.rows || a.cols != b.cols || a.values.size() != count || b.values.size() != count
+        || 2 * count * sizeof(int32_t) > MAX_PAYLOAD_SIZE) {
+        MatrixResult result;
+        FailRequest(result, REQUEST_INVALID, STATUS_BAD_REQUEST);
+        request->done(std::move(result));
+        return;
+    }
+
+    // Encoding happens here, on the caller's thread, so the I/O thread only moves bytes.
+    std::vector<uint8_t> raw(2 * count * sizeof(int32_t));
+    WriteInt32LE(a.values.data(), count, raw.data());
+    WriteInt32LE(b.values.data(), count, raw.data() + count * sizeof(int32_t));
+    if (request->codec != CODEC_NONE) {
+        raw = EncodePayload(request->codec, raw.data(), 2 * count, a.cols);
+    }
+    request->payload = std::make_shared<const std::vector<uint8_t>>(std::move(raw));
+    Enqueue(std::move(request));
+}
+
+size_t MatrixClient::ConnectedCount() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return std::count_if(m_connections.begin(), m_connections.end(), [](const auto& connection) { return connection->connected; });
+}
+
+void MatrixClient::Enqueue(RequestPtr request) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (!m_running) {
+        lock.unlock();
+        MatrixResult result;
+        FailRequest(result, REQUEST_CANCELLED);
+        request->done(std::move(result));
+        return;
+    }
+    PooledConnection* connection = m_waiting.empty() ? PickConnection() : nullptr;
+    if (connection == nullptr) {
+        m_waiting.push_back(std::move(request));
+        return;
+    }
+    lock.unlock();
+    Dispatch(*connection, request);
+}
+
+// Round-robin over the connections that are up and have room. Caller holds m_lock.
+MatrixClient::PooledConnection* MatrixClient::PickConnection() {
+    for (size_t i = 0; i < m_connections.size(); i++) {
+        PooledConnection& connection = *m_connections[(m_nextConnection + i) % m_connections.size()];
+        if (connection.connected && connection.inFlight.size() < m_config.maxInFlight) {
+            m_nextConnection = (m_nextConnection + i + 1) % m_connections.size();
+            return &connection;
+        }
+    }
+    return nullptr;
+}
+
+// Registers the task on `connection` and sends it. Called without m_lock held, after
+// PickConnection chose the connection under it.
+void MatrixClient::Dispatch(PooledConnection& connection, const RequestPtr& request) {
+    uint32_t taskId;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!connection.connected) {
+            m_waiting.push_front(request);
+            WakeSocket(m_wake);
+            return;
+        }
+        taskId = connection.nextTaskId++;
+        if (connection.nextTaskId == 0) connection.nextTaskId = 1;
+        generation = connection.generation;
+        request->attempts++;
+        connection.inFlight[taskId] = request;
+    }
+
+    FrameHeader header;
+    header.opcode = OP_PROCESS;
+    header.dtype = DTYPE_INT32;
+    header.flags = FLAG_PUSH_RESULT;
+    header.codec = request->codec;
+    header.taskId = taskId;
+    header.rows = request->rows;
+    header.cols = request->cols;
+    header.payloadLength = request->payload->size();
+    OutgoingFrame frame;
+    frame.head.resize(FRAME_HEADER_SIZE);
+    EncodeHeader(header, frame.head.data());
+    frame.owner = request->payload;
+    frame.body = request->payload->data();
+    frame.bodyLength = request->payload->size();
+
+    bool backlogged;
+    {
+        std::lock_guard<std::mutex> sendLock(connection.sendLock);
+        {
+            // A reconnect in between already moved the task on; the new socket must not
+            // see it.
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (connection.generation != generation) return;
+        }
+        if (connection.socket == INVALID_SOCKET) return;
+        connection.sendQueue.emplace_back(std::move(frame), 0);
+        // Only the first frame in the queue is written from here; later ones follow it
+        // from the I/O thread, which also sees a failed send as a dead connection.
+        backlogged = connection.sendQueue.size() > 1 || !SendPending(connection);
+    }
+    if (backlogged) WakeSocket(m_wake);
+}
+
+// Writes queued frames until the socket would block. True when the queue is empty.
+// Caller holds sendLock.
+bool MatrixClient::SendPending(PooledConnection& connection) {
+    while (!connection.sendQueue.empty()) {
+        auto& [frame, sent] = connection.sendQueue.front();
+        const uint8_t* data;
+        size_t left;
+        if (sent < frame.head.size()) {
+            data = frame.head.data() + sent;
+            left = frame.head.size() - sent;
+        }
+        else {
+            size_t offset = sent - frame.head.size();
+            data = frame.body + offset;
+            left = frame.bodyLength - offset;
+        }
+        int chunk = static_cast<int>(std::min<size_t>(left, size_t(1) << 30));
+        int written = send(connection.socket, reinterpret_cast<const char*>(data), chunk, SEND_FLAGS);
+        if (written < 0) return false;
+        sent += written;
+        if (sent == frame.Size()) connection.sendQueue.pop_front();
+    }
+    return true;
+}
+
+// Connects and greets the server. Called before the I/O thread runs, or on it.
+bool MatrixClient::Open(PooledConnection& connection) {
+    SocketHandle socket = ConnectTcp(m_config.host, m_config.port);
+    if (socket == INVALID_SOCKET) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        connection.reconnectAt = Clock::now() + m_config.reconnectDelay;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> sendLock(connection.sendLock);
+        connection.socket = socket;
+        connection.reader = FrameReader();
+        if (m_config.codec != CODEC_NONE) {
+            FrameHeader hello;
+            hello.opcode = OP_HELLO;
+            hello.status = CodecBit(m_config.codec);
+            OutgoingFrame frame;
+            frame.head = BuildFrame(hello);
+            connection.sendQueue.emplace_back(std::move(frame), 0);
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    connection.generation++;
+    connection.connected = true;
+    return true;
+}
+
+void MatrixClient::Run() {
+    std::vector<pollfd> fds;
+    std::vector<PooledConnection*> polled;
+    Finished finished;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        bool pending;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_running) break;
+            ResendDue(now, finished);
+            ExpireOverdue(now, finished);
+            pending = !m_waiting.empty() || !m_retries.empty();
+            for (auto& connection : m_connections) pending = pending || !connection->inFlight.empty();
+        }
+        Reconnect(now);
+        Deliver(finished);
+
+        // Waiting tasks take the room completions and reconnects made.
+        while (true) {
+            RequestPtr request;
+            PooledConnection* connection;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_waiting.empty() || (connection = PickConnection()) == nullptr) break;
+                request = std::move(m_waiting.front());
+                m_waiting.pop_front();
+            }
+            Dispatch(*connection, request);
+        }
+
+        fds.clear();
+        polled.clear();
+        pollfd wake{};
+        wake.fd = m_wake;
+        wake.events = POLLIN;
+        fds.push_back(wake);
+        for (auto& connection : m_connections) {
+            std::lock_guard<std::mutex> sendLock(connection->sendLock);
+            if (connection->socket == INVALID_SOCKET) continue;
+            pollfd entry{};
+            entry.fd = connection->socket;
+            entry.events = POLLIN;
+            if (!connection->sendQueue.empty()) entry.events |= POLLOUT;
+            fds.push_back(entry);
+            polled.push_back(connection.get());
+        }
+        if (PollSockets(fds.data(), fds.size(), pending ? POLL_INTERVAL_MS : IDLE_POLL_INTERVAL_MS) <= 0) continue;
+
+        if (fds[0].revents & POLLIN) DrainWakeSocket(m_wake);
+        for (size_t i = 1; i < fds.size(); i++) {
+            PooledConnection& connection = *polled[i - 1];
+            if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                Receive(connection, finished);
+            }
+            if (fds[i].revents & POLLOUT) {
+                bool failed = false;
+                {
+                    std::lock_guard<std::mutex> sendLock(connection.sendLock);
+                    failed = connection.socket != INVALID_SOCKET && !SendPending(connection) && !WouldBlock();
+                }
+                if (failed) Fail(connection, finished);
+            }
+        }
+        Deliver(finished);
+    }
+}
+
+void MatrixClient::Reconnect(Clock::time_point now) {
+    for (auto& connection : m_connections) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (connection->connected || now < connection->reconnectAt) continue;
+        }
+        Open(*connection);
+    }
+}
+
+// Caller holds m_lock.
+void MatrixClient::ResendDue(Clock::time_point now, Finished& finished) {
+    auto due = std::stable_partition(m_retries.begin(), m_retries.end(), [now](const auto& retry) { return retry.first > now; });
+    for (auto it = due; it != m_retries.end(); ++it) {
+        if (it->second->deadline <= now) {
+            MatrixResult result;
+            FailRequest(result, REQUEST_TIMEOUT);
+            result.attempts = it->second->attempts;
+            finished.emplace_back(std::move(it->second), std::move(result));
+        }
+        else {
+            m_waiting.push_back(std::move(it->second));
+        }
+    }
+    m_retries.erase(due, m_retries.end());
+}
+
+// Caller holds m_lock. A task that times out on a connection may still be computed; its
+// result is dropped when it arrives.
+void MatrixClient::ExpireOverdue(Clock::time_point now, Finished& finished) {
+    auto expire = [&](RequestPtr request) {
+        MatrixResult result;
+        FailRequest(result, REQUEST_TIMEOUT);
+        result.attempts = request->attempts;
+        finished.emplace_back(std::move(request), std::move(result));
+    };
+    for (auto& connection : m_connections) {
+        for (auto it = connection->inFlight.begin(); it != connection->inFlight.end();) {
+            if (it->second->deadline <= now) {
+                expire(std::move(it->second));
+                it = connection->inFlight.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    for (auto it = m_waiting.begin(); it != m_waiting.end();) {
+        if ((*it)->deadline <= now) {
+            expire(std::move(*it));
+            it = m_waiting.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void MatrixClient::Receive(PooledConnection& connection, Finished& finished) {
+    SocketHandle socket;
+    {
+        std::lock_guard<std::mutex> sendLock(connection.sendLock);
+        socket = connection.socket;
+    }
+    // Only the I/O thread closes the socket outside Close, so the handle stays valid.
+    if (socket == INVALID_SOCKET) return;
+    while (true) {
+        size_t remaining = 0;
+        uint8_t* target = connection.reader.PayloadTarget(remaining);
+        int received;
+        if (target != nullptr && remaining >= DIRECT_RECEIVE_THRESHOLD) {
+            int chunk = static_cast<int>(std::min<size_t>(remaining, size_t(1) << 30));
+            received = recv(socket, reinterpret_cast<char*>(target), chunk, 0);
+            if (received > 0) connection.reader.CommitPayload(received);
+        }
+        else {
+            received = recv(socket, m_buffer.data(), static_cast<int>(m_buffer.size()), 0);
+            if (received > 0) connection.reader.Feed(m_buffer.data(), received);
+        }
+        if (received == 0 || (received < 0 && !WouldBlock()) || connection.reader.Failed()) {
+            Fail(connection, finished);
+            return;
+        }
+        if (received < 0) break;
+    }
+
+    Frame frame;
+    while (connection.reader.Next(frame)) {
+        OnFrame(connection, frame, finished);
+    }
+}
+
+void MatrixClient::OnFrame(PooledConnection& connection, Frame& frame, Finished& finished) {
+    const FrameHeader& header = frame.header;
+    if (header.opcode != OP_RESULT_REPLY && header.opcode != OP_ERROR) return; // OP_HELLO_REPLY
+    RequestPtr request;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = connection.inFlight.find(header.taskId);
+        if (it == connection.inFlight.end()) return; // timed out already
+        request = std::move(it->second);
+        connection.inFlight.erase(it);
+    }
+
+    MatrixResult result;
+    result.attempts = request->attempts;
+    result.status = header.status;
+    if (header.opcode == OP_ERROR) {
+        if (header.status == STATUS_BUSY) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            Retry(std::move(request), header.status, REQUEST_REJECTED, Clock::now(), finished);
+            return;
+        }
+        FailRequest(result, REQUEST_REJECTED, header.status);
+        finished.emplace_back(std::move(request), std::move(result));
+        return;
+    }
+
+    size_t count = static_cast<size_t>(request->rows) * request->cols;
+    result.matrix.rows = header.rows;
+    result.matrix.cols = header.cols;
+    result.matrix.values.resize(count);
+    bool valid = header.status == STATUS_COMPLETED && header.rows == request->rows && header.cols == request->cols;
+    uint8_t* values = reinterpret_cast<uint8_t*>(result.matrix.values.data());
+    if (valid && header.codec != CODEC_NONE) {
+        valid = DecodePayload(header.codec, frame.payload.data(), frame.payload.size(), values, count);
+    }
+    else if (valid) {
+        valid = frame.payload.size() == count * sizeof(int32_t);
+        if (valid) std::copy(frame.payload.data(), frame.payload.data() + frame.payload.size(), values);
+    }
+    if (valid) {
+        SwapInt32LEInPlace(result.matrix.values.data(), count);
+    }
+    else {
+        result.matrix = Matrix();
+        FailRequest(result, REQUEST_REJECTED, STATUS_BAD_REQUEST);
+    }
+    finished.emplace_back(std::move(request), std::move(result));
+}
+
+// Schedules another attempt with exponential backoff, or finishes the task with `error`
+// when it is out of attempts or time. Caller holds m_lock.
+void MatrixClient::Retry(RequestPtr request, uint32_t status, RequestError error, Clock::time_point now, Finished& finished) {
+    uint32_t retries = request->attempts - 1;
+    Clock::time_point at = now + m_config.retryBackoff * (int64_t(1) << std::min<uint32_t>(retries, 16));
+    if (retries >= m_config.maxRetries || at >= request->deadline || !m_running) {
+        MatrixResult result;
+        FailRequest(result, error, status);
+        result.attempts = request->attempts;
+        finished.emplace_back(std::move(request), std::move(result));
+        return;
+    }
+    m_retries.emplace_back(at, std::move(request));
+}
+
+// Drops the connection; its tasks go to other connections, or wait for it to come back.
+void MatrixClient::Fail(PooledConnection& connection, Finished& finished) {
+    {
+        std::lock_guard<std::mutex> sendLock(connection.sendLock);
+        if (connection.socket == INVALID_SOCKET) return;
+        CloseSocket(connection.socket);
+        connection.socket = INVALID_SOCKET;
+        connection.sendQueue.clear();
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    connection.connected = false;
+    connection.reconnectAt = Clock::now() + m_config.reconnectDelay;
+    Clock::time_point now = Clock::now();
+    for (auto& [taskId, request] : connection.inFlight) {
+        Retry(std::move(request), 0, REQUEST_CONNECTION_LOST, now, finished);
+    }
+    connection.inFlight.clear();
+}
+
+// Runs completions outside the locks: a callback may submit again.
+void MatrixClient::Deliver(Finished& finished) {
+    for (auto& [request, result] : finished) {
+        request->done(std::move(result));
+    }
+    finished.clear();
+}
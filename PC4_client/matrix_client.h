@@ -0,0 +1,153 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../PC4/client_socket.h"
+#include "../PC4/codec.h"
+#include "../PC4/protocol.h"
+
+// Asynchronous client library for PC4_server. Tasks are spread over a pool of
+// connections and pipelined on each of them (FLAG_PUSH_RESULT, so a result comes back
+// without being asked for). One I/O thread polls all the connections, retries tasks the
+// server turned away as busy or lost with a dropped connection, and fails tasks that
+// outlive their deadline.
+//
+// Every Submit finishes exactly once, through one of:
+//  - a std::future<MatrixResult>;
+//  - a callback, run on the I/O thread: it must not block, and must not wait for
+//    another task of the same client;
+//  - a CompletionQueue the caller drains from threads of its own.
+// On Windows the caller runs WSAStartup before connecting.
+
+struct Matrix {
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    std::vector<int32_t> values; // row-major, rows * cols
+};
+
+enum RequestError {
+    REQUEST_OK,
+    REQUEST_INVALID,         // shapes differ, empty or too large; never sent
+    REQUEST_REJECTED,        // the server answered with an error, see `status`
+    REQUEST_TIMEOUT,         // no result before the deadline
+    REQUEST_CONNECTION_LOST, // every attempt went down with its connection
+    REQUEST_CANCELLED,       // the client was closed first
+};
+
+struct MatrixResult {
+    RequestError error = REQUEST_OK;
+    uint32_t status = 0;    // server status: STATUS_COMPLETED, or the error's STATUS_*
+    uint32_t attempts = 0;  // times the task was sent
+    Matrix matrix;          // A - B when error is REQUEST_OK
+
+    bool Ok() const { return error == REQUEST_OK; }
+};
+
+const char* RequestErrorName(RequestError error);
+
+// Results of Submit calls that name this queue, in completion order, each with the tag
+// it was submitted with.
+class CompletionQueue {
+public:
+    struct Completion {
+        uint64_t tag = 0;
+        MatrixResult result;
+    };
+
+    // Waits up to `wait` for the next completion; false when there was none.
+    bool Next(Completion& completion, std::chrono::milliseconds wait);
+    bool TryNext(Completion& completion) { return Next(completion, std::chrono::milliseconds::zero()); }
+    void Push(uint64_t tag, MatrixResult result);
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_ready;
+    std::deque<Completion> m_completions;
+};
+
+class MatrixClient {
+public:
+    struct Config {
+        std::string host = "127.0.0.1";
+        uint16_t port = 27015;
+        size_t connections = 4;
+        // Tasks pipelined per connection; more wait in the client. The server accepts
+        // at most 256 unfinished tasks per connection.
+        size_t maxInFlight = 64;
+        // Default deadline of a task, from Submit to its result, retries included.
+        std::chrono::milliseconds timeout{ 10000 };
+        // Sends after the first one, for STATUS_BUSY and dropped connections. A task
+        // is not resent once the deadline has passed.
+        uint32_t maxRetries = 3;
+        // Wait before the first retry, doubled for every further one.
+        std::chrono::milliseconds retryBackoff{ 10 };
+        // A dropped connection is reopened no sooner than this.
+        std::chrono::milliseconds reconnectDelay{ 200 };
+        // Codec of the matrices both ways, agreed on with OP_HELLO on every connection.
+        uint8_t codec = CODEC_NONE;
+    };
+
+    using Callback = std::function<void(MatrixResult&&)>;
+
+    explicit MatrixClient(Config config);
+    // Closes the client; unfinished tasks end with REQUEST_CANCELLED.
+    ~MatrixClient();
+    MatrixClient(const MatrixClient&) = delete;
+    MatrixClient& operator=(const MatrixClient&) = delete;
+
+    // Opens the pool and starts the I/O thread. False when not even one connection
+    // could be made; connections that failed are retried in the background.
+    bool Connect();
+    void Close();
+
+    // A - B on the server. `timeout` of zero means Config::timeout.
+    std::future<MatrixResult> Submit(Matrix a, Matrix b, std::chrono::milliseconds timeout = {});
+    void Submit(Matrix a, Matrix b, Callback done, std::chrono::milliseconds timeout = {});
+    void Submit(Matrix a, Matrix b, CompletionQueue& queue, uint64_t tag, std::chrono::milliseconds timeout = {});
+
+    size_t ConnectedCount() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Request;
+    struct PooledConnection;
+    using RequestPtr = std::shared_ptr<Request>;
+    using Finished = std::vector<std::pair<RequestPtr, MatrixResult>>;
+
+    void Enqueue(RequestPtr request);
+    PooledConnection* PickConnection();
+    void Dispatch(PooledConnection& connection, const RequestPtr& request);
+    bool SendPending(PooledConnection& connection);
+    void Run();
+    void Reconnect(Clock::time_point now);
+    void ResendDue(Clock::time_point now, Finished& finished);
+    void ExpireOverdue(Clock::time_point now, Finished& finished);
+    void Receive(PooledConnection& connection, Finished& finished);
+    void OnFrame(PooledConnection& connection, Frame& frame, Finished& finished);
+    void Retry(RequestPtr request, uint32_t status, RequestError error, Clock::time_point now, Finished& finished);
+    void Fail(PooledConnection& connection, Finished& finished);
+    bool Open(PooledConnection& connection);
+    void Deliver(Finished& finished);
+
+    Config m_config;
+    std::vector<std::unique_ptr<PooledConnection>> m_connections;
+    SocketHandle m_wake = INVALID_SOCKET;
+    std::thread m_thread;
+    std::vector<char> m_buffer; // receive buffer of the I/O thread
+
+    // Guards everything below and each connection's task table. Taken after a
+    // connection's sendLock, never before it.
+    mutable std::mutex m_lock;
+    bool m_running = false;
+    std::deque<RequestPtr> m_waiting;             // no connection had room
+    std::vector<std::pair<Clock::time_point, RequestPtr>> m_retries; // resend at
+    size_t m_nextConnection = 0;
+};
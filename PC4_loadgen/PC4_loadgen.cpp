@@ -0,0 +1,128 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "load_generator.h"
+
+void PrintUsage() {
+    std::cerr <<
+        "Usage: PC4_loadgen [options]\n"
+        "  --host HOST           server address (127.0.0.1)\n"
+        "  --port PORT           server port (27015)\n"
+        "  --connections N       connections to open (16)\n"
+        "  --threads N           generator threads, 0 for one per core (0)\n"
+        "  --duration SECONDS    measured run time (10)\n"
+        "  --warmup SECONDS      unrecorded run time before it (2)\n"
+        "  --drain SECONDS       wait for answers after it (5)\n"
+        "  --closed DEPTH        closed loop, DEPTH tasks in flight per connection (default, 1)\n"
+        "  --rate RPS            open loop, RPS tasks per second over all connections\n"
+        "  --sizes MIX           matrix sizes and weights, e.g. 3:90,100:9,1000:1\n"
+        "  --push                have results pushed instead of fetched after OP_COMPLETED\n"
+        "  --reuse               send identical inputs, so the server's result cache answers\n"
+        "  --format json|csv     report format (json)\n"
+        "  --output FILE         write the report there instead of stdout\n";
+}
+
+// Returns the value after a flag, or nullptr (after complaining) when there is none.
+const char* FlagValue(int argc, char* argv[], int& index) {
+    if (index + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[index] << std::endl;
+        return nullptr;
+    }
+    return argv[++index];
+}
+
+bool ParseArguments(int argc, char* argv[], LoadOptions& options, std::string& format, std::string& outputPath) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--push") {
+                options.push = true;
+                continue;
+            }
+            if (flag == "--reuse") {
+                options.unique = false;
+                continue;
+            }
+            const char* value = FlagValue(argc, argv, i);
+            if (value == nullptr) return false;
+            if (flag == "--host") options.host = value;
+            else if (flag == "--port") options.port = static_cast<uint16_t>(std::stoul(value));
+            else if (flag == "--connections") options.connections = std::stoul(value);
+            else if (flag == "--threads") options.threads = std::stoul(value);
+            else if (flag == "--duration") options.durationSeconds = std::stod(value);
+            else if (flag == "--warmup") options.warmupSeconds = std::stod(value);
+            else if (flag == "--drain") options.drainSeconds = std::stod(value);
+            else if (flag == "--closed") {
+                options.openLoop = false;
+                options.depth = std::stoul(value);
+            }
+            else if (flag == "--rate") {
+                options.openLoop = true;
+                options.rate = std::stod(value);
+            }
+            else if (flag == "--sizes") {
+                if (!ParseSizeMix(value, options.sizes)) {
+                    std::cerr << "Invalid size mix: " << value << std::endl;
+                    return false;
+                }
+            }
+            else if (flag == "--format") format = value;
+            else if (flag == "--output") outputPath = value;
+            else {
+                std::cerr << "Unknown option: " << flag << std::endl;
+                return false;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        std::cerr << "Invalid numeric option value." << std::endl;
+        return false;
+    }
+    if (format != "json" && format != "csv") {
+        std::cerr << "Unknown format: " << format << std::endl;
+        return false;
+    }
+    if (options.connections == 0 || options.depth == 0 || options.depth > options.maxInFlight || options.rate <= 0 || options.durationSeconds <= 0) {
+        std::cerr << "Connections, depth (at most " << options.maxInFlight << "), rate and duration must be positive." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    std::string format = "json";
+    std::string outputPath;
+    if (!ParseArguments(argc, argv, options, format, outputPath)) {
+        PrintUsage();
+        return 2;
+    }
+
+    LoadReport report = RunLoad(options);
+    if (report.connectFailures == options.connections) {
+        std::cerr << "Could not connect to " << options.host << ":" << options.port << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath);
+        if (!file) {
+            std::cerr << "Cannot write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = outputPath.empty() ? std::cout : file;
+    if (format == "csv") {
+        WriteReportCsv(options, report, out);
+    }
+    else {
+        WriteReportJson(options, report, out);
+    }
+    // Short human summary on stderr, so stdout stays machine-readable.
+    std::cerr << report.results / report.measuredSeconds << " tasks/s, p50 " << report.result.percentile(50) / 1000.0
+        << " us, p99 " << report.result.percentile(99) / 1000.0 << " us, p99.9 " << report.result.percentile(99.9) / 1000.0
+        << " us; busy " << report.busy << ", errors " << report.errors << ", timed out " << report.timedOut << std::endl;
+    return 0;
+}
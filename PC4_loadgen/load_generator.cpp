@@ -0,0 +1,560 @@
+#include "load_generator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "../PC4/client_socket.h"
+#include "../PC4/protocol.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t RECEIVE_BUFFER_SIZE = 65536;
+// Payload remainders at least this large are received in place, not through the buffer.
+constexpr size_t DIRECT_RECEIVE_THRESHOLD = 16384;
+constexpr int POLL_INTERVAL_MS = 10;
+const double REPORTED_PERCENTILES[] = { 50, 90, 99, 99.9, 99.99 };
+
+// One input per size: A then B in wire order, shared by every task of that size. A
+// task only differs in its first element, sent from the frame's own head.
+struct PayloadTemplate {
+    uint32_t size;
+    std::shared_ptr<const std::vector<uint8_t>> payload;
+    int32_t firstA;
+    int32_t firstB;
+};
+
+struct PendingTask {
+    Clock::time_point start;
+    uint32_t sizeIndex;
+    int32_t firstA;
+    bool measured;
+    bool completed = false;
+};
+
+struct OutgoingTask {
+    OutgoingFrame frame;
+    size_t sent = 0;
+};
+
+// An open-loop arrival that found its connection at the in-flight limit.
+struct Arrival {
+    Clock::time_point start;
+    uint32_t sizeIndex;
+};
+
+struct LoadConnection {
+    SocketHandle socket = INVALID_SOCKET;
+    FrameReader reader;
+    std::deque<OutgoingTask> sendQueue;
+    std::unordered_map<uint32_t, PendingTask> inFlight;
+    std::deque<Arrival> backlog;
+    uint32_t nextTaskId = 1;
+    bool broken = false;
+};
+
+void MergeReport(LoadReport& into, const LoadReport& from) {
+    into.requests += from.requests;
+    into.completed += from.completed;
+    into.results += from.results;
+    into.busy += from.busy;
+    into.errors += from.errors;
+    into.timedOut += from.timedOut;
+    into.bytesSent += from.bytesSent;
+    into.bytesReceived += from.bytesReceived;
+    into.connectFailures += from.connectFailures;
+    into.completion.merge(from.completion);
+    into.result.merge(from.result);
+    for (size_t i = 0; i < into.bySize.size(); i++) {
+        into.bySize[i].requests += from.bySize[i].requests;
+        into.bySize[i].result.merge(from.bySize[i].result);
+    }
+}
+
+class LoadWorker {
+public:
+    LoadWorker(const LoadOptions& options, const std::vector<PayloadTemplate>& templates, size_t index)
+        : m_options(options), m_templates(templates), m_random(0x9E3779B97F4A7C15ULL * (index + 1)), m_buffer(RECEIVE_BUFFER_SIZE) {
+        std::vector<double> weights;
+        for (const SizeWeight& size : options.sizes) {
+            weights.push_back(size.weight);
+            m_report.bySize.emplace_back().size = size.size;
+        }
+        m_sizePicker = std::discrete_distribution<uint32_t>(weights.begin(), weights.end());
+        // Workers stamp from disjoint ranges, so inputs stay distinct across connections.
+        m_sequence = static_cast<uint32_t>(index) << 24;
+    }
+
+    void AddConnection(SocketHandle socket) {
+        m_connections.emplace_back(std::make_unique<LoadConnection>());
+        m_connections.back()->socket = socket;
+    }
+
+    void Run(double rate, Clock::time_point measureFrom, Clock::time_point stopAt, Clock::time_point drainUntil);
+
+    const LoadReport& Report() const { return m_report; }
+
+private:
+    void Submit(LoadConnection& connection, uint32_t sizeIndex, Clock::time_point start);
+    bool Measured(Clock::time_point start) const { return start >= m_measureFrom && start < m_stopAt; }
+    void Flush(LoadConnection& connection);
+    void Receive(LoadConnection& connection);
+    void OnFrame(LoadConnection& connection, const Frame& frame);
+    bool ResultMatches(const PendingTask& task, const Frame& frame) const;
+    void Break(LoadConnection& connection);
+    bool Idle() const;
+
+    const LoadOptions& m_options;
+    const std::vector<PayloadTemplate>& m_templates;
+    std::vector<std::unique_ptr<LoadConnection>> m_connections;
+    std::mt19937_64 m_random;
+    std::discrete_distribution<uint32_t> m_sizePicker;
+    std::vector<char> m_buffer;
+    uint32_t m_sequence;
+    // Tasks scheduled in [m_measureFrom, m_stopAt) are recorded.
+    Clock::time_point m_measureFrom;
+    Clock::time_point m_stopAt;
+    LoadReport m_report;
+};
+
+void LoadWorker::Run(double rate, Clock::time_point measureFrom, Clock::time_point stopAt, Clock::time_point drainUntil) {
+    m_measureFrom = measureFrom;
+    m_stopAt = stopAt;
+    std::exponential_distribution<double> gap(rate > 0 ? rate : 1);
+    Clock::time_point nextArrival = Clock::now();
+    size_t arrivalTarget = 0;
+    std::vector<pollfd> fds;
+    std::vector<LoadConnection*> polled;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        bool issuing = now < stopAt;
+        if (!issuing && (Idle() || now >= drainUntil)) break;
+
+        if (issuing && m_options.openLoop && !m_connections.empty()) {
+            while (nextArrival <= now) {
+                LoadConnection& target = *m_connections[arrivalTarget++ % m_connections.size()];
+                target.backlog.push_back(Arrival{ nextArrival, m_sizePicker(m_random) });
+                nextArrival += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(m_random)));
+            }
+        }
+        for (auto& connection : m_connections) {
+            if (connection->broken) continue;
+            if (m_options.openLoop) {
+                while (!connection->broken && !connection->backlog.empty() && connection->inFlight.size() < m_options.maxInFlight) {
+                    Arrival arrival = connection->backlog.front();
+                    connection->backlog.pop_front();
+                    Submit(*connection, arrival.sizeIndex, arrival.start);
+                }
+            }
+            else if (issuing) {
+                while (!connection->broken && connection->inFlight.size() < m_options.depth) {
+                    Submit(*connection, m_sizePicker(m_random), now);
+                }
+            }
+        }
+
+        fds.clear();
+        polled.clear();
+        for (auto& connection : m_connections) {
+            if (connection->broken) continue;
+            pollfd entry{};
+            entry.fd = connection->socket;
+            entry.events = POLLIN;
+            if (!connection->sendQueue.empty()) entry.events |= POLLOUT;
+            fds.push_back(entry);
+            polled.push_back(connection.get());
+        }
+        if (fds.empty()) break;
+
+        int timeoutMs = POLL_INTERVAL_MS;
+        if (issuing && m_options.openLoop) {
+            auto untilArrival = std::chrono::duration_cast<std::chrono::milliseconds>(nextArrival - Clock::now()).count();
+            timeoutMs = static_cast<int>(std::clamp<long long>(untilArrival, 0, POLL_INTERVAL_MS));
+        }
+        if (PollSockets(fds.data(), fds.size(), timeoutMs) <= 0) continue;
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                Receive(*polled[i]);
+            }
+            if (!polled[i]->broken && (fds[i].revents & POLLOUT)) {
+                Flush(*polled[i]);
+            }
+        }
+    }
+
+    for (auto& connection : m_connections) {
+        for (auto& [taskId, task] : connection->inFlight) {
+            if (task.measured) m_report.timedOut++;
+        }
+        for (const Arrival& arrival : connection->backlog) {
+            if (Measured(arrival.start)) {
+                m_report.requests++;
+                m_report.timedOut++;
+            }
+        }
+        if (connection->socket != INVALID_SOCKET) {
+            CloseSocket(connection->socket);
+        }
+    }
+}
+
+void LoadWorker::Submit(LoadConnection& connection, uint32_t sizeIndex, Clock::time_point start) {
+    const PayloadTemplate& input = m_templates[sizeIndex];
+    uint32_t taskId = connection.nextTaskId++;
+    if (connection.nextTaskId == 0) connection.nextTaskId = 1;
+
+    PendingTask task{ start, sizeIndex, input.firstA, Measured(start) };
+    if (m_options.unique) {
+        task.firstA = static_cast<int32_t>(m_sequence++ & 0x7fffffff);
+    }
+
+    FrameHeader header;
+    header.opcode = OP_PROCESS;
+    header.dtype = DTYPE_INT32;
+    header.flags = m_options.push ? FLAG_PUSH_RESULT : 0;
+    header.taskId = taskId;
+    header.rows = input.size;
+    header.cols = input.size;
+    header.payloadLength = input.payload->size();
+
+    OutgoingTask outgoing;
+    outgoing.frame.head.resize(FRAME_HEADER_SIZE + sizeof(int32_t));
+    EncodeHeader(header, outgoing.frame.head.data());
+    WriteInt32LE(&task.firstA, 1, outgoing.frame.head.data() + FRAME_HEADER_SIZE);
+    outgoing.frame.owner = input.payload;
+    outgoing.frame.body = input.payload->data() + sizeof(int32_t);
+    outgoing.frame.bodyLength = input.payload->size() - sizeof(int32_t);
+
+    if (task.measured) {
+        m_report.requests++;
+        m_report.bySize[sizeIndex].requests++;
+    }
+    connection.inFlight[taskId] = task;
+    connection.sendQueue.push_back(std::move(outgoing));
+    if (connection.sendQueue.size() == 1) {
+        Flush(connection);
+    }
+}
+
+void LoadWorker::Flush(LoadConnection& connection) {
+    while (!connection.sendQueue.empty()) {
+        OutgoingTask& outgoing = connection.sendQueue.front();
+        const OutgoingFrame& frame = outgoing.frame;
+        const uint8_t* data;
+        size_t left;
+        if (outgoing.sent < frame.head.size()) {
+            data = frame.head.data() + outgoing.sent;
+            left = frame.head.size() - outgoing.sent;
+        }
+        else {
+            size_t offset = outgoing.sent - frame.head.size();
+            data = frame.body + offset;
+            left = frame.bodyLength - offset;
+        }
+        int chunk = static_cast<int>(std::min<size_t>(left, size_t(1) << 30));
+        int sent = send(connection.socket, reinterpret_cast<const char*>(data), chunk, SEND_FLAGS);
+        if (sent < 0) {
+            if (!WouldBlock()) Break(connection);
+            return;
+        }
+        outgoing.sent += sent;
+        m_report.bytesSent += sent;
+        if (outgoing.sent == frame.Size()) {
+            connection.sendQueue.pop_front();
+        }
+    }
+}
+
+void LoadWorker::Receive(LoadConnection& connection) {
+    while (!connection.broken) {
+        size_t remaining = 0;
+        uint8_t* target = connection.reader.PayloadTarget(remaining);
+        int received;
+        if (target != nullptr && remaining >= DIRECT_RECEIVE_THRESHOLD) {
+            int chunk = static_cast<int>(std::min<size_t>(remaining, size_t(1) << 30));
+            received = recv(connection.socket, reinterpret_cast<char*>(target), chunk, 0);
+            if (received > 0) connection.reader.CommitPayload(received);
+        }
+        else {
+            received = recv(connection.socket, m_buffer.data(), static_cast<int>(m_buffer.size()), 0);
+            if (received > 0) connection.reader.Feed(m_buffer.data(), received);
+        }
+        if (received == 0 || (received < 0 && !WouldBlock()) || connection.reader.Failed()) {
+            Break(connection);
+            return;
+        }
+        if (received < 0) break;
+        m_report.bytesReceived += received;
+    }
+
+    Frame frame;
+    while (connection.reader.Next(frame)) {
+        OnFrame(connection, frame);
+    }
+}
+
+void LoadWorker::OnFrame(LoadConnection& connection, const Frame& frame) {
+    const FrameHeader& header = frame.header;
+    auto it = connection.inFlight.find(header.taskId);
+    if (it == connection.inFlight.end()) return;
+    PendingTask& task = it->second;
+    uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - task.start).count());
+
+    if (header.opcode == OP_COMPLETED && !task.completed) {
+        task.completed = true;
+        if (task.measured) {
+            m_report.completed++;
+            m_report.completion.record(elapsed);
+        }
+        FrameHeader fetch;
+        fetch.opcode = OP_RESULT;
+        fetch.taskId = header.taskId;
+        OutgoingTask outgoing;
+        outgoing.frame.head = BuildFrame(fetch);
+        connection.sendQueue.push_back(std::move(outgoing));
+        if (connection.sendQueue.size() == 1) {
+            Flush(connection);
+        }
+        return;
+    }
+
+    if (task.measured) {
+        if (header.opcode == OP_RESULT_REPLY && ResultMatches(task, frame)) {
+            if (!task.completed) {
+                m_report.completed++;
+                m_report.completion.record(elapsed);
+            }
+            m_report.results++;
+            m_report.result.record(elapsed);
+            m_report.bySize[task.sizeIndex].result.record(elapsed);
+        }
+        else if (header.opcode == OP_ERROR && header.status == STATUS_BUSY) {
+            m_report.busy++;
+        }
+        else {
+            m_report.errors++;
+        }
+    }
+    connection.inFlight.erase(it);
+}
+
+// Shape, length, and the one element that differs between tasks: A[0] - B[0].
+bool LoadWorker::ResultMatches(const PendingTask& task, const Frame& frame) const {
+    const PayloadTemplate& input = m_templates[task.sizeIndex];
+    const FrameHeader& header = frame.header;
+    uint64_t expectedLength = static_cast<uint64_t>(input.size) * input.size * sizeof(int32_t);
+    if (header.status != STATUS_COMPLETED || header.rows != input.size || header.cols != input.size) return false;
+    if (header.payloadLength != expectedLength || frame.payload.size() != expectedLength) return false;
+    int first;
+    ReadInt32LE(frame.payload.data(), 1, &first);
+    return first == task.firstA - input.firstB;
+}
+
+void LoadWorker::Break(LoadConnection& connection) {
+    connection.broken = true;
+    for (auto& [taskId, task] : connection.inFlight) {
+        if (task.measured) m_report.errors++;
+    }
+    connection.inFlight.clear();
+    connection.sendQueue.clear();
+    // Arrivals still waiting for this connection will never be sent.
+    m_report.errors += std::count_if(connection.backlog.begin(), connection.backlog.end(),
+        [this](const Arrival& arrival) { return Measured(arrival.start); });
+    connection.backlog.clear();
+}
+
+bool LoadWorker::Idle() const {
+    for (const auto& connection : m_connections) {
+        if (!connection->broken && (!connection->inFlight.empty() || !connection->backlog.empty())) return false;
+    }
+    return true;
+}
+
+std::vector<PayloadTemplate> BuildTemplates(const std::vector<SizeWeight>& sizes) {
+    std::mt19937 random(12345);
+    std::uniform_int_distribution<int> value(0, 99);
+    std::vector<PayloadTemplate> templates;
+    for (const SizeWeight& size : sizes) {
+        size_t count = static_cast<size_t>(size.size) * size.size;
+        std::vector<int> values(2 * count);
+        for (int& element : values) element = value(random);
+        auto payload = std::make_shared<std::vector<uint8_t>>(values.size() * sizeof(int32_t));
+        WriteInt32LE(values.data(), values.size(), payload->data());
+        templates.push_back(PayloadTemplate{ size.size, std::move(payload), values[0], values[count] });
+    }
+    return templates;
+}
+
+void WriteHistogramJson(const char* name, const latency_histogram& histogram, std::ostream& out) {
+    out << "\"" << name << "\":{\"count\":" << histogram.count() << ",\"mean_us\":" << histogram.mean() / 1000.0;
+    for (double percent : REPORTED_PERCENTILES) {
+        std::string label = std::to_string(percent);
+        label.erase(label.find_last_not_of('0') + 1);
+        if (label.back() == '.') label.pop_back();
+        std::replace(label.begin(), label.end(), '.', '_');
+        out << ",\"p" << label << "_us\":" << histogram.percentile(percent) / 1000.0;
+    }
+    out << ",\"max_us\":" << histogram.max() / 1000.0 << "}";
+}
+
+std::string SizeMixText(const std::vector<SizeWeight>& sizes) {
+    std::ostringstream text;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        text << (i ? "," : "") << sizes[i].size << ":" << sizes[i].weight;
+    }
+    return text.str();
+}
+
+}
+
+bool ParseSizeMix(const std::string& text, std::vector<SizeWeight>& sizes) {
+    std::vector<SizeWeight> parsed;
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        SizeWeight entry{ 0, 1 };
+        size_t colon = item.find(':');
+        try {
+            size_t used = 0;
+            unsigned long size = std::stoul(item.substr(0, colon), &used);
+            if (used != (colon == std::string::npos ? item.size() : colon)) return false;
+            entry.size = static_cast<uint32_t>(size);
+            if (colon != std::string::npos) {
+                entry.weight = static_cast<uint32_t>(std::stoul(item.substr(colon + 1), &used));
+                if (used != item.size() - colon - 1) return false;
+            }
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        uint64_t payloadLength = uint64_t(2) * entry.size * entry.size * sizeof(int32_t);
+        if (entry.size == 0 || entry.weight == 0 || payloadLength > MAX_PAYLOAD_SIZE) return false;
+        parsed.push_back(entry);
+    }
+    if (parsed.empty()) return false;
+    sizes = std::move(parsed);
+    return true;
+}
+
+LoadReport RunLoad(const LoadOptions& options) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    std::vector<PayloadTemplate> templates = BuildTemplates(options.sizes);
+    size_t threadsAmount = options.threads;
+    if (threadsAmount == 0) {
+        threadsAmount = std::min<size_t>(options.connections, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    threadsAmount = std::max<size_t>(threadsAmount, 1);
+
+    LoadReport report;
+    for (const SizeWeight& size : options.sizes) {
+        report.bySize.emplace_back().size = size.size;
+    }
+
+    std::vector<std::unique_ptr<LoadWorker>> workers;
+    for (size_t i = 0; i < threadsAmount; i++) {
+        workers.push_back(std::make_unique<LoadWorker>(options, templates, i));
+    }
+    // Connect everything up front so connection setup is not part of the measurement.
+    for (size_t i = 0; i < options.connections; i++) {
+        SocketHandle socket = ConnectTcp(options.host, options.port);
+        if (socket == INVALID_SOCKET) {
+            report.connectFailures++;
+            continue;
+        }
+        workers[i % threadsAmount]->AddConnection(socket);
+    }
+
+    auto toDuration = [](double seconds) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)); };
+    Clock::time_point measureFrom = Clock::now() + toDuration(options.warmupSeconds);
+    Clock::time_point stopAt = measureFrom + toDuration(options.durationSeconds);
+    Clock::time_point drainUntil = stopAt + toDuration(options.drainSeconds);
+    double workerRate = options.rate / threadsAmount;
+
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker, workerRate, measureFrom, stopAt, drainUntil]() {
+            worker->Run(workerRate, measureFrom, stopAt, drainUntil);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& worker : workers) {
+        MergeReport(report, worker->Report());
+    }
+    report.measuredSeconds = options.durationSeconds;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return report;
+}
+
+void WriteReportJson(const LoadOptions& options, const LoadReport& report, std::ostream& out) {
+    double seconds = report.measuredSeconds > 0 ? report.measuredSeconds : 1;
+    out << std::setprecision(6);
+    out << "{\"mode\":\"" << (options.openLoop ? "open" : "closed") << "\"";
+    if (options.openLoop) {
+        out << ",\"rate\":" << options.rate;
+    }
+    else {
+        out << ",\"depth\":" << options.depth;
+    }
+    out << ",\"connections\":" << options.connections << ",\"push\":" << (options.push ? "true" : "false")
+        << ",\"unique\":" << (options.unique ? "true" : "false") << ",\"sizes\":\"" << SizeMixText(options.sizes) << "\""
+        << ",\"duration_s\":" << report.measuredSeconds << ",\"requests\":" << report.requests
+        << ",\"completed\":" << report.completed << ",\"results\":" << report.results << ",\"busy\":" << report.busy
+        << ",\"errors\":" << report.errors << ",\"timed_out\":" << report.timedOut
+        << ",\"connect_failures\":" << report.connectFailures
+        << ",\"throughput_rps\":" << report.results / seconds
+        << ",\"sent_mb_per_s\":" << report.bytesSent / seconds / (1 << 20)
+        << ",\"received_mb_per_s\":" << report.bytesReceived / seconds / (1 << 20) << ",";
+    WriteHistogramJson("completion", report.completion, out);
+    out << ",";
+    WriteHistogramJson("result", report.result, out);
+    out << ",\"by_size\":[";
+    for (size_t i = 0; i < report.bySize.size(); i++) {
+        const SizeReport& size = report.bySize[i];
+        out << (i ? "," : "") << "{\"size\":" << size.size << ",\"requests\":" << size.requests << ",";
+        WriteHistogramJson("result", size.result, out);
+        out << "}";
+    }
+    out << "]}" << std::endl;
+}
+
+void WriteReportCsv(const LoadOptions& options, const LoadReport& report, std::ostream& out) {
+    double seconds = report.measuredSeconds > 0 ? report.measuredSeconds : 1;
+    out << std::setprecision(6);
+    out << "Series,Size,Mode,Connections,Requests,Answered,Busy,Errors,Timed out,Throughput rps,Count,Mean us";
+    for (double percent : REPORTED_PERCENTILES) {
+        out << ",p" << percent << " us";
+    }
+    out << ",Max us\n";
+
+    auto row = [&](const char* series, uint32_t size, uint64_t requests, uint64_t answered, const latency_histogram& histogram) {
+        out << series << "," << size << "," << (options.openLoop ? "open" : "closed") << "," << options.connections << ","
+            << requests << "," << answered << "," << report.busy << "," << report.errors << "," << report.timedOut << ","
+            << answered / seconds << "," << histogram.count() << "," << histogram.mean() / 1000.0;
+        for (double percent : REPORTED_PERCENTILES) {
+            out << "," << histogram.percentile(percent) / 1000.0;
+        }
+        out << "," << histogram.max() / 1000.0 << "\n";
+    };
+    row("completion", 0, report.requests, report.completed, report.completion);
+    row("result", 0, report.requests, report.results, report.result);
+    for (const SizeReport& size : report.bySize) {
+        row("result", size.size, size.requests, size.result.count(), size.result);
+    }
+    out.flush();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "../common/latency_histogram.h"
+
+// Load generator for PC4_server. Worker threads each drive a share of the connections
+// over non-blocking sockets and submit OP_PROCESS tasks of randomly chosen sizes.
+//
+//  - closed loop: every connection keeps `depth` tasks in flight and submits the next
+//    one as soon as one finishes, so the offered load follows the server;
+//  - open loop: tasks arrive at `rate` per second in total (Poisson arrivals) whether
+//    or not the server keeps up. Latency is measured from the scheduled arrival, not
+//    from when the task could actually be sent, so a stalled server shows up in the
+//    tail instead of being hidden by the generator waiting for it.
+//
+// Without `push` a task is submitted plainly, the OP_COMPLETED notification gives the
+// submit->completion latency, and the result is then fetched with OP_RESULT for the
+// submit->result latency. With `push` the result comes back on its own and both
+// latencies are the same sample.
+struct SizeWeight {
+    uint32_t size; // N of an N x N matrix
+    uint32_t weight;
+};
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    uint16_t port = 27015;
+    size_t connections = 16;
+    size_t threads = 0; // 0: min(connections, hardware concurrency)
+    double durationSeconds = 10;
+    double warmupSeconds = 2; // run before measuring, not recorded
+    double drainSeconds = 5; // after the run, for answers still in flight
+    bool openLoop = false;
+    double rate = 1000; // open loop: tasks per second over all connections
+    size_t depth = 1; // closed loop: tasks in flight per connection
+    size_t maxInFlight = 256; // per connection, the server's own limit
+    std::vector<SizeWeight> sizes{ { 3, 90 }, { 100, 9 }, { 1000, 1 } };
+    bool push = false;
+    // Stamp each task's first element with a sequence number, so no two inputs are
+    // equal and the server's result cache is not what gets measured.
+    bool unique = true;
+};
+
+struct SizeReport {
+    uint32_t size = 0;
+    uint64_t requests = 0;
+    latency_histogram result; // nanoseconds
+};
+
+struct LoadReport {
+    double measuredSeconds = 0;
+    uint64_t requests = 0; // submitted in the measured window
+    uint64_t completed = 0;
+    uint64_t results = 0;
+    uint64_t busy = 0; // rejected with STATUS_BUSY
+    uint64_t errors = 0; // any other OP_ERROR, or a result of the wrong shape
+    uint64_t timedOut = 0; // unanswered at the end of the drain
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t connectFailures = 0;
+    latency_histogram completion; // nanoseconds
+    latency_histogram result;
+    std::vector<SizeReport> bySize;
+};
+
+// Parses "3:90,100:9,1000:1" (a bare "500" means weight 1). False on bad input.
+bool ParseSizeMix(const std::string& text, std::vector<SizeWeight>& sizes);
+
+LoadReport RunLoad(const LoadOptions& options);
+
+void WriteReportJson(const LoadOptions& options, const LoadReport& report, std::ostream& out);
+void WriteReportCsv(const LoadOptions& options, const LoadReport& report, std::ostream& out);
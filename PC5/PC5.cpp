@@ -1,76 +1,116 @@
-#include <iostream>
+#ifdef _WIN32
 #include <winsock2.h>
 #include <WS2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#include "file_sender.h"
+#else
+#include "../common/io_ring.h"
+#include "reactor_server.h"
+#include "uring_server.h"
+#endif
+#include <chrono>
+#include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <thread>
-#include <mutex>
-
-#pragma comment(lib, "ws2_32.lib")
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "async_logger.h"
+#include "http_handler.h"
+#include "http_metrics.h"
+#include "http_parser.h"
 
 #define PORT 8080
 
-std::string readFile(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) return "";
-    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-}
-
-bool endsWith(const std::string& str, const std::string& suffix) {
-    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
-}
-
-std::string getContentType(const std::string& path) {
-    if (endsWith(path, ".html")) return "text/html";
-    if (endsWith(path, ".css")) return "text/css";
-    return "text/plain";
-}
+// Idle keep-alive connections, and clients stalling in the middle of a request, are
+// closed after this long.
+#define IDLE_TIMEOUT_MS 5000
+#define RECEIVE_BUFFER_SIZE 16384 // grows only for request bodies larger than this
 
-void sendResponse(SOCKET clientSocket, const std::string& response) {
-    send(clientSocket, response.c_str(), response.size(), 0);
-}
+#ifdef _WIN32
 
-std::mutex mtx;
-void lockedConsoleOutput(std::string str) {
-    std::lock_guard<std::mutex> guard(mtx);
-    std::cout << str << "\n";
+bool waitReadable(SOCKET socket, int timeoutMs) {
+    WSAPOLLFD entry{};
+    entry.fd = socket;
+    entry.events = POLLRDNORM;
+    return WSAPoll(&entry, 1, timeoutMs) > 0;
 }
 
-void handleRequest(SOCKET clientSocket) {
-    char buffer[4096];
-    int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-    if (bytesReceived > 0) {
-        buffer[bytesReceived] = '\0';
-        std::istringstream request(buffer);
-        std::string method, path, version;
-        request >> method >> path >> version;
-
-        std::cout << "Received request: " << method << " " << path << " " << version << std::endl;
-
-        if (method == "GET") {
-            std::string fullPath = (path == "/") ? "./index.html" : "." + path;
-            std::string content = readFile(fullPath);
-            std::string contentType = getContentType(fullPath);
-
-            if (!content.empty()) {
-                std::string httpResponse = "HTTP/1.1 200 OK\r\nContent-Type: " + contentType + "\r\nContent-Length: " + std::to_string(content.size()) + "\r\n\r\n" + content;
-                sendResponse(clientSocket, httpResponse);
+// Thread-per-connection: serves requests on one connection until the client closes
+// it, asks for it to be closed, sends something unparsable or stays silent for
+// IDLE_TIMEOUT_MS. Pipelined requests are answered in order, all that arrived together
+// in one flush.
+void handleConnection(SOCKET clientSocket) {
+    using Clock = std::chrono::steady_clock;
+    const HttpMetrics& metrics = httpMetrics();
+    metrics.connectionsAccepted.add();
+    metrics.connectionsOpen.add();
+    std::vector<char> buffer(RECEIVE_BUFFER_SIZE);
+    size_t filled = 0;
+    RequestParser parser(MAX_REQUEST_BODY);
+    // Compute endpoints are waited for right here, this thread has nothing else to do.
+    ResponseContext context;
+    context.client = static_cast<uint64_t>(clientSocket);
+    HttpRequest request;
+    ResponseWriter writer(clientSocket);
+    bool open = true;
+    // Parse times of the requests answered in this batch, for their timings once flushed.
+    std::vector<Clock::time_point> parsedAt;
+
+    while (open) {
+        size_t offset = 0;
+        size_t consumed = 0;
+        ParseResult result;
+        parsedAt.clear();
+        Clock::time_point started = Clock::now();
+        while ((result = parser.parse(buffer.data() + offset, filled - offset, request, consumed)) == PARSE_COMPLETE) {
+            parsedAt.push_back(Clock::now());
+            metrics.parseTime.record(parsedAt.back() - started);
+            metrics.requests.add();
+            HttpResponse response = respond(request, context);
+            metrics.handleTime.record_since(parsedAt.back());
+            if (response.deferred) {
+                response.deferred->wait();
+                response.resolve();
             }
-            else {
-                std::string httpResponse = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-                sendResponse(clientSocket, httpResponse);
+            writer.write(response);
+            offset += consumed;
+            if (response.close || writer.failed()) {
+                open = false;
+                break;
             }
+            started = Clock::now();
+        }
+        if (result != PARSE_COMPLETE && result != PARSE_INCOMPLETE) {
+            metrics.badRequests.add();
+            writer.write(errorResponse(result));
+            open = false;
+        }
+        Clock::time_point flushStarted = Clock::now();
+        if (!writer.flush() || !open) break;
+        Clock::time_point flushed = Clock::now();
+        for (Clock::time_point parsed : parsedAt) {
+            metrics.sendTime.record(flushed - flushStarted);
+            metrics.requestTime.record(flushed - parsed);
         }
+
+        // Keep the start of the next request, if any, at the front of the buffer.
+        std::memmove(buffer.data(), buffer.data() + offset, filled - offset);
+        filled -= offset;
+        if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+        if (!waitReadable(clientSocket, IDLE_TIMEOUT_MS)) break;
+        int bytesReceived = recv(clientSocket, buffer.data() + filled, static_cast<int>(buffer.size() - filled), 0);
+        if (bytesReceived <= 0) break;
+        metrics.bytesReceived.add(bytesReceived);
+        filled += bytesReceived;
     }
 
+    metrics.connectionsOpen.sub();
     closesocket(clientSocket);
-    std::string threadResut = "Socket closed: ";
-    threadResut.append(std::to_string(clientSocket));
-    lockedConsoleOutput(threadResut);
+    serverLog().log("Socket closed: %llu", static_cast<unsigned long long>(clientSocket));
 }
 
-int main() {
+int runThreadedServer() {
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         std::cerr << "WSAStartup failed\n";
@@ -116,9 +156,9 @@ int main() {
 
         char clientAddrStr[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &(clientAddr.sin_addr), clientAddrStr, INET_ADDRSTRLEN);
-        std::cout << "Connection accepted on socket " << clientSocket << " from " << clientAddrStr << ":" << ntohs(clientAddr.sin_port) << std::endl;
+        serverLog().log("Connection accepted on socket %llu from %s:%u", static_cast<unsigned long long>(clientSocket), clientAddrStr, ntohs(clientAddr.sin_port));
 
-        std::thread(handleRequest, clientSocket).detach();
+        std::thread(handleConnection, clientSocket).detach();
     }
 
     closesocket(serverSocket);
@@ -126,3 +166,20 @@ int main() {
 
     return 0;
 }
+
+#endif
+
+int main() {
+#ifdef _WIN32
+    return runThreadedServer();
+#else
+    // One reactor per core: each owns its listening socket, ring or epoll instance and
+    // connections, so they share nothing on the request path. io_uring where the kernel
+    // has it, unless IO_ENGINE=epoll.
+    size_t reactorsAmount = std::max(1u, std::thread::hardware_concurrency());
+    if (io_ring::enabled()) {
+        return runUringServer(PORT, reactorsAmount, IDLE_TIMEOUT_MS) ? 0 : 1;
+    }
+    return runReactorServer(PORT, reactorsAmount, IDLE_TIMEOUT_MS) ? 0 : 1;
+#endif
+}
@@ -0,0 +1,78 @@
+#include "async_logger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+// Longest the logger sleeps when it might have missed a wakeup.
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(100);
+
+}
+
+AsyncLogger::AsyncLogger(size_t capacity) : m_ring(capacity) {
+    m_thread = std::thread(&AsyncLogger::run, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+    m_stopping.store(true);
+    {
+        std::lock_guard<std::mutex> guard(m_wakeLock);
+        m_wake.notify_one();
+    }
+    m_thread.join();
+}
+
+void AsyncLogger::log(const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    bool pushed = m_ring.try_push([&](Line& line) {
+        int length = vsnprintf(line.text, LINE_SIZE - 1, format, arguments);
+        if (length < 0) length = 0;
+        line.length = static_cast<uint32_t>(length < static_cast<int>(LINE_SIZE - 1) ? length : LINE_SIZE - 2);
+        line.text[line.length++] = '\n';
+    });
+    va_end(arguments);
+    if (!pushed) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (m_sleeping.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> guard(m_wakeLock);
+        m_wake.notify_one();
+    }
+}
+
+void AsyncLogger::run() {
+    std::string batch;
+    uint64_t reportedDropped = 0;
+    while (true) {
+        batch.clear();
+        while (batch.size() < 65536 && m_ring.try_pop([&](Line& line) { batch.append(line.text, line.length); })) {
+        }
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != reportedDropped) {
+            batch += std::to_string(dropped - reportedDropped) + " log lines dropped\n";
+            reportedDropped = dropped;
+        }
+        if (!batch.empty()) {
+            fwrite(batch.data(), 1, batch.size(), stdout);
+            fflush(stdout);
+            continue;
+        }
+        if (m_stopping.load()) return;
+
+        // Producers only notify while this is set; the timeout covers a line published
+        // between the check and the wait.
+        std::unique_lock<std::mutex> guard(m_wakeLock);
+        m_sleeping.store(true, std::memory_order_seq_cst);
+        if (m_ring.empty() && !m_stopping.load()) m_wake.wait_for(guard, IDLE_WAIT);
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+AsyncLogger& serverLog() {
+    static AsyncLogger logger;
+    return logger;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "../common/mpsc_ring.h"
+
+// Console logging off the request path. Request threads format a line straight into a
+// slot of a lock-free ring and go on; one logger thread writes the lines out in batches.
+// When the ring is full the line is dropped and counted rather than making a request
+// wait for the console.
+class AsyncLogger {
+public:
+    static constexpr size_t LINE_SIZE = 120; // longer lines are cut
+
+    explicit AsyncLogger(size_t capacity = 8192);
+    ~AsyncLogger();
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    // printf-style; a newline is added.
+    void log(const char* format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Line {
+        uint32_t length = 0;
+        char text[LINE_SIZE];
+    };
+
+    void run();
+
+    mpsc_ring<Line> m_ring;
+    std::atomic<uint64_t> m_dropped{ 0 };
+    std::atomic<bool> m_sleeping{ false };
+    std::atomic<bool> m_stopping{ false };
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+};
+
+// The server's request and connection log.
+AsyncLogger& serverLog();
@@ -0,0 +1,466 @@
+#include "compute_endpoints.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../common/compute_scheduler.h"
+#include "http_metrics.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int DEFAULT_BUDGET_MS = 1000;
+// Longer budgets are cut to this.
+const int MAX_BUDGET_MS = 10000;
+const size_t MAX_QUEUED_JOBS = 256;
+// Cost per element assumed until tiles have been measured.
+const double INITIAL_NS_PER_ELEMENT = 1.0;
+// Smaller tiles are mostly overhead and would skew the measured cost.
+const size_t MIN_MEASURED_TILE = 4096;
+// Nesting of JSON arrays, a matrix given row by row takes two.
+const int MAX_JSON_DEPTH = 8;
+
+const std::string methodNotAllowedResponse = "HTTP/1.1 405 Method Not Allowed\r\nAllow: POST\r\nContent-Length: 0\r\n\r\n";
+// Unlike a malformed request, a well-formed one with unusable input keeps the connection.
+const std::string invalidInputResponse = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+const std::string overloadedResponse = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\n\r\n";
+
+enum Operation {
+    OPERATION_SUBTRACT,
+    OPERATION_MIN,
+    OPERATION_COUNT_GREATER,
+};
+
+bool findOperation(std::string_view path, Operation& operation) {
+    if (path == "/matrix/subtract") operation = OPERATION_SUBTRACT;
+    else if (path == "/reduce/min") operation = OPERATION_MIN;
+    else if (path == "/reduce/count") operation = OPERATION_COUNT_GREATER;
+    else return false;
+    return true;
+}
+
+// One request on its way through the pool.
+struct ComputeJob {
+    Operation operation = OPERATION_MIN;
+    std::string json;           // a JSON body, parsed on the pool
+    std::vector<int32_t> input; // subtract: A, then B
+    size_t rows = 0;
+    size_t cols = 0;
+    int32_t threshold = 0;
+    bool binaryResult = false;
+    Clock::time_point accepted;
+    Clock::time_point deadline;
+    std::atomic<bool> expired{ false };
+
+    std::vector<int32_t> difference;
+    std::mutex minimumLock;
+    int32_t minimum = 0;
+    size_t minimumIndex = SIZE_MAX;
+    std::atomic<uint64_t> count{ 0 };
+
+    uint64_t client = 0;
+    std::function<void()> wake;
+    std::shared_ptr<DeferredResponse> deferred;
+
+    size_t elements() const { return operation == OPERATION_SUBTRACT ? rows * cols : input.size(); }
+};
+
+// The JSON the endpoints take: integers, arrays of integers (nested ones are flattened,
+// so a matrix may come row by row), and objects of those one level deep.
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : m_text(text) {}
+
+    bool startsWithArray() {
+        skipSpace();
+        return m_position < m_text.size() && m_text[m_position] == '[';
+    }
+
+    // The whole text is one array.
+    bool readArray(std::vector<int32_t>& values) { return array(values, 0) && end(); }
+
+    // The whole text is one object: integer members go to `numbers`, arrays to `arrays`.
+    bool readObject(std::unordered_map<std::string, int64_t>& numbers, std::unordered_map<std::string, std::vector<int32_t>>& arrays) {
+        if (!consume('{')) return false;
+        if (consume('}')) return end();
+        while (true) {
+            std::string key;
+            if (!string(key) || !consume(':')) return false;
+            if (startsWithArray()) {
+                if (!array(arrays[key], 0)) return false;
+            }
+            else if (!integer(numbers[key])) {
+                return false;
+            }
+            if (consume('}')) return end();
+            if (!consume(',')) return false;
+        }
+    }
+
+private:
+    void skipSpace() {
+        while (m_position < m_text.size() && (m_text[m_position] == ' ' || m_text[m_position] == '\t' || m_text[m_position] == '\r'
+            || m_text[m_position] == '\n')) {
+            m_position++;
+        }
+    }
+
+    bool consume(char expected) {
+        skipSpace();
+        if (m_position == m_text.size() || m_text[m_position] != expected) return false;
+        m_position++;
+        return true;
+    }
+
+    bool end() {
+        skipSpace();
+        return m_position == m_text.size();
+    }
+
+    bool integer(int64_t& value) {
+        skipSpace();
+        const char* first = m_text.data() + m_position;
+        auto [last, error] = std::from_chars(first, m_text.data() + m_text.size(), value);
+        if (error != std::errc() || last == first) return false;
+        m_position += static_cast<size_t>(last - first);
+        return true;
+    }
+
+    // Keys are plain names; escapes are not needed for them and are refused.
+    bool string(std::string& value) {
+        if (!consume('"')) return false;
+        size_t close = m_text.find('"', m_position);
+        if (close == std::string_view::npos) return false;
+        std::string_view content = m_text.substr(m_position, close - m_position);
+        if (content.find('\\') != std::string_view::npos) return false;
+        value.assign(content);
+        m_position = close + 1;
+        return true;
+    }
+
+    bool array(std::vector<int32_t>& values, int depth) {
+        if (depth >= MAX_JSON_DEPTH || !consume('[')) return false;
+        if (consume(']')) return true;
+        while (true) {
+            if (startsWithArray()) {
+                if (!array(values, depth + 1)) return false;
+            }
+            else {
+                int64_t value;
+                if (!integer(value) || value < INT32_MIN || value > INT32_MAX) return false;
+                values.push_back(static_cast<int32_t>(value));
+            }
+            if (consume(']')) return true;
+            if (!consume(',')) return false;
+        }
+    }
+
+    std::string_view m_text;
+    size_t m_position = 0;
+};
+
+// Value of `name` in the query of `target`; empty when absent.
+std::string_view queryParameter(std::string_view target, std::string_view name) {
+    size_t question = target.find('?');
+    if (question == std::string_view::npos) return {};
+    std::string_view query = target.substr(question + 1);
+    while (!query.empty()) {
+        size_t ampersand = query.find('&');
+        std::string_view pair = query.substr(0, ampersand);
+        size_t equals = pair.find('=');
+        if (pair.substr(0, equals) == name) return equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+        if (ampersand == std::string_view::npos) break;
+        query.remove_prefix(ampersand + 1);
+    }
+    return {};
+}
+
+template <typename number_t>
+bool parseNumber(std::string_view text, number_t& value) {
+    const char* last = text.data() + text.size();
+    auto [end, error] = std::from_chars(text.data(), last, value);
+    return !text.empty() && error == std::errc() && end == last;
+}
+
+// Bodies are little-endian; only a big-endian host has anything to do.
+void fromLittleEndian(int32_t* values, size_t count) {
+    if constexpr (std::endian::native != std::endian::little) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t value = static_cast<uint32_t>(values[i]);
+            values[i] = static_cast<int32_t>((value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24));
+        }
+    }
+}
+
+std::string okResponse(const char* contentType, const std::string& body) {
+    return "HTTP/1.1 200 OK\r\nContent-Type: " + std::string(contentType) + "\r\nContent-Length: " + std::to_string(body.size())
+        + "\r\n\r\n" + body;
+}
+
+void appendNumber(std::string& out, int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+std::string resultResponse(const ComputeJob& job) {
+    std::string body;
+    if (job.operation == OPERATION_MIN) {
+        body = "{\"min\":";
+        appendNumber(body, job.minimum);
+        body += ",\"index\":";
+        appendNumber(body, static_cast<int64_t>(job.minimumIndex));
+        body += "}";
+    }
+    else if (job.operation == OPERATION_COUNT_GREATER) {
+        body = "{\"count\":";
+        appendNumber(body, static_cast<int64_t>(job.count.load(std::memory_order_relaxed)));
+        body += "}";
+    }
+    else if (job.binaryResult) {
+        body.resize(job.difference.size() * sizeof(int32_t));
+        std::vector<int32_t> swapped;
+        const int32_t* values = job.difference.data();
+        if constexpr (std::endian::native != std::endian::little) {
+            swapped = job.difference;
+            fromLittleEndian(swapped.data(), swapped.size());
+            values = swapped.data();
+        }
+        std::memcpy(body.data(), values, body.size());
+        return okResponse("application/octet-stream", body);
+    }
+    else {
+        body.reserve(job.difference.size() * 4 + 48);
+        body = "{\"rows\":";
+        appendNumber(body, static_cast<int64_t>(job.rows));
+        body += ",\"cols\":";
+        appendNumber(body, static_cast<int64_t>(job.cols));
+        body += ",\"result\":[";
+        for (size_t i = 0; i < job.difference.size(); i++) {
+            if (i > 0) body += ',';
+            appendNumber(body, job.difference[i]);
+        }
+        body += "]}";
+    }
+    return okResponse("application/json", body);
+}
+
+// Fills the job's input from its JSON body. False if it is not what the endpoint takes.
+bool parseJson(ComputeJob& job) {
+    JsonReader reader(job.json);
+    std::unordered_map<std::string, int64_t> numbers;
+    std::unordered_map<std::string, std::vector<int32_t>> arrays;
+    if (job.operation != OPERATION_SUBTRACT) {
+        if (reader.startsWithArray()) return reader.readArray(job.input) && !job.input.empty();
+        if (!reader.readObject(numbers, arrays)) return false;
+        job.input = std::move(arrays["values"]);
+        return !job.input.empty();
+    }
+    if (!reader.readObject(numbers, arrays)) return false;
+    if (numbers.count("rows")) job.rows = static_cast<size_t>(std::max<int64_t>(numbers["rows"], 0));
+    if (numbers.count("cols")) job.cols = static_cast<size_t>(std::max<int64_t>(numbers["cols"], 0));
+    std::vector<int32_t>& a = arrays["a"];
+    std::vector<int32_t>& b = arrays["b"];
+    if (job.rows == 0 || job.cols == 0 || a.size() / job.rows != job.cols || a.size() % job.rows != 0 || b.size() != a.size()) return false;
+    job.input = std::move(a);
+    job.input.insert(job.input.end(), b.begin(), b.end());
+    return true;
+}
+
+// The kernel for [begin, end) of the job's elements.
+void computeRange(ComputeJob& job, size_t begin, size_t end) {
+    const int32_t* values = job.input.data();
+    if (job.operation == OPERATION_SUBTRACT) {
+        const int32_t* b = values + job.elements();
+        for (size_t i = begin; i < end; i++) {
+            // Wraps around instead of overflowing.
+            job.difference[i] = static_cast<int32_t>(static_cast<uint32_t>(values[i]) - static_cast<uint32_t>(b[i]));
+        }
+    }
+    else if (job.operation == OPERATION_MIN) {
+        size_t best = begin;
+        for (size_t i = begin + 1; i < end; i++) {
+            if (values[i] < values[best]) best = i;
+        }
+        std::lock_guard<std::mutex> lock(job.minimumLock);
+        if (job.minimumIndex == SIZE_MAX || values[best] < job.minimum || (values[best] == job.minimum && best < job.minimumIndex)) {
+            job.minimum = values[best];
+            job.minimumIndex = best;
+        }
+    }
+    else {
+        uint64_t count = 0;
+        for (size_t i = begin; i < end; i++) count += values[i] > job.threshold ? 1 : 0;
+        job.count.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+class ComputeService {
+public:
+    ComputeService() : m_pool(poolConfig()) {}
+
+    // How long `elements` more would take, behind everything accepted and unfinished.
+    Clock::duration estimate(size_t elements) const {
+        double nanoseconds = static_cast<double>(m_queuedElements.load(std::memory_order_relaxed) + elements)
+            * m_nsPerElement.load(std::memory_order_relaxed) / static_cast<double>(m_pool.workers());
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(nanoseconds));
+    }
+
+    ComputeBacklog backlog() const {
+        ComputeBacklog backlog;
+        backlog.jobs = m_pool.jobs_in_system();
+        backlog.elements = m_queuedElements.load(std::memory_order_relaxed);
+        return backlog;
+    }
+
+    // Queues the job: its JSON parse first if it has one. False when the pool is full.
+    bool start(const std::shared_ptr<ComputeJob>& job) {
+        if (job->json.empty()) return compute(job);
+        auto parsed = std::make_shared<bool>(false);
+        return m_pool.try_submit(job->client, 1,
+            [job, parsed](size_t, size_t) { *parsed = parseJson(*job); },
+            [this, job, parsed]() {
+                job->json = std::string();
+                if (!*parsed) finish(*job, invalidInputResponse);
+                else if (Clock::now() > job->deadline || !compute(job)) reject(*job);
+            });
+    }
+
+private:
+    static compute_scheduler::config poolConfig() {
+        compute_scheduler::config config;
+        config.max_jobs = MAX_QUEUED_JOBS;
+        return config;
+    }
+
+    bool compute(const std::shared_ptr<ComputeJob>& job) {
+        size_t elements = job->elements();
+        if (job->operation == OPERATION_SUBTRACT) job->difference.resize(elements);
+        m_queuedElements.fetch_add(elements, std::memory_order_relaxed);
+        bool queued = m_pool.try_submit(job->client, elements,
+            [this, job](size_t begin, size_t end) {
+                // A tile that starts past the deadline is not worth computing, nor is
+                // anything after it.
+                if (job->expired.load(std::memory_order_relaxed)) return;
+                Clock::time_point started = Clock::now();
+                if (started > job->deadline) {
+                    job->expired.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                computeRange(*job, begin, end);
+                measure(end - begin, Clock::now() - started);
+            },
+            [this, job, elements]() {
+                m_queuedElements.fetch_sub(elements, std::memory_order_relaxed);
+                if (job->expired.load(std::memory_order_relaxed)) reject(*job);
+                else finish(*job, resultResponse(*job));
+            });
+        if (!queued) m_queuedElements.fetch_sub(elements, std::memory_order_relaxed);
+        return queued;
+    }
+
+    // Moving average of the cost per element, over tiles large enough to tell.
+    void measure(size_t elements, Clock::duration elapsed) {
+        if (elements < MIN_MEASURED_TILE) return;
+        double sample = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(elements);
+        double average = m_nsPerElement.load(std::memory_order_relaxed);
+        m_nsPerElement.store(average + (sample - average) / 8, std::memory_order_relaxed);
+    }
+
+    void finish(ComputeJob& job, std::string response) {
+        httpMetrics().computeTime.record(Clock::now() - job.accepted);
+        job.deferred->complete(std::move(response));
+        if (job.wake) job.wake();
+    }
+
+    void reject(ComputeJob& job) {
+        httpMetrics().computeRejected.add();
+        finish(job, overloadedResponse);
+    }
+
+    compute_scheduler m_pool;
+    std::atomic<uint64_t> m_queuedElements{ 0 };
+    std::atomic<double> m_nsPerElement{ INITIAL_NS_PER_ELEMENT };
+};
+
+ComputeService& computeService() {
+    static ComputeService service;
+    return service;
+}
+
+}
+
+bool isComputePath(std::string_view path) {
+    Operation operation;
+    return findOperation(path, operation);
+}
+
+HttpResponse computeResponse(const HttpRequest& request, const ResponseContext& context) {
+    HttpResponse response;
+    response.close = !request.keepAlive;
+    auto job = std::make_shared<ComputeJob>();
+    findOperation(request.path, job->operation);
+    if (request.method != "POST") {
+        response.body = methodNotAllowedResponse;
+        return response;
+    }
+    response.body = invalidInputResponse;
+
+    int budgetMs = DEFAULT_BUDGET_MS;
+    std::string_view budget = queryParameter(request.target, "budget_ms");
+    if (!budget.empty() && (!parseNumber(budget, budgetMs) || budgetMs <= 0)) return response;
+    budgetMs = std::min(budgetMs, MAX_BUDGET_MS);
+    std::string_view rows = queryParameter(request.target, "rows");
+    std::string_view cols = queryParameter(request.target, "cols");
+    if ((!rows.empty() && !parseNumber(rows, job->rows)) || (!cols.empty() && !parseNumber(cols, job->cols))) return response;
+    if (job->operation == OPERATION_COUNT_GREATER && !parseNumber(queryParameter(request.target, "gt"), job->threshold)) return response;
+    job->binaryResult = request.header("Accept").find("application/octet-stream") != std::string_view::npos;
+
+    // Elements, or a guess at them from the size of the JSON, for admission.
+    size_t elements = 0;
+    if (request.header("Content-Type").substr(0, 16) == "application/json") {
+        job->json.assign(request.body);
+        elements = job->json.size() / 4;
+    }
+    else {
+        size_t count = request.body.size() / sizeof(int32_t);
+        if (count == 0 || request.body.size() % sizeof(int32_t) != 0) return response;
+        if (job->operation == OPERATION_SUBTRACT
+            && (job->rows == 0 || job->cols == 0 || count / 2 / job->rows != job->cols || count != 2 * job->rows * job->cols)) {
+            return response;
+        }
+        job->input.resize(count);
+        std::memcpy(job->input.data(), request.body.data(), request.body.size());
+        fromLittleEndian(job->input.data(), count);
+        elements = job->elements();
+    }
+
+    ComputeService& service = computeService();
+    std::chrono::milliseconds limit(budgetMs);
+    response.body = overloadedResponse;
+    job->accepted = Clock::now();
+    job->deadline = job->accepted + limit;
+    job->client = context.client;
+    job->wake = context.wake;
+    job->deferred = std::make_shared<DeferredResponse>();
+    if (service.estimate(elements) > limit || !service.start(job)) {
+        httpMetrics().computeRejected.add();
+        return response;
+    }
+    response.body = {};
+    response.deferred = job->deferred;
+    return response;
+}
+
+ComputeBacklog computeBacklog() {
+    return computeService().backlog();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "http_handler.h"
+
+// The matrix kernels as a service:
+//
+//   POST /matrix/subtract?rows=R&cols=C   A - B, element-wise
+//   POST /reduce/min                      smallest value and its first index
+//   POST /reduce/count?gt=N               how many values are greater than N
+//
+// A body is either raw little-endian int32 (A then B for subtract), or JSON with
+// Content-Type application/json: an array of integers for the reductions, or
+// {"rows":R,"cols":C,"a":[...],"b":[...]} for subtract, the matrices flat or row by row.
+// Reductions answer in JSON; the difference comes back as JSON too, or as raw int32 when
+// the request's Accept asks for application/octet-stream.
+//
+// The work runs on a compute_scheduler shared by all connections, which batches small
+// requests and shares its workers fairly between clients; the connection gets a
+// deferred response and is woken when it is ready. Every request has a latency budget
+// (?budget_ms=, 1000 by default): one the pool cannot meet, going by the work queued
+// ahead of it and the measured cost per element, is answered 503 at once, and so is one
+// whose budget runs out before it got to a worker.
+bool isComputePath(std::string_view path);
+HttpResponse computeResponse(const HttpRequest& request, const ResponseContext& context);
+
+// Work the compute pool has accepted and not finished, for /metrics.
+struct ComputeBacklog {
+    size_t jobs = 0;
+    uint64_t elements = 0;
+};
+ComputeBacklog computeBacklog();
@@ -0,0 +1,355 @@
+#include "file_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include "gzip.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Smaller files are not worth a variant: the gzip framing alone is 18 bytes.
+const size_t MIN_COMPRESSED_SIZE = 256;
+// A variant has to save at least 1/8 of the body to be kept.
+const size_t MIN_SAVING_DIVISOR = 8;
+
+struct ContentType {
+    const char* extension;
+    const char* type;
+    bool compressible;
+};
+
+const ContentType CONTENT_TYPES[] = {
+    { ".html", "text/html", true },
+    { ".htm", "text/html", true },
+    { ".css", "text/css", true },
+    { ".js", "text/javascript", true },
+    { ".mjs", "text/javascript", true },
+    { ".json", "application/json", true },
+    { ".xml", "application/xml", true },
+    { ".svg", "image/svg+xml", true },
+    { ".txt", "text/plain", true },
+    { ".wasm", "application/wasm", true },
+    { ".ico", "image/x-icon", true },
+    { ".png", "image/png", false },
+    { ".jpg", "image/jpeg", false },
+    { ".jpeg", "image/jpeg", false },
+    { ".gif", "image/gif", false },
+    { ".webp", "image/webp", false },
+    { ".woff", "font/woff", false },
+    { ".woff2", "font/woff2", false },
+    { ".pdf", "application/pdf", false },
+    { ".zip", "application/zip", false },
+    { ".gz", "application/gzip", false },
+};
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+const ContentType* findContentType(const std::string& path) {
+    for (const ContentType& contentType : CONTENT_TYPES) {
+        if (endsWith(path, contentType.extension)) return &contentType;
+    }
+    return nullptr;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+int64_t steadyNow() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::string_view trim(std::string_view str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) return {};
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+// Weak comparison ignores the W/ prefix.
+std::string_view opaqueTag(std::string_view tag) {
+    return tag.substr(0, 2) == "W/" ? tag.substr(2) : tag;
+}
+
+// Decimal digits that fit in 64 bits.
+bool parseDecimal(std::string_view text, uint64_t& value) {
+    if (text.empty() || text.size() > 19 || text.find_first_not_of("0123456789") != std::string_view::npos) return false;
+    value = 0;
+    for (char digit : text) value = value * 10 + static_cast<uint64_t>(digit - '0');
+    return true;
+}
+
+std::shared_ptr<CachedFile> copyOf(const CachedFile& file) {
+    auto copy = std::make_shared<CachedFile>();
+    copy->response = file.response;
+    copy->notModified = file.notModified;
+    copy->etag = file.etag;
+    copy->contentType = file.contentType;
+    copy->fullPath = file.fullPath;
+    copy->bodyOffset = file.bodyOffset;
+    copy->bodyLength = file.bodyLength;
+    copy->streamed = file.streamed;
+    copy->compressible = file.compressible;
+    copy->variants = file.variants;
+    copy->fileSize = file.fileSize;
+    copy->modified = file.modified;
+    copy->checkedAt.store(file.checkedAt.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return copy;
+}
+
+// `identity` with a gzip variant added, or nullptr when gzip does not pay off.
+std::shared_ptr<const CachedFile> withVariants(const CachedFile& identity) {
+    std::string_view body = std::string_view(identity.response).substr(identity.bodyOffset, static_cast<size_t>(identity.bodyLength));
+    std::string gzipped = gzipCompress(body);
+    if (gzipped.size() > body.size() - body.size() / MIN_SAVING_DIVISOR) return nullptr;
+
+    EncodedVariant variant;
+    variant.encoding = "gzip";
+    // A strong ETag names one representation, so the encoded one gets its own.
+    variant.etag = identity.etag.substr(0, identity.etag.size() - 1) + "-gzip\"";
+    variant.response = "HTTP/1.1 200 OK\r\nContent-Type: " + identity.contentType + "\r\nContent-Encoding: gzip\r\nContent-Length: "
+        + std::to_string(gzipped.size()) + "\r\nVary: Accept-Encoding\r\nETag: " + variant.etag + "\r\n\r\n" + gzipped;
+    variant.notModified = "HTTP/1.1 304 Not Modified\r\nVary: Accept-Encoding\r\nETag: " + variant.etag + "\r\n\r\n";
+
+    std::shared_ptr<CachedFile> entry = copyOf(identity);
+    entry->variants.push_back(std::move(variant));
+    return entry;
+}
+
+}
+
+std::string getContentType(const std::string& path) {
+    const ContentType* contentType = findContentType(path);
+    return contentType ? contentType->type : "text/plain";
+}
+
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag) {
+    std::string_view wanted = opaqueTag(etag);
+    while (!ifNoneMatch.empty()) {
+        size_t comma = ifNoneMatch.find(',');
+        std::string_view tag = trim(ifNoneMatch.substr(0, comma));
+        if (tag == "*" || (!tag.empty() && opaqueTag(tag) == wanted)) return true;
+        if (comma == std::string_view::npos) break;
+        ifNoneMatch.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool acceptsEncoding(std::string_view acceptEncoding, std::string_view coding) {
+    // -1 while not mentioned, else whether allowed.
+    int listed = -1, wildcard = -1;
+    while (!acceptEncoding.empty()) {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view item = trim(acceptEncoding.substr(0, comma));
+        size_t semicolon = item.find(';');
+        std::string_view name = trim(item.substr(0, semicolon));
+        int allowed = 1;
+        if (semicolon != std::string_view::npos) {
+            // Any weight but zero ("0", "0.0", ...) allows the coding.
+            std::string_view parameter = trim(item.substr(semicolon + 1));
+            if (parameter.size() > 2 && equalsIgnoreCase(parameter.substr(0, 2), "q=")
+                && parameter.substr(2).find_first_not_of("0.") == std::string_view::npos) {
+                allowed = 0;
+            }
+        }
+        if (equalsIgnoreCase(name, coding)) listed = allowed;
+        else if (name == "*") wildcard = allowed;
+        if (comma == std::string_view::npos) break;
+        acceptEncoding.remove_prefix(comma + 1);
+    }
+    return listed >= 0 ? listed == 1 : wildcard == 1;
+}
+
+const EncodedVariant* preferredVariant(const CachedFile& file, std::string_view acceptEncoding) {
+    if (acceptEncoding.empty()) return nullptr;
+    for (const EncodedVariant& variant : file.variants) {
+        if (acceptsEncoding(acceptEncoding, variant.encoding)) return &variant;
+    }
+    return nullptr;
+}
+
+RangeResult parseRange(std::string_view range, uint64_t size, uint64_t& first, uint64_t& last) {
+    if (range.substr(0, 6) != "bytes=" || range.find(',') != std::string_view::npos) return RANGE_NONE;
+    std::string_view spec = trim(range.substr(6));
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) return RANGE_NONE;
+    std::string_view from = spec.substr(0, dash);
+    std::string_view to = spec.substr(dash + 1);
+    if (from.empty()) {
+        // bytes=-N: the last N bytes
+        uint64_t suffix;
+        if (!parseDecimal(to, suffix)) return RANGE_NONE;
+        if (suffix == 0 || size == 0) return RANGE_UNSATISFIABLE;
+        first = suffix < size ? size - suffix : 0;
+        last = size - 1;
+        return RANGE_SATISFIABLE;
+    }
+    if (!parseDecimal(from, first)) return RANGE_NONE;
+    if (to.empty()) {
+        last = UINT64_MAX;
+    }
+    else if (!parseDecimal(to, last) || last < first) {
+        return RANGE_NONE;
+    }
+    if (first >= size) return RANGE_UNSATISFIABLE;
+    last = std::min(last, size - 1);
+    return RANGE_SATISFIABLE;
+}
+
+std::string partialContentHead(const CachedFile& file, uint64_t first, uint64_t last) {
+    return "HTTP/1.1 206 Partial Content\r\nContent-Type: " + file.contentType + "\r\nContent-Length: " + std::to_string(last - first + 1)
+        + "\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(file.bodyLength)
+        + (file.compressible ? "\r\nVary: Accept-Encoding" : "") + "\r\nETag: " + file.etag + "\r\n\r\n";
+}
+
+std::string rangeNotSatisfiableResponse(const CachedFile& file) {
+    return "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\nContent-Range: bytes */" + std::to_string(file.bodyLength) + "\r\n\r\n";
+}
+
+FileCache::FileCache(std::string root, std::chrono::milliseconds revalidateInterval, uintmax_t inlineLimit)
+    : m_root(std::move(root)), m_revalidateInterval(revalidateInterval), m_inlineLimit(inlineLimit) {
+    m_compressor = std::thread(&FileCache::compressLoop, this);
+}
+
+FileCache::~FileCache() {
+    {
+        std::lock_guard<std::mutex> guard(m_compressLock);
+        m_stopping = true;
+    }
+    m_compressWake.notify_one();
+    m_compressor.join();
+}
+
+std::shared_ptr<const CachedFile> FileCache::get(std::string_view path) {
+    int64_t now = steadyNow();
+    int64_t interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_revalidateInterval).count();
+    std::shared_ptr<const CachedFile> cached;
+    {
+        std::shared_lock<std::shared_mutex> guard(m_lock);
+        auto it = m_files.find(path);
+        if (it != m_files.end()) {
+            cached = it->second;
+            if (now - cached->checkedAt.load(std::memory_order_relaxed) < interval) return cached;
+        }
+    }
+
+    std::string fullPath = m_root + std::string(path);
+    std::error_code error;
+    bool regular = fs::is_regular_file(fullPath, error);
+    uintmax_t size = regular ? fs::file_size(fullPath, error) : 0;
+    fs::file_time_type modified = regular && !error ? fs::last_write_time(fullPath, error) : fs::file_time_type();
+    if (!regular || error) {
+        if (cached) {
+            std::unique_lock<std::shared_mutex> guard(m_lock);
+            auto it = m_files.find(path);
+            if (it != m_files.end()) m_files.erase(it);
+        }
+        return nullptr;
+    }
+
+    int64_t modifiedTicks = modified.time_since_epoch().count();
+    if (cached && cached->fileSize == size && cached->modified == modifiedTicks) {
+        cached->checkedAt.store(now, std::memory_order_relaxed);
+        return cached;
+    }
+
+    std::shared_ptr<const CachedFile> loaded = load(fullPath);
+    {
+        std::unique_lock<std::shared_mutex> guard(m_lock);
+        auto it = m_files.find(path);
+        if (!loaded) {
+            if (it != m_files.end()) m_files.erase(it);
+        }
+        else if (it != m_files.end()) {
+            it->second = loaded;
+        }
+        else {
+            m_files.emplace(std::string(path), loaded);
+        }
+    }
+    if (loaded && loaded->compressible) {
+        std::lock_guard<std::mutex> guard(m_compressLock);
+        m_compressQueue.emplace_back(path);
+        m_compressWake.notify_one();
+    }
+    return loaded;
+}
+
+void FileCache::compressLoop() {
+    std::unique_lock<std::mutex> lock(m_compressLock);
+    while (true) {
+        m_compressWake.wait(lock, [this] { return m_stopping || !m_compressQueue.empty(); });
+        if (m_stopping) return;
+        std::string path = std::move(m_compressQueue.front());
+        m_compressQueue.pop_front();
+        lock.unlock();
+
+        std::shared_ptr<const CachedFile> identity;
+        {
+            std::shared_lock<std::shared_mutex> guard(m_lock);
+            auto it = m_files.find(path);
+            if (it != m_files.end()) identity = it->second;
+        }
+        std::shared_ptr<const CachedFile> encoded;
+        if (identity && identity->compressible && identity->variants.empty()) encoded = withVariants(*identity);
+        if (encoded) {
+            // Unless the file changed meanwhile and the entry was rebuilt.
+            std::unique_lock<std::shared_mutex> guard(m_lock);
+            auto it = m_files.find(path);
+            if (it != m_files.end() && it->second == identity) it->second = encoded;
+        }
+        lock.lock();
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::load(const std::string& fullPath) const {
+    std::error_code error;
+    fs::file_time_type modified = fs::last_write_time(fullPath, error);
+    uintmax_t size = error ? 0 : fs::file_size(fullPath, error);
+    if (error) return nullptr;
+    std::ifstream file(fullPath, std::ios::binary);
+    if (!file.is_open()) return nullptr;
+
+    auto entry = std::make_shared<CachedFile>();
+    std::string body;
+    if (size > m_inlineLimit) {
+        entry->streamed = true;
+    }
+    else {
+        char chunk[65536];
+        while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0) {
+            body.append(chunk, static_cast<size_t>(file.gcount()));
+        }
+        size = body.size();
+    }
+
+    entry->fullPath = fullPath;
+    entry->fileSize = size;
+    entry->modified = modified.time_since_epoch().count();
+    entry->checkedAt.store(steadyNow(), std::memory_order_relaxed);
+    const ContentType* contentType = findContentType(fullPath);
+    entry->contentType = contentType ? contentType->type : "text/plain";
+    entry->compressible = contentType && contentType->compressible && !entry->streamed && size >= MIN_COMPRESSED_SIZE;
+    std::string vary = entry->compressible ? "Vary: Accept-Encoding\r\n" : "";
+
+    // Size and mtime, like most servers: cheap, and changes whenever the file does.
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(entry->fileSize),
+        static_cast<unsigned long long>(entry->modified));
+    entry->etag = etag;
+
+    entry->response = "HTTP/1.1 200 OK\r\nContent-Type: " + entry->contentType + "\r\nContent-Length: " + std::to_string(size)
+        + "\r\nAccept-Ranges: bytes\r\n" + vary + "ETag: " + entry->etag + "\r\n\r\n";
+    entry->bodyOffset = entry->response.size();
+    entry->bodyLength = size;
+    entry->response += body;
+    entry->notModified = "HTTP/1.1 304 Not Modified\r\n" + vary + "ETag: " + entry->etag + "\r\n\r\n";
+    return entry;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The body of a cached file in a content coding, as the complete responses to send.
+struct EncodedVariant {
+    std::string encoding;    // as in Content-Encoding
+    std::string response;    // "200 OK" with the encoded body
+    std::string notModified;
+    std::string etag;        // the identity ETag with the coding appended
+};
+
+// A static file held in memory as the complete responses the server sends for it, so a
+// cache hit is a lookup and a send, with no disk access and no string building. Large
+// files are held as their headers only and the body is sent from the file itself.
+struct CachedFile {
+    std::string response;    // "200 OK": headers, and the body unless `streamed`
+    std::string notModified; // "304 Not Modified" for a matching If-None-Match
+    std::string etag;        // quoted, as sent
+    std::string contentType;
+    std::string fullPath;
+    size_t bodyOffset = 0;   // where the body starts (or would start) in `response`
+    uint64_t bodyLength = 0;
+    bool streamed = false;   // body not in `response`, send it from `fullPath`
+    // Worth compressing: its responses vary on Accept-Encoding from the start, and
+    // `variants` (best first) are filled in by the cache's compressor thread, which
+    // replaces the entry once they are built.
+    bool compressible = false;
+    std::vector<EncodedVariant> variants;
+
+    // What the entry was built from, to notice when the file changes.
+    uintmax_t fileSize = 0;
+    int64_t modified = 0;
+    // steady_clock ticks of the last check against the file.
+    mutable std::atomic<int64_t> checkedAt{ 0 };
+};
+
+// Files under `root`, keyed by request path. An entry is checked against the file's size
+// and mtime at most once per `revalidateInterval` and rebuilt when either changed.
+// Files up to `inlineLimit` bytes are kept whole; larger ones are streamed. Whole text
+// files are gzipped by a background thread after they are loaded, so requests never
+// wait for compression: until the variant is there they get the identity response.
+class FileCache {
+public:
+    explicit FileCache(std::string root, std::chrono::milliseconds revalidateInterval = std::chrono::milliseconds(1000),
+        uintmax_t inlineLimit = uintmax_t(256) << 10);
+    ~FileCache();
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // nullptr when the file does not exist or cannot be read.
+    std::shared_ptr<const CachedFile> get(std::string_view path);
+
+private:
+    std::shared_ptr<const CachedFile> load(const std::string& fullPath) const;
+    void compressLoop();
+
+    std::string m_root;
+    std::chrono::milliseconds m_revalidateInterval;
+    uintmax_t m_inlineLimit;
+
+    std::shared_mutex m_lock;
+    // Transparent, so a lookup by the parser's string_view does not build a string.
+    struct PathHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view path) const { return std::hash<std::string_view>()(path); }
+    };
+    std::unordered_map<std::string, std::shared_ptr<const CachedFile>, PathHash, std::equal_to<>> m_files;
+
+    // Paths of entries waiting for their encoded variants.
+    std::mutex m_compressLock;
+    std::condition_variable m_compressWake;
+    std::deque<std::string> m_compressQueue;
+    bool m_stopping = false;
+    std::thread m_compressor;
+};
+
+enum RangeResult {
+    RANGE_NONE,          // no usable Range header: send the whole file
+    RANGE_SATISFIABLE,   // send bytes [first, last]
+    RANGE_UNSATISFIABLE, // 416
+};
+
+// Parses a single "bytes=" range of a `size`-byte body. Multiple ranges are answered
+// with the whole file, which HTTP allows.
+RangeResult parseRange(std::string_view range, uint64_t size, uint64_t& first, uint64_t& last);
+// Headers of the 206 for bytes [first, last] of `file`.
+std::string partialContentHead(const CachedFile& file, uint64_t first, uint64_t last);
+std::string rangeNotSatisfiableResponse(const CachedFile& file);
+
+// True when an If-None-Match header value lists `etag` (weak comparison) or is "*".
+bool etagMatches(std::string_view ifNoneMatch, std::string_view etag);
+
+// True when an Accept-Encoding header value allows `coding`: listed, or covered by "*",
+// with a q-value above zero.
+bool acceptsEncoding(std::string_view acceptEncoding, std::string_view coding);
+// The first of `file`'s variants the client accepts, or nullptr for the identity body.
+const EncodedVariant* preferredVariant(const CachedFile& file, std::string_view acceptEncoding);
+
+std::string getContentType(const std::string& path);
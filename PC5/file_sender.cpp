@@ -0,0 +1,67 @@
+#include "file_sender.h"
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include "http_metrics.h"
+
+namespace {
+
+// Replies gathered up to this size before they are sent; larger ones go out directly.
+constexpr size_t GATHER_LIMIT = 16384;
+
+}
+
+bool sendAll(SOCKET socket, const char* data, size_t length) {
+    while (length > 0) {
+        int chunk = static_cast<int>(std::min<size_t>(length, INT_MAX));
+        int sent = send(socket, data, chunk, 0);
+        if (sent <= 0) return false;
+        httpMetrics().bytesSent.add(sent);
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+bool sendFileRegion(SOCKET socket, const std::string& head, const std::string& path, uint64_t offset, uint64_t length) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open() || !file.seekg(static_cast<std::streamoff>(offset))) return false;
+    if (!sendAll(socket, head.data(), head.size())) return false;
+    char chunk[65536];
+    while (length > 0) {
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(length, sizeof(chunk)));
+        if (!file.read(chunk, wanted)) return false;
+        if (!sendAll(socket, chunk, wanted)) return false;
+        length -= wanted;
+    }
+    return true;
+}
+
+void ResponseWriter::write(const char* data, size_t length) {
+    if (m_failed) return;
+    if (m_pending.size() + length <= GATHER_LIMIT) {
+        m_pending.append(data, length);
+        return;
+    }
+    if (!flush() || !sendAll(m_socket, data, length)) m_failed = true;
+}
+
+void ResponseWriter::write(const HttpResponse& response) {
+    if (response.fileLength == 0) {
+        write(response.head);
+        write(response.body);
+        return;
+    }
+    if (m_failed) return;
+    std::string head = response.head;
+    head.append(response.body);
+    if (!flush() || !sendFileRegion(m_socket, head, response.filePath, response.fileOffset, response.fileLength)) m_failed = true;
+}
+
+bool ResponseWriter::flush() {
+    if (!m_failed && !m_pending.empty()) {
+        m_failed = !sendAll(m_socket, m_pending.data(), m_pending.size());
+        m_pending.clear();
+    }
+    return !m_failed;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <winsock2.h>
+#include "http_handler.h"
+
+// Blocking sends that put the whole buffer on the wire, however many send calls it
+// takes. False once the connection fails; the client then got a truncated reply and the
+// socket should be closed.
+bool sendAll(SOCKET socket, const char* data, size_t length);
+
+// Sends `head` and then `length` bytes of the file at `offset` (a whole file or one
+// Range), copied through a 64 KiB buffer rather than read into memory whole. The Linux
+// transports send file bodies themselves, with sendfile or io_uring.
+bool sendFileRegion(SOCKET socket, const std::string& head, const std::string& path, uint64_t offset, uint64_t length);
+
+// Replies on one connection. Small ones are gathered, so the answers to a batch of
+// pipelined requests leave in a single send; flush before waiting for the next batch.
+class ResponseWriter {
+public:
+    explicit ResponseWriter(SOCKET socket) : m_socket(socket) {}
+
+    void write(const char* data, size_t length);
+    void write(std::string_view data) { write(data.data(), data.size()); }
+    void write(const HttpResponse& response);
+    bool flush();
+    // Set once a send failed; later writes are dropped.
+    bool failed() const { return m_failed; }
+
+private:
+    SOCKET m_socket;
+    std::string m_pending;
+    bool m_failed = false;
+};
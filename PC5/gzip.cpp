@@ -0,0 +1,364 @@
+#include "gzip.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+namespace {
+
+const size_t WINDOW_SIZE = 32768;
+const size_t MIN_MATCH = 3;
+const size_t MAX_MATCH = 258;
+const int HASH_BITS = 15;
+// Candidates compared per position; longer chains buy little on text.
+const int MAX_CHAIN = 128;
+// A match at least this long is taken without looking one byte further for a longer one.
+const size_t LAZY_LIMIT = 32;
+const size_t SYMBOLS_PER_BLOCK = 1 << 16;
+
+const int LITERAL_CODES = 286;
+const int DISTANCE_CODES = 30;
+const int END_OF_BLOCK = 256;
+
+const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+    131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+    2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+    13, 13 };
+// The order code length code lengths are sent in.
+const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// A literal (distance 0) or a match.
+struct Symbol {
+    uint16_t value; // the byte, or the match length
+    uint16_t distance;
+};
+
+class BitWriter {
+public:
+    explicit BitWriter(std::string& out) : m_out(out) {}
+
+    // The low `count` bits of `bits`, least significant first.
+    void write(uint32_t bits, int count) {
+        m_bits |= static_cast<uint64_t>(bits) << m_count;
+        m_count += count;
+        while (m_count >= 8) {
+            m_out.push_back(static_cast<char>(m_bits & 0xff));
+            m_bits >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    // Huffman codes go out most significant bit first.
+    void writeCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        write(reversed, length);
+    }
+
+    void flush() {
+        if (m_count > 0) m_out.push_back(static_cast<char>(m_bits & 0xff));
+        m_bits = 0;
+        m_count = 0;
+    }
+
+private:
+    std::string& m_out;
+    uint64_t m_bits = 0;
+    int m_count = 0;
+};
+
+int lengthCode(size_t length) {
+    return static_cast<int>(std::upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) - LENGTH_BASE) - 1;
+}
+
+int distanceCode(size_t distance) {
+    return static_cast<int>(std::upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30, distance) - DISTANCE_BASE) - 1;
+}
+
+// Huffman code lengths for `frequencies`, none longer than `limit`. Too deep a tree is
+// flattened by halving the frequencies and building again, which costs a fraction of
+// a percent against an optimal length-limited code. At least two symbols get a code so
+// the code is always complete.
+std::vector<uint8_t> codeLengths(std::vector<uint32_t> frequencies, int limit) {
+    size_t used = static_cast<size_t>(std::count_if(frequencies.begin(), frequencies.end(), [](uint32_t f) { return f > 0; }));
+    for (size_t symbol = 0; used < 2 && symbol < frequencies.size(); symbol++) {
+        if (frequencies[symbol] == 0) {
+            frequencies[symbol] = 1;
+            used++;
+        }
+    }
+
+    std::vector<uint8_t> lengths(frequencies.size());
+    while (true) {
+        // Leaves first, then internal nodes; parent[] links every node to its parent.
+        std::vector<int> parent;
+        using Node = std::pair<uint64_t, int>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int> leaves;
+        for (size_t symbol = 0; symbol < frequencies.size(); symbol++) {
+            if (frequencies[symbol] == 0) continue;
+            queue.push({ frequencies[symbol], static_cast<int>(parent.size()) });
+            leaves.push_back(static_cast<int>(symbol));
+            parent.push_back(-1);
+        }
+        while (queue.size() > 1) {
+            Node a = queue.top();
+            queue.pop();
+            Node b = queue.top();
+            queue.pop();
+            int node = static_cast<int>(parent.size());
+            parent.push_back(-1);
+            parent[a.second] = node;
+            parent[b.second] = node;
+            queue.push({ a.first + b.first, node });
+        }
+
+        int deepest = 0;
+        for (size_t leaf = 0; leaf < leaves.size(); leaf++) {
+            int depth = 0;
+            for (int node = static_cast<int>(leaf); parent[node] >= 0; node = parent[node]) depth++;
+            lengths[leaves[leaf]] = static_cast<uint8_t>(std::min(depth, 255));
+            deepest = std::max(deepest, depth);
+        }
+        if (deepest <= limit) return lengths;
+        for (uint32_t& frequency : frequencies) {
+            if (frequency > 0) frequency = (frequency >> 1) | 1;
+        }
+    }
+}
+
+// Canonical codes for `lengths` (RFC 1951 3.2.2).
+std::vector<uint16_t> canonicalCodes(const std::vector<uint8_t>& lengths) {
+    uint16_t lengthCount[16] = {};
+    for (uint8_t length : lengths) lengthCount[length]++;
+    lengthCount[0] = 0;
+    uint16_t next[16] = {};
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = static_cast<uint16_t>((code + lengthCount[bits - 1]) << 1);
+        next[bits] = code;
+    }
+    std::vector<uint16_t> codes(lengths.size());
+    for (size_t symbol = 0; symbol < lengths.size(); symbol++) {
+        if (lengths[symbol] != 0) codes[symbol] = next[lengths[symbol]]++;
+    }
+    return codes;
+}
+
+std::vector<Symbol> findMatches(std::string_view data) {
+    std::vector<Symbol> symbols;
+    symbols.reserve(data.size() / 2);
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    size_t size = data.size();
+    std::vector<int32_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int32_t> previous(WINDOW_SIZE, -1);
+
+    auto hashAt = [&](size_t position) {
+        uint32_t value = bytes[position] | (bytes[position + 1] << 8) | (bytes[position + 2] << 16);
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t position) {
+        if (position + MIN_MATCH > size) return;
+        uint32_t hash = hashAt(position);
+        previous[position % WINDOW_SIZE] = head[hash];
+        head[hash] = static_cast<int32_t>(position);
+    };
+    // Longest earlier match for `position`, before it is inserted itself.
+    auto longest = [&](size_t position, size_t& distance) {
+        if (position + MIN_MATCH > size) return size_t(0);
+        size_t best = 0;
+        size_t maxLength = std::min(MAX_MATCH, size - position);
+        int32_t candidate = head[hashAt(position)];
+        for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; chain++) {
+            size_t from = static_cast<size_t>(candidate);
+            if (position - from > WINDOW_SIZE) break;
+            if (bytes[from + best] == bytes[position + best]) {
+                size_t length = 0;
+                while (length < maxLength && bytes[from + length] == bytes[position + length]) length++;
+                if (length > best) {
+                    best = length;
+                    distance = position - from;
+                    if (length == maxLength) break;
+                }
+            }
+            int32_t next = previous[from % WINDOW_SIZE];
+            // The slot may have been reused by a later position: the chain ends here.
+            if (next >= candidate) break;
+            candidate = next;
+        }
+        return best >= MIN_MATCH ? best : 0;
+    };
+
+    size_t position = 0;
+    while (position < size) {
+        size_t distance = 0;
+        size_t length = longest(position, distance);
+        if (length > 0 && length < LAZY_LIMIT && position + 1 < size) {
+            insert(position);
+            size_t nextDistance = 0;
+            size_t nextLength = longest(position + 1, nextDistance);
+            if (nextLength > length) {
+                symbols.push_back({ bytes[position], 0 });
+                position++;
+                length = nextLength;
+                distance = nextDistance;
+            }
+            else {
+                // `position` is already in the chains.
+                symbols.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(distance) });
+                for (size_t i = 1; i < length; i++) insert(position + i);
+                position += length;
+                continue;
+            }
+        }
+        if (length > 0) {
+            symbols.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(distance) });
+            for (size_t i = 0; i < length; i++) insert(position + i);
+            position += length;
+        }
+        else {
+            symbols.push_back({ bytes[position], 0 });
+            insert(position);
+            position++;
+        }
+    }
+    return symbols;
+}
+
+// One dynamic Huffman block of `symbols`.
+void writeBlock(BitWriter& writer, const Symbol* symbols, size_t count, bool last) {
+    std::vector<uint32_t> literalFrequencies(LITERAL_CODES), distanceFrequencies(DISTANCE_CODES);
+    for (size_t i = 0; i < count; i++) {
+        if (symbols[i].distance == 0) {
+            literalFrequencies[symbols[i].value]++;
+        }
+        else {
+            literalFrequencies[257 + lengthCode(symbols[i].value)]++;
+            distanceFrequencies[distanceCode(symbols[i].distance)]++;
+        }
+    }
+    literalFrequencies[END_OF_BLOCK]++;
+    std::vector<uint8_t> literalLengths = codeLengths(literalFrequencies, 15);
+    std::vector<uint8_t> distanceLengths = codeLengths(distanceFrequencies, 15);
+    std::vector<uint16_t> literalCodes = canonicalCodes(literalLengths);
+    std::vector<uint16_t> distanceCodes = canonicalCodes(distanceLengths);
+
+    int literalCount = LITERAL_CODES;
+    while (literalCount > 257 && literalLengths[literalCount - 1] == 0) literalCount--;
+    int distanceCount = DISTANCE_CODES;
+    while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) distanceCount--;
+
+    // Both code length tables, run-length coded with codes 16 (repeat the previous
+    // length 3-6 times), 17 (3-10 zeros) and 18 (11-138 zeros).
+    std::vector<uint8_t> lengths(literalLengths.begin(), literalLengths.begin() + literalCount);
+    lengths.insert(lengths.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCount);
+    std::vector<std::pair<uint8_t, uint8_t>> runs; // code, extra bits value
+    for (size_t i = 0; i < lengths.size();) {
+        uint8_t length = lengths[i];
+        size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == length) run++;
+        i += run;
+        if (length == 0) {
+            while (run >= 11) {
+                size_t take = std::min<size_t>(run, 138);
+                runs.push_back({ 18, static_cast<uint8_t>(take - 11) });
+                run -= take;
+            }
+            if (run >= 3) {
+                runs.push_back({ 17, static_cast<uint8_t>(run - 3) });
+                run = 0;
+            }
+        }
+        else {
+            runs.push_back({ length, 0 });
+            run--;
+            while (run >= 3) {
+                size_t take = std::min<size_t>(run, 6);
+                runs.push_back({ 16, static_cast<uint8_t>(take - 3) });
+                run -= take;
+            }
+        }
+        for (; run > 0; run--) runs.push_back({ length, 0 });
+    }
+
+    std::vector<uint32_t> runFrequencies(19);
+    for (const auto& run : runs) runFrequencies[run.first]++;
+    std::vector<uint8_t> runLengths = codeLengths(runFrequencies, 7);
+    std::vector<uint16_t> runCodes = canonicalCodes(runLengths);
+    int runLengthCount = 19;
+    while (runLengthCount > 4 && runLengths[CODE_LENGTH_ORDER[runLengthCount - 1]] == 0) runLengthCount--;
+
+    writer.write(last ? 1 : 0, 1);
+    writer.write(2, 2);
+    writer.write(static_cast<uint32_t>(literalCount - 257), 5);
+    writer.write(static_cast<uint32_t>(distanceCount - 1), 5);
+    writer.write(static_cast<uint32_t>(runLengthCount - 4), 4);
+    for (int i = 0; i < runLengthCount; i++) writer.write(runLengths[CODE_LENGTH_ORDER[i]], 3);
+    for (const auto& run : runs) {
+        writer.writeCode(runCodes[run.first], runLengths[run.first]);
+        if (run.first == 16) writer.write(run.second, 2);
+        else if (run.first == 17) writer.write(run.second, 3);
+        else if (run.first == 18) writer.write(run.second, 7);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const Symbol& symbol = symbols[i];
+        if (symbol.distance == 0) {
+            writer.writeCode(literalCodes[symbol.value], literalLengths[symbol.value]);
+            continue;
+        }
+        int length = lengthCode(symbol.value);
+        writer.writeCode(literalCodes[257 + length], literalLengths[257 + length]);
+        writer.write(symbol.value - LENGTH_BASE[length], LENGTH_EXTRA[length]);
+        int distance = distanceCode(symbol.distance);
+        writer.writeCode(distanceCodes[distance], distanceLengths[distance]);
+        writer.write(symbol.distance - DISTANCE_BASE[distance], DISTANCE_EXTRA[distance]);
+    }
+    writer.writeCode(literalCodes[END_OF_BLOCK], literalLengths[END_OF_BLOCK]);
+}
+
+uint32_t crc32(std::string_view data) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (char byte : data) crc = table[(crc ^ static_cast<uint8_t>(byte)) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void appendLE32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+}
+
+std::string gzipCompress(std::string_view data) {
+    // Magic, deflate, no flags, no mtime, no extra flags, unknown OS.
+    std::string out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    BitWriter writer(out);
+    std::vector<Symbol> symbols = findMatches(data);
+    if (symbols.empty()) {
+        // A final fixed Huffman block holding only the end of block code.
+        writer.write(1, 1);
+        writer.write(1, 2);
+        writer.write(0, 7);
+    }
+    for (size_t first = 0; first < symbols.size(); first += SYMBOLS_PER_BLOCK) {
+        size_t count = std::min(SYMBOLS_PER_BLOCK, symbols.size() - first);
+        writeBlock(writer, symbols.data() + first, count, first + count == symbols.size());
+    }
+    writer.flush();
+    appendLE32(out, crc32(data));
+    appendLE32(out, static_cast<uint32_t>(data.size()));
+    return out;
+}
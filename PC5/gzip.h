@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// gzip (RFC 1952) of `data`: LZ77 over a 32 KiB window with lazy matching, coded in
+// dynamic Huffman deflate blocks. Slower than it would need to be for on-the-fly
+// compression and about as tight as zlib's default level, which is the trade the file
+// cache wants: a file is compressed once, off the request path, and served many times.
+std::string gzipCompress(std::string_view data);
@@ -0,0 +1,179 @@
+#include "http_connection.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "http_metrics.h"
+
+namespace {
+
+const size_t RECEIVE_BUFFER_SIZE = 16384;
+
+}
+
+ReadyConnections::ReadyConnections() : m_eventFd(eventfd(0, EFD_CLOEXEC)) {}
+
+ReadyConnections::~ReadyConnections() {
+    close(m_eventFd);
+}
+
+void ReadyConnections::push(unsigned connection) {
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_connections.push_back(connection);
+    }
+    uint64_t one = 1;
+    while (write(m_eventFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+std::vector<unsigned> ReadyConnections::take() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::vector<unsigned> taken;
+    taken.swap(m_connections);
+    return taken;
+}
+
+uint64_t HttpConnection::newClientId() {
+    static std::atomic<uint64_t> nextId{ 1 };
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+HttpConnection::HttpConnection() : m_input(RECEIVE_BUFFER_SIZE), m_parser(MAX_REQUEST_BODY) {
+    httpMetrics().connectionsAccepted.add();
+    httpMetrics().connectionsOpen.add();
+}
+
+HttpConnection::~HttpConnection() {
+    httpMetrics().connectionsOpen.sub();
+    httpMetrics().responsesQueued.sub(static_cast<int64_t>(m_output.size()));
+}
+
+void HttpConnection::received(size_t length) {
+    m_filled += length;
+    httpMetrics().bytesReceived.add(static_cast<int64_t>(length));
+}
+
+std::span<char> HttpConnection::receiveSpace() {
+    if (m_filled == m_input.size()) {
+        if (m_start > 0) {
+            std::memmove(m_input.data(), m_input.data() + m_start, m_filled - m_start);
+            m_filled -= m_start;
+            m_start = 0;
+        }
+        else if (m_output.empty()) {
+            // One request larger than the buffer; the parser bounds how large.
+            m_input.resize(m_input.size() * 2);
+        }
+        else {
+            return {};
+        }
+    }
+    return { m_input.data() + m_filled, m_input.size() - m_filled };
+}
+
+void HttpConnection::append(const char* data, size_t length) {
+    if (m_input.size() - m_filled < length && m_start > 0) {
+        std::memmove(m_input.data(), m_input.data() + m_start, m_filled - m_start);
+        m_filled -= m_start;
+        m_start = 0;
+    }
+    if (m_input.size() - m_filled < length) {
+        m_input.resize(std::max(m_input.size() * 2, m_filled + length));
+    }
+    std::memcpy(m_input.data() + m_filled, data, length);
+    received(length);
+}
+
+bool HttpConnection::parseRequests() {
+    using Clock = std::chrono::steady_clock;
+    const HttpMetrics& metrics = httpMetrics();
+    bool answered = false;
+    HttpRequest request;
+    while (!m_closing && !backpressured()) {
+        size_t consumed = 0;
+        Clock::time_point started = Clock::now();
+        ParseResult result = m_parser.parse(m_input.data() + m_start, m_filled - m_start, request, consumed);
+        if (result == PARSE_INCOMPLETE) break;
+        PendingResponse pending;
+        pending.parsedAt = Clock::now();
+        if (result == PARSE_COMPLETE) {
+            metrics.parseTime.record(pending.parsedAt - started);
+            metrics.requests.add();
+            pending.response = respond(request, m_context);
+            metrics.handleTime.record_since(pending.parsedAt);
+            m_start += consumed;
+        }
+        else {
+            metrics.badRequests.add();
+            pending.response = errorResponse(result);
+        }
+        pending.resolve();
+        m_closing = pending.response.close;
+        m_output.push_back(std::move(pending));
+        metrics.responsesQueued.add();
+        answered = true;
+    }
+    if (m_start == m_filled) {
+        m_start = 0;
+        m_filled = 0;
+    }
+    return answered;
+}
+
+int HttpConnection::gatherMemory(iovec* parts, int maxParts, bool& fileFollows) {
+    int partsAmount = 0;
+    fileFollows = false;
+    for (PendingResponse& pending : m_output) {
+        if (partsAmount + 2 > maxParts || !pending.resolve()) break;
+        size_t skip = pending.memorySent;
+        for (std::string_view piece : { std::string_view(pending.response.head), pending.response.body }) {
+            if (skip >= piece.size()) {
+                skip -= piece.size();
+                continue;
+            }
+            parts[partsAmount++] = { const_cast<char*>(piece.data()) + skip, piece.size() - skip };
+            skip = 0;
+        }
+        if (pending.fileSent < pending.response.fileLength) {
+            fileFollows = true;
+            break;
+        }
+    }
+    return partsAmount;
+}
+
+bool HttpConnection::computing() const {
+    return std::any_of(m_output.begin(), m_output.end(), [](const PendingResponse& pending) { return !pending.response.resolved(); });
+}
+
+void HttpConnection::memorySent(size_t length) {
+    httpMetrics().bytesSent.add(static_cast<int64_t>(length));
+    for (PendingResponse& pending : m_output) {
+        if (length == 0) break;
+        size_t take = std::min(length, pending.response.memoryLength() - pending.memorySent);
+        pending.memorySent += take;
+        length -= take;
+    }
+}
+
+void HttpConnection::fileSent(PendingResponse& pending, uint64_t length) {
+    pending.fileSent += length;
+    httpMetrics().bytesSent.add(static_cast<int64_t>(length));
+}
+
+void HttpConnection::responseSent(const PendingResponse& pending) {
+    const HttpMetrics& metrics = httpMetrics();
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    metrics.sendTime.record(now - pending.readyAt);
+    metrics.requestTime.record(now - pending.parsedAt);
+    metrics.responsesQueued.sub();
+}
+
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <sys/uio.h>
+#include <vector>
+#include "http_handler.h"
+#include "http_parser.h"
+
+// A response on its way out: the in-memory part first, then the file region, with how
+// far each has got.
+struct PendingResponse {
+    HttpResponse response;
+    size_t memorySent = 0;
+    uint64_t fileSent = 0;
+    // Opened by the transport when the file part is reached: a descriptor for the epoll
+    // server, a file table slot for io_uring. Closed by the transport as well.
+    int file = -1;
+    // When the request was parsed and when the response was complete: at once, or when
+    // a deferred one resolved. For the request and send timings.
+    std::chrono::steady_clock::time_point parsedAt;
+    std::chrono::steady_clock::time_point readyAt;
+
+    // response.resolve(), noting when it first succeeds.
+    bool resolve() {
+        if (readyAt == std::chrono::steady_clock::time_point()) {
+            if (!response.resolve()) return false;
+            readyAt = std::chrono::steady_clock::now();
+        }
+        return true;
+    }
+    bool memoryDone() const { return response.resolved() && memorySent == response.memoryLength(); }
+    bool done() const { return memoryDone() && fileSent == response.fileLength; }
+};
+
+// Connections of a reactor whose deferred responses became ready. Compute workers add to
+// it, and wake the reactor through an eventfd it always has a read or poll pending on.
+class ReadyConnections {
+public:
+    ReadyConnections();
+    ~ReadyConnections();
+    ReadyConnections(const ReadyConnections&) = delete;
+    ReadyConnections& operator=(const ReadyConnections&) = delete;
+
+    // `connection` is the reactor's own id for it: a descriptor or a file table slot.
+    // The connection may be gone, or the id reused, by the time the reactor looks.
+    void push(unsigned connection);
+    std::vector<unsigned> take();
+    int fd() const { return m_eventFd; }
+
+private:
+    int m_eventFd;
+    std::mutex m_lock;
+    std::vector<unsigned> m_connections;
+};
+
+// Protocol state of one keep-alive connection for the event-driven servers, whatever
+// moves its bytes: requests received and not yet answered, and answers not yet sent.
+class HttpConnection {
+public:
+    // Pipelined requests answered ahead of the client reading the answers. Beyond this
+    // parsing stops, and the transport stops reading, until the output drains.
+    static constexpr size_t MAX_QUEUED_RESPONSES = 64;
+
+    HttpConnection();
+    ~HttpConnection();
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // Passed to the handler with every request; see ResponseContext.
+    void setContext(ResponseContext context) { m_context = std::move(context); }
+    // A process-wide unique ResponseContext::client.
+    static uint64_t newClientId();
+
+    // Free space at the end of the receive buffer, after compacting or growing it. Empty
+    // when reading should pause: answers are queued and the buffer is full of requests
+    // that are not parsed yet.
+    std::span<char> receiveSpace();
+    void received(size_t length);
+    // Copies bytes received elsewhere (a provided buffer), growing as needed.
+    void append(const char* data, size_t length);
+
+    // Queues answers to the complete requests received. True if any was queued.
+    bool parseRequests();
+    bool backpressured() const { return m_output.size() >= MAX_QUEUED_RESPONSES; }
+
+    // Unsent in-memory parts of the queued responses, in order, as far as the first
+    // file part or deferred response still being computed; `fileFollows` is set when it
+    // stopped at a file part.
+    int gatherMemory(iovec* parts, int maxParts, bool& fileFollows);
+    // Records `length` bytes of what gatherMemory returned as sent.
+    void memorySent(size_t length);
+    // Records `length` more bytes of the file part of `pending` as sent.
+    void fileSent(PendingResponse& pending, uint64_t length);
+    // Drops finished responses from the front, handing each to `finished` first.
+    template <typename finished_t>
+    void popDone(finished_t&& finished) {
+        while (!m_output.empty() && m_output.front().done()) {
+            finished(m_output.front());
+            responseSent(m_output.front());
+            m_output.pop_front();
+        }
+    }
+
+    std::deque<PendingResponse>& output() { return m_output; }
+    // A deferred response is being computed; the connection is waiting for it, not idle.
+    bool computing() const;
+    // A response that closes the connection, or an unparsable request, was queued:
+    // nothing more is parsed, and the connection is closed once the output is sent.
+    bool closing() const { return m_closing; }
+
+private:
+    void responseSent(const PendingResponse& pending);
+
+    std::vector<char> m_input;
+    size_t m_start = 0; // first unparsed byte of m_input
+    size_t m_filled = 0;
+    RequestParser m_parser;
+    ResponseContext m_context;
+    std::deque<PendingResponse> m_output;
+    bool m_closing = false;
+};
+
+#endif
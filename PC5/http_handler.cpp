@@ -0,0 +1,110 @@
+#include "http_handler.h"
+#include "async_logger.h"
+#include "compute_endpoints.h"
+#include "http_metrics.h"
+
+namespace {
+
+const std::string notFoundResponse = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+const std::string methodNotAllowedResponse = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\n\r\n";
+const std::string badRequestResponse = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+const std::string headTooLargeResponse = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+const std::string bodyTooLargeResponse = "HTTP/1.1 413 Content Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+FileCache fileCache(".");
+
+// The metrics in the Prometheus text format, fresh on every scrape.
+HttpResponse metricsResponse(const HttpRequest& request) {
+    HttpResponse response;
+    response.close = !request.keepAlive;
+    if (request.method != "GET") {
+        response.body = methodNotAllowedResponse;
+        return response;
+    }
+    std::string text = metrics_text();
+    response.head = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nCache-Control: no-store\r\nContent-Length: "
+        + std::to_string(text.size()) + "\r\n\r\n" + text;
+    return response;
+}
+
+// 200, 206 or 416 for a GET of `file`, honouring Range and If-Range.
+void respondWithFile(const HttpRequest& request, const std::shared_ptr<const CachedFile>& file, HttpResponse& response) {
+    uint64_t first = 0, last = 0;
+    RangeResult range = parseRange(request.header("Range"), file->bodyLength, first, last);
+    std::string_view ifRange = request.header("If-Range");
+    if (!ifRange.empty() && ifRange != file->etag) range = RANGE_NONE;
+
+    if (range == RANGE_UNSATISFIABLE) {
+        response.head = rangeNotSatisfiableResponse(*file);
+        return;
+    }
+    response.file = file;
+    if (range == RANGE_NONE) {
+        response.body = file->response;
+        if (file->streamed) {
+            response.filePath = file->fullPath;
+            response.fileLength = file->bodyLength;
+        }
+        return;
+    }
+    response.head = partialContentHead(*file, first, last);
+    if (file->streamed) {
+        response.filePath = file->fullPath;
+        response.fileOffset = first;
+        response.fileLength = last - first + 1;
+    }
+    else {
+        response.body = std::string_view(file->response).substr(file->bodyOffset + first, static_cast<size_t>(last - first + 1));
+    }
+}
+
+}
+
+HttpResponse respond(const HttpRequest& request, const ResponseContext& context) {
+    serverLog().log("Received request: %.*s %.*s %.*s", static_cast<int>(request.method.size()), request.method.data(),
+        static_cast<int>(request.target.size()), request.target.data(), static_cast<int>(request.version.size()), request.version.data());
+
+    if (isComputePath(request.path)) return computeResponse(request, context);
+    if (request.path == "/metrics") return metricsResponse(request);
+
+    HttpResponse response;
+    response.close = !request.keepAlive;
+    if (request.method != "GET") {
+        response.body = methodNotAllowedResponse;
+        return response;
+    }
+    std::shared_ptr<const CachedFile> file;
+    std::string_view path = request.path;
+    if (!path.empty() && path[0] == '/' && path.find("..") == std::string_view::npos) {
+        file = fileCache.get(path == "/" ? "/index.html" : path);
+    }
+
+    // Ranges are served from the identity body only.
+    const EncodedVariant* variant = nullptr;
+    if (file && request.header("Range").empty()) variant = preferredVariant(*file, request.header("Accept-Encoding"));
+
+    if (!file) {
+        response.body = notFoundResponse;
+    }
+    else if (variant) {
+        response.file = file;
+        response.body = etagMatches(request.header("If-None-Match"), variant->etag) ? variant->notModified : variant->response;
+    }
+    else if (etagMatches(request.header("If-None-Match"), file->etag)) {
+        response.file = file;
+        response.body = file->notModified;
+    }
+    else {
+        respondWithFile(request, file, response);
+    }
+    return response;
+}
+
+HttpResponse errorResponse(ParseResult result) {
+    HttpResponse response;
+    response.close = true;
+    if (result == PARSE_HEAD_TOO_LARGE) response.body = headTooLargeResponse;
+    else if (result == PARSE_BODY_TOO_LARGE) response.body = bodyTooLargeResponse;
+    else response.body = badRequestResponse;
+    return response;
+}
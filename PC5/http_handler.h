@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "file_cache.h"
+#include "http_parser.h"
+
+// Request bodies up to this size are accepted, for the compute endpoints.
+constexpr size_t MAX_REQUEST_BODY = size_t(16) << 20;
+
+// A complete response produced off the connection's thread, by the compute pool.
+class DeferredResponse {
+public:
+    bool ready() const { return m_ready.load(std::memory_order_acquire); }
+    void wait() const { m_ready.wait(false, std::memory_order_acquire); }
+    const std::string& response() const { return m_response; }
+    // Called once, by whoever computed it.
+    void complete(std::string response) {
+        m_response = std::move(response);
+        m_ready.store(true, std::memory_order_release);
+        m_ready.notify_all();
+    }
+
+private:
+    std::string m_response;
+    std::atomic<bool> m_ready{ false };
+};
+
+// The connection a request came on, for responses that are deferred: `client` is who the
+// compute pool shares its workers fairly between, and `wake` tells the transport that a
+// deferred response of the connection is ready. It is called on a compute worker.
+struct ResponseContext {
+    uint64_t client = 0;
+    std::function<void()> wake;
+};
+
+// What to send for one request, independent of how the transport sends it: `head`,
+// then `body`, then `fileLength` bytes of `filePath` from `fileOffset`. Most responses
+// are a `body` alone, pointing into a cached response or a constant.
+struct HttpResponse {
+    std::string head;                       // built for this request, if anything was
+    std::shared_ptr<const CachedFile> file; // keeps `body` alive
+    std::string_view body;
+    std::string filePath;
+    uint64_t fileOffset = 0;
+    uint64_t fileLength = 0;
+    // The connection is closed once this response is out.
+    bool close = false;
+    // Set when the response is computed elsewhere: `body` stays empty until resolve()
+    // finds it ready, and nothing queued behind it is sent before it.
+    std::shared_ptr<DeferredResponse> deferred;
+
+    size_t memoryLength() const { return head.size() + body.size(); }
+    bool resolved() const { return !deferred || !body.empty(); }
+    // False while a deferred response is being computed; once it is ready, takes it as
+    // `body`.
+    bool resolve() {
+        if (resolved()) return true;
+        if (!deferred->ready()) return false;
+        body = deferred->response();
+        return true;
+    }
+};
+
+// Routes a parsed request (static files for GET, the compute endpoints for POST, the
+// server's metrics on GET /metrics) and logs it.
+HttpResponse respond(const HttpRequest& request, const ResponseContext& context);
+// Reply to a request that could not be parsed; the connection closes after it.
+HttpResponse errorResponse(ParseResult result);
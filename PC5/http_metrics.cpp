@@ -0,0 +1,6 @@
+#include "http_metrics.h"
+
+const HttpMetrics& httpMetrics() {
+    static const HttpMetrics metrics;
+    return metrics;
+}
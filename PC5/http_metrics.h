@@ -0,0 +1,34 @@
+#pragma once
+#include "../common/metrics.h"
+#include "compute_endpoints.h"
+
+// What the server measures, served on GET /metrics. The phases of a request are timed
+// apart, so a slow response can be put down to the network, parsing, the handler or the
+// compute pool:
+//   parse    the parser call that completed the request
+//   handle   routing it and building the response, a file cache lookup for static files
+//   compute  a compute endpoint from admission to its result, queueing included
+//   send     the response being complete to its last byte written, which includes
+//            waiting behind responses pipelined ahead of it
+// and pc5_request_seconds spans all of them.
+struct HttpMetrics {
+    metric_counter connectionsAccepted{ "pc5_connections_accepted_total", "Connections accepted." };
+    metric_gauge connectionsOpen{ "pc5_connections_open", "Connections open." };
+    metric_counter bytesReceived{ "pc5_received_bytes_total", "Bytes read from clients." };
+    metric_counter bytesSent{ "pc5_sent_bytes_total", "Bytes written to clients, file bodies included." };
+    metric_counter requests{ "pc5_requests_total", "Requests parsed." };
+    metric_counter badRequests{ "pc5_bad_requests_total", "Requests that could not be parsed." };
+    metric_gauge responsesQueued{ "pc5_responses_queued", "Responses waiting to be sent: pipelined, or being computed." };
+    metric_counter computeRejected{ "pc5_compute_rejected_total", "Compute requests answered 503 for their latency budget." };
+    metric_histogram parseTime{ "pc5_phase_seconds", "Time a request spends in each phase.", "phase=\"parse\"" };
+    metric_histogram handleTime{ "pc5_phase_seconds", "Time a request spends in each phase.", "phase=\"handle\"" };
+    metric_histogram computeTime{ "pc5_phase_seconds", "Time a request spends in each phase.", "phase=\"compute\"" };
+    metric_histogram sendTime{ "pc5_phase_seconds", "Time a request spends in each phase.", "phase=\"send\"" };
+    metric_histogram requestTime{ "pc5_request_seconds", "From a request being parsed to the last byte of its response written." };
+    sampled_gauge computeJobs{ "pc5_compute_queued_jobs", "Compute requests accepted by the pool and not finished.",
+        []() { return static_cast<double>(computeBacklog().jobs); } };
+    sampled_gauge computeElements{ "pc5_compute_queued_elements", "Elements of the compute requests accepted and not finished.",
+        []() { return static_cast<double>(computeBacklog().elements); } };
+};
+
+const HttpMetrics& httpMetrics();
@@ -0,0 +1,126 @@
+#include "http_parser.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return lower(x) == lower(y); });
+}
+
+// Whether a comma-separated header value such as Connection lists `token`.
+bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        size_t begin = item.find_first_not_of(" \t");
+        size_t end = item.find_last_not_of(" \t");
+        if (begin != std::string_view::npos && equalsIgnoreCase(item.substr(begin, end - begin + 1), token)) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool isTokenChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+bool isToken(std::string_view text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c != '\0' && isTokenChar(c); });
+}
+
+std::string_view trimSpaces(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) return {};
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(begin, end - begin + 1);
+}
+
+// Request line and headers of `head` (without the blank line). False if malformed.
+bool parseHead(std::string_view head, HttpRequest& request, uint64_t& contentLength) {
+    size_t lineEnd = head.find("\r\n");
+    std::string_view line = head.substr(0, lineEnd);
+    head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+
+    size_t firstSpace = line.find(' ');
+    size_t secondSpace = firstSpace == std::string_view::npos ? firstSpace : line.find(' ', firstSpace + 1);
+    if (secondSpace == std::string_view::npos) return false;
+    request.method = line.substr(0, firstSpace);
+    request.target = line.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+    request.version = line.substr(secondSpace + 1);
+    if (!isToken(request.method) || request.target.empty() || request.target.find(' ') != std::string_view::npos) return false;
+    if (request.version != "HTTP/1.1" && request.version != "HTTP/1.0") return false;
+    request.path = request.target.substr(0, request.target.find('?'));
+
+    request.headerCount = 0;
+    contentLength = 0;
+    bool sawLength = false;
+    while (!head.empty()) {
+        lineEnd = head.find("\r\n");
+        line = head.substr(0, lineEnd);
+        head.remove_prefix(lineEnd == std::string_view::npos ? head.size() : lineEnd + 2);
+        size_t colon = line.find(':');
+        // No obsolete line folding, and no space before the colon (RFC 9112, 5.1).
+        if (colon == std::string_view::npos || !isToken(line.substr(0, colon))) return false;
+        if (request.headerCount == MAX_REQUEST_HEADERS) return false;
+        HttpHeader& header = request.headers[request.headerCount++];
+        header.name = line.substr(0, colon);
+        header.value = trimSpaces(line.substr(colon + 1));
+
+        if (equalsIgnoreCase(header.name, "Transfer-Encoding")) return false; // chunked bodies are not supported
+        if (equalsIgnoreCase(header.name, "Content-Length")) {
+            if (header.value.empty() || header.value.size() > 18 || header.value.find_first_not_of("0123456789") != std::string_view::npos) return false;
+            uint64_t length = 0;
+            for (char digit : header.value) length = length * 10 + static_cast<uint64_t>(digit - '0');
+            if (sawLength && length != contentLength) return false;
+            contentLength = length;
+            sawLength = true;
+        }
+    }
+    request.keepAlive = request.version == "HTTP/1.1" && !hasToken(request.header("Connection"), "close");
+    return true;
+}
+
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < headerCount; i++) {
+        if (equalsIgnoreCase(headers[i].name, name)) return headers[i].value;
+    }
+    return {};
+}
+
+ParseResult RequestParser::parse(const char* data, size_t length, HttpRequest& request, size_t& consumed) {
+    std::string_view buffer(data, length);
+    // Empty lines before a request line are allowed (RFC 9112, 2.2); they are consumed
+    // along with the request.
+    size_t start = 0;
+    while (start + 1 < buffer.size() && buffer[start] == '\r' && buffer[start + 1] == '\n') start += 2;
+
+    if (m_headEnd == 0) {
+        size_t from = std::max(m_scanned, start + 3) - 3;
+        size_t blank = buffer.find("\r\n\r\n", from);
+        if (blank == std::string_view::npos) {
+            m_scanned = length;
+            return length - start > MAX_REQUEST_HEAD ? PARSE_HEAD_TOO_LARGE : PARSE_INCOMPLETE;
+        }
+        if (blank + 4 - start > MAX_REQUEST_HEAD) return PARSE_HEAD_TOO_LARGE;
+        m_headEnd = blank + 4;
+    }
+
+    uint64_t contentLength = 0;
+    if (!parseHead(buffer.substr(start, m_headEnd - 4 - start), request, contentLength)) return PARSE_BAD_REQUEST;
+    if (contentLength > m_maxBodySize) return PARSE_BODY_TOO_LARGE;
+    if (length - m_headEnd < contentLength) return PARSE_INCOMPLETE;
+
+    request.body = buffer.substr(m_headEnd, static_cast<size_t>(contentLength));
+    consumed = m_headEnd + static_cast<size_t>(contentLength);
+    m_scanned = 0;
+    m_headEnd = 0;
+    return PARSE_COMPLETE;
+}
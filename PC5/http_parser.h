@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// HTTP/1.1 request parsing over a connection's receive buffer. Nothing is copied or
+// allocated: the request is a set of views into the buffer, valid until the buffer is
+// compacted or refilled.
+
+constexpr size_t MAX_REQUEST_HEADERS = 32;
+// Request line and headers together; a longer head is answered 431.
+constexpr size_t MAX_REQUEST_HEAD = 8192;
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;  // as sent, query included
+    std::string_view path;    // target without the query
+    std::string_view version; // "HTTP/1.1"
+    HttpHeader headers[MAX_REQUEST_HEADERS];
+    size_t headerCount = 0;
+    std::string_view body;    // Content-Length bytes after the head
+    // HTTP/1.1 without "Connection: close". HTTP/1.0 connections are closed after one
+    // request, since the cached responses do not carry "Connection: keep-alive".
+    bool keepAlive = false;
+
+    // First header called `name`, compared case-insensitively; empty when absent.
+    std::string_view header(std::string_view name) const;
+};
+
+enum ParseResult {
+    PARSE_INCOMPLETE, // need more bytes
+    PARSE_COMPLETE,
+    PARSE_BAD_REQUEST,
+    PARSE_HEAD_TOO_LARGE,
+    PARSE_BODY_TOO_LARGE,
+};
+
+// Finds one request at the start of a buffer that grows between calls. The end of the
+// head is searched for only in bytes not seen before, so a request trickling in over
+// many reads is still scanned once.
+class RequestParser {
+public:
+    explicit RequestParser(size_t maxBodySize = 1 << 20) : m_maxBodySize(maxBodySize) {}
+
+    // On PARSE_COMPLETE, `request` describes the first `consumed` bytes of `data`. The
+    // caller drops those bytes before parsing the next (pipelined) request.
+    ParseResult parse(const char* data, size_t length, HttpRequest& request, size_t& consumed);
+
+private:
+    size_t m_maxBodySize;
+    size_t m_scanned = 0;  // bytes known not to complete "\r\n\r\n"
+    size_t m_headEnd = 0;  // past the blank line, once found
+};
@@ -0,0 +1,347 @@
+#include "reactor_server.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "async_logger.h"
+#include "http_connection.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int MAX_EVENTS = 256;
+const int MAX_IOVECS = 64;
+// epoll_wait timeout, and how often idle connections are looked for.
+const int SWEEP_INTERVAL_MS = 500;
+
+enum ReadResult {
+    READ_DRAINED, // EAGAIN: wait for the next edge
+    READ_FULL,    // stopped with data left in the socket, see ReactorConnection::readPending
+    READ_EOF,
+    READ_ERROR,
+};
+
+struct ReactorConnection : HttpConnection {
+    int fd = -1;
+    // The client shut down its side. Requests already buffered are still answered.
+    bool inputEnded = false;
+    // Reading stopped under backpressure before the socket was drained, so no new edge
+    // will come for what is already there.
+    bool readPending = false;
+    Clock::time_point lastActive;
+};
+
+void closeFile(PendingResponse& pending) {
+    if (pending.file >= 0) {
+        close(pending.file);
+        pending.file = -1;
+    }
+}
+
+
+class Reactor {
+public:
+    Reactor(int listenFd, int epollFd, int idleTimeoutMs)
+        : m_listenFd(listenFd), m_epollFd(epollFd), m_idleTimeout(std::chrono::milliseconds(idleTimeoutMs)),
+          m_ready(std::make_shared<ReadyConnections>()) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = m_ready->fd();
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_ready->fd(), &event);
+    }
+
+    ~Reactor() {
+        for (auto& entry : m_connections) {
+            for (PendingResponse& pending : entry.second->output()) closeFile(pending);
+            close(entry.first);
+        }
+        close(m_listenFd);
+        close(m_epollFd);
+    }
+
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        Clock::time_point nextSweep = Clock::now() + std::chrono::milliseconds(SWEEP_INTERVAL_MS);
+        while (true) {
+            int ready = epoll_wait(m_epollFd, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+            if (ready < 0 && errno != EINTR) {
+                std::cerr << "epoll_wait failed: " << std::strerror(errno) << "\n";
+                return;
+            }
+            for (int i = 0; i < ready; i++) {
+                if (events[i].data.fd == m_listenFd) {
+                    acceptAll();
+                }
+                else if (events[i].data.fd == m_ready->fd()) {
+                    serviceReady();
+                }
+                else {
+                    handleEvent(events[i].data.fd, events[i].events);
+                }
+            }
+            Clock::time_point now = Clock::now();
+            if (now >= nextSweep) {
+                dropIdle(now);
+                nextSweep = now + std::chrono::milliseconds(SWEEP_INTERVAL_MS);
+            }
+        }
+    }
+
+private:
+    void acceptAll() {
+        while (true) {
+            sockaddr_in clientAddr{};
+            socklen_t clientAddrLen = sizeof(clientAddr);
+            int fd = accept4(m_listenFd, reinterpret_cast<sockaddr*>(&clientAddr), &clientAddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "Accept failed: " << std::strerror(errno) << "\n";
+                }
+                return;
+            }
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.fd = fd;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                std::cerr << "epoll_ctl failed: " << std::strerror(errno) << "\n";
+                close(fd);
+                continue;
+            }
+            auto connection = std::make_unique<ReactorConnection>();
+            connection->fd = fd;
+            connection->lastActive = Clock::now();
+            ResponseContext context;
+            context.client = HttpConnection::newClientId();
+            context.wake = [ready = m_ready, fd]() { ready->push(static_cast<unsigned>(fd)); };
+            connection->setContext(std::move(context));
+            m_connections[fd] = std::move(connection);
+
+            char clientAddrStr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &clientAddr.sin_addr, clientAddrStr, INET_ADDRSTRLEN);
+            serverLog().log("Connection accepted on socket %d from %s:%u", fd, clientAddrStr, ntohs(clientAddr.sin_port));
+        }
+    }
+
+    void handleEvent(int fd, uint32_t events) {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end()) return;
+        ReactorConnection& connection = *it->second;
+        if (events & EPOLLERR) {
+            drop(fd);
+            return;
+        }
+        bool readable = (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0;
+        if (!service(connection, readable)) {
+            drop(fd);
+        }
+    }
+
+    // Sends the deferred responses that became ready.
+    void serviceReady() {
+        uint64_t count;
+        while (read(m_ready->fd(), &count, sizeof(count)) < 0 && errno == EINTR) {
+        }
+        for (unsigned id : m_ready->take()) {
+            int fd = static_cast<int>(id);
+            auto it = m_connections.find(fd);
+            if (it != m_connections.end() && !service(*it->second, false)) drop(fd);
+        }
+    }
+
+    // Reads, answers and writes until the connection has to wait for the socket.
+    // False when it should be closed.
+    bool service(ReactorConnection& connection, bool readable) {
+        while (true) {
+            if ((readable || connection.readPending) && !connection.closing() && !connection.inputEnded) {
+                readable = false;
+                ReadResult result = readSome(connection);
+                if (result == READ_ERROR) return false;
+                connection.inputEnded = result == READ_EOF;
+                connection.readPending = result == READ_FULL;
+            }
+            bool answered = connection.parseRequests();
+            if (!flush(connection)) return false;
+            if (!connection.output().empty()) return true; // EPOLLOUT or the compute pool resumes
+            if (connection.closing()) return false;
+            // Output drained: go on if that released backpressure, else wait for input.
+            if (!connection.readPending && !answered) return !connection.inputEnded;
+        }
+    }
+
+    ReadResult readSome(ReactorConnection& connection) {
+        while (true) {
+            std::span<char> space = connection.receiveSpace();
+            if (space.empty()) return READ_FULL;
+            ssize_t received = recv(connection.fd, space.data(), space.size(), 0);
+            if (received > 0) {
+                connection.received(static_cast<size_t>(received));
+                connection.lastActive = Clock::now();
+                continue;
+            }
+            if (received == 0) return READ_EOF;
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? READ_DRAINED : READ_ERROR;
+        }
+    }
+
+    // Writes queued responses until done or EAGAIN. In-memory parts of consecutive
+    // responses go out in one sendmsg; a file body follows its head through sendfile,
+    // corked onto it with MSG_MORE. False if the connection failed.
+    bool flush(ReactorConnection& connection) {
+        std::deque<PendingResponse>& output = connection.output();
+        while (!output.empty()) {
+            PendingResponse& front = output.front();
+            if (!front.resolve()) return true;
+            if (!front.memoryDone()) {
+                iovec parts[MAX_IOVECS];
+                bool fileFollows = false;
+                msghdr message{};
+                message.msg_iov = parts;
+                message.msg_iovlen = connection.gatherMemory(parts, MAX_IOVECS, fileFollows);
+                ssize_t sent = sendmsg(connection.fd, &message, MSG_NOSIGNAL | (fileFollows ? MSG_MORE : 0));
+                if (sent < 0) {
+                    if (errno == EINTR) continue;
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                connection.lastActive = Clock::now();
+                connection.memorySent(static_cast<size_t>(sent));
+            }
+            else if (!front.done()) {
+                if (front.file < 0) {
+                    front.file = open(front.response.filePath.c_str(), O_RDONLY | O_CLOEXEC);
+                    // The head is already out, so there is no other answer left to give.
+                    if (front.file < 0) return false;
+                }
+                off_t offset = static_cast<off_t>(front.response.fileOffset + front.fileSent);
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(front.response.fileLength - front.fileSent, size_t(1) << 30));
+                ssize_t sent = sendfile(connection.fd, front.file, &offset, chunk);
+                if (sent < 0) {
+                    if (errno == EINTR) continue;
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                // 0: the file shrank under us and the promised length cannot be met.
+                if (sent == 0) return false;
+                connection.lastActive = Clock::now();
+                connection.fileSent(front, static_cast<uint64_t>(sent));
+            }
+            connection.popDone(closeFile);
+        }
+        return true;
+    }
+
+    void dropIdle(Clock::time_point now) {
+        std::vector<int> idle;
+        for (const auto& entry : m_connections) {
+            if (now - entry.second->lastActive >= m_idleTimeout && !entry.second->computing()) idle.push_back(entry.first);
+        }
+        for (int fd : idle) drop(fd);
+    }
+
+    void drop(int fd) {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end()) return;
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        for (PendingResponse& pending : it->second->output()) closeFile(pending);
+        close(fd);
+        m_connections.erase(it);
+        serverLog().log("Socket closed: %d", fd);
+    }
+
+    int m_listenFd;
+    int m_epollFd;
+    Clock::duration m_idleTimeout;
+    std::shared_ptr<ReadyConnections> m_ready; // shared with the wake-ups of pending computations
+    std::unordered_map<int, std::unique_ptr<ReactorConnection>> m_connections;
+};
+
+}
+
+int openListenSocket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Socket creation failed: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        std::cerr << "SO_REUSEPORT failed: " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serverAddr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0) {
+        std::cerr << "Bind failed: " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "Listen failed: " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool runReactorServer(uint16_t port, size_t reactorsAmount, int idleTimeoutMs) {
+    if (reactorsAmount == 0) reactorsAmount = 1;
+    // sendfile has no MSG_NOSIGNAL; a client that went away must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    for (size_t i = 0; i < reactorsAmount; i++) {
+        int listenFd = openListenSocket(port);
+        if (listenFd < 0) return false;
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = listenFd;
+        if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+            std::cerr << "epoll setup failed: " << std::strerror(errno) << "\n";
+            close(listenFd);
+            if (epollFd >= 0) close(epollFd);
+            return false;
+        }
+        reactors.push_back(std::make_unique<Reactor>(listenFd, epollFd, idleTimeoutMs));
+    }
+
+    std::cout << "Server listening on port " << port << " (epoll, " << reactorsAmount << " reactors)...\n";
+
+    std::vector<std::thread> threads;
+    for (auto& reactor : reactors) {
+        threads.emplace_back([&reactor]() { reactor->run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+
+// Event-driven HTTP server for Linux. Each of `reactorsAmount` threads owns an
+// edge-triggered epoll instance and its own listening socket bound with SO_REUSEPORT,
+// so the kernel spreads connections over the reactors and they share no locks. Sockets
+// are non-blocking; a connection is a receive buffer and a queue of responses, not a
+// thread. Keep-alive connections idle for `idleTimeoutMs` are closed. Runs until
+// setup fails (false) or the process is stopped.
+bool runReactorServer(uint16_t port, size_t reactorsAmount, int idleTimeoutMs);
+
+// Non-blocking listening socket with SO_REUSEPORT, one per reactor; -1 after logging
+// why not.
+int openListenSocket(uint16_t port);
+
+#endif
@@ -0,0 +1,415 @@
+#include "uring_server.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../common/io_ring.h"
+#include "async_logger.h"
+#include "http_connection.h"
+#include "reactor_server.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const unsigned RING_ENTRIES = 1024;
+// File table slots per reactor: sockets, then files being streamed.
+const unsigned MAX_CONNECTIONS = 4096;
+const unsigned MAX_OPEN_FILES = 256;
+const unsigned FILE_BUFFERS = 32;
+const size_t FILE_BUFFER_SIZE = 65536;
+const unsigned RECEIVE_BUFFERS = 256;
+const size_t RECEIVE_BUFFER_SIZE = 16384;
+// Read→send pairs linked into one submission. A link runs strictly in order, so the
+// pairs take turns on the same buffer.
+const int FILE_CHUNKS_PER_CHAIN = 8;
+const int MAX_IOVECS = 64;
+// Longest wait for completions, and how often idle connections are looked for.
+const int SWEEP_INTERVAL_MS = 500;
+// Before a failed multishot accept (file table full) is armed again.
+const auto ACCEPT_RETRY_DELAY = std::chrono::milliseconds(100);
+
+// user_data of an SQE: what it was for, and the socket slot it was for.
+enum Operation : uint64_t {
+    OP_IGNORE, // cancels and closes, nothing waits for them
+    OP_ACCEPT,
+    OP_RECV,
+    OP_WRITE,
+    OP_READY, // the ReadyConnections eventfd
+};
+
+uint64_t userData(Operation operation, unsigned slot) {
+    return (static_cast<uint64_t>(operation) << 32) | slot;
+}
+
+// A connection lives, slot and all, until every operation submitted for it has
+// completed; the kernel may still be filling or reading its buffers until then.
+struct UringConnection : HttpConnection {
+    unsigned slot = 0;
+    bool inputEnded = false;
+    bool recvArmed = false;
+    bool recvCancelled = false;
+    bool dropped = false;
+    // The write chain in flight: SQEs not completed yet, whether one failed, and what
+    // it has sent once all succeeded.
+    int chainOps = 0;
+    bool chainFailed = false;
+    size_t chainMemory = 0;
+    PendingResponse* chainFileTarget = nullptr;
+    uint64_t chainFile = 0;
+    int buffer = -1;
+    iovec parts[MAX_IOVECS];
+    msghdr message{};
+    Clock::time_point lastActive;
+};
+
+class UringReactor {
+public:
+    UringReactor(int listenFd, int idleTimeoutMs)
+        : m_listenFd(listenFd), m_idleTimeout(std::chrono::milliseconds(idleTimeoutMs)), m_ready(std::make_shared<ReadyConnections>()) {}
+
+    ~UringReactor() {
+        // The ring goes first: closing it ends the operations and the file table.
+        m_ring.reset();
+        close(m_listenFd);
+    }
+
+    // Runs on the reactor's own thread, which the ring is created on and tied to.
+    void run() {
+        io_ring::config settings;
+        settings.entries = RING_ENTRIES;
+        settings.direct_sockets = MAX_CONNECTIONS;
+        settings.direct_files = MAX_OPEN_FILES;
+        settings.fixed_buffers = FILE_BUFFERS;
+        settings.fixed_buffer_size = FILE_BUFFER_SIZE;
+        settings.recv_buffers = RECEIVE_BUFFERS;
+        settings.recv_buffer_size = RECEIVE_BUFFER_SIZE;
+        m_ring = io_ring::create(settings);
+        if (m_ring == nullptr) {
+            std::cerr << "io_uring setup failed: " << std::strerror(errno) << "\n";
+            return;
+        }
+        m_connections.resize(MAX_CONNECTIONS);
+        armAccept();
+        armReady();
+
+        Clock::time_point nextSweep = Clock::now() + std::chrono::milliseconds(SWEEP_INTERVAL_MS);
+        while (true) {
+            if (!m_ring->submit_and_wait(SWEEP_INTERVAL_MS)) {
+                std::cerr << "io_uring_enter failed: " << std::strerror(errno) << "\n";
+                return;
+            }
+            m_ring->reap([this](const io_uring_cqe& cqe) { complete(cqe); });
+
+            Clock::time_point now = Clock::now();
+            if (!m_acceptArmed && now >= m_acceptRetry) armAccept();
+            if (now >= nextSweep) {
+                dropIdle(now);
+                nextSweep = now + std::chrono::milliseconds(SWEEP_INTERVAL_MS);
+            }
+        }
+    }
+
+private:
+    void complete(const io_uring_cqe& cqe) {
+        unsigned slot = static_cast<uint32_t>(cqe.user_data);
+        switch (static_cast<Operation>(cqe.user_data >> 32)) {
+        case OP_ACCEPT:
+            accepted(cqe);
+            break;
+        case OP_RECV:
+            received(*m_connections[slot], cqe);
+            break;
+        case OP_WRITE:
+            written(*m_connections[slot], cqe);
+            break;
+        case OP_READY:
+            for (unsigned ready : m_ready->take()) {
+                if (m_connections[ready] != nullptr && !m_connections[ready]->dropped) service(*m_connections[ready]);
+            }
+            armReady();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void armAccept() {
+        m_ring->multishot_accept(m_listenFd, userData(OP_ACCEPT, 0));
+        m_acceptArmed = true;
+    }
+
+    void armReady() {
+        m_ring->read(m_ready->fd(), false, &m_readyCount, sizeof(m_readyCount), UINT64_MAX, userData(OP_READY, 0));
+    }
+
+    void accepted(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            m_acceptArmed = false;
+            m_acceptRetry = Clock::now() + (cqe.res < 0 ? ACCEPT_RETRY_DELAY : Clock::duration::zero());
+        }
+        if (cqe.res < 0) {
+            std::cerr << "Accept failed: " << std::strerror(-cqe.res) << "\n";
+            return;
+        }
+        auto connection = std::make_unique<UringConnection>();
+        connection->slot = static_cast<unsigned>(cqe.res);
+        connection->lastActive = Clock::now();
+        ResponseContext context;
+        context.client = HttpConnection::newClientId();
+        context.wake = [ready = m_ready, slot = connection->slot]() { ready->push(slot); };
+        connection->setContext(std::move(context));
+        armRecv(*connection);
+        m_connections[connection->slot] = std::move(connection);
+        serverLog().log("Connection accepted into slot %d", cqe.res);
+    }
+
+    void armRecv(UringConnection& connection) {
+        m_ring->multishot_recv(static_cast<int>(connection.slot), true, userData(OP_RECV, connection.slot));
+        connection.recvArmed = true;
+        connection.recvCancelled = false;
+    }
+
+    void received(UringConnection& connection, const io_uring_cqe& cqe) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned id = io_ring::recv_buffer_id(cqe);
+            if (cqe.res > 0 && !connection.dropped) {
+                connection.append(reinterpret_cast<const char*>(m_ring->recv_buffer(id)), static_cast<size_t>(cqe.res));
+            }
+            m_ring->recycle_recv_buffer(id);
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) connection.recvArmed = false;
+        if (connection.dropped) {
+            settle(connection);
+            return;
+        }
+        if (cqe.res > 0) {
+            connection.lastActive = Clock::now();
+        }
+        else if (cqe.res == 0) {
+            connection.inputEnded = true;
+        }
+        // ENOBUFS: the provided buffers ran out and the recv stopped; service arms it
+        // again, by when they are back. ECANCELED: stopped under backpressure.
+        else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            drop(connection);
+            return;
+        }
+        service(connection);
+    }
+
+    // Answers what can be answered and keeps reading and writing going, or closes the
+    // connection when it is finished.
+    void service(UringConnection& connection) {
+        bool answered = connection.parseRequests();
+        startWrite(connection);
+        if (connection.chainOps == 0 && connection.output().empty() && (connection.closing() || (connection.inputEnded && !answered))) {
+            drop(connection);
+            return;
+        }
+        if (connection.backpressured()) {
+            if (connection.recvArmed && !connection.recvCancelled) {
+                m_ring->cancel(userData(OP_RECV, connection.slot), userData(OP_IGNORE, 0));
+                connection.recvCancelled = true;
+            }
+        }
+        else if (!connection.recvArmed && !connection.inputEnded && !connection.closing()) {
+            armRecv(connection);
+        }
+    }
+
+    // Submits the next write chain unless one is in flight: the in-memory parts of the
+    // queued responses in one sendmsg, and when a file part follows, linked behind it
+    // the file's open (first time) and up to FILE_CHUNKS_PER_CHAIN read→send pairs.
+    // A short read or send fails the rest of the link, and the connection with it.
+    void startWrite(UringConnection& connection) {
+        std::deque<PendingResponse>& output = connection.output();
+        if (connection.chainOps > 0 || connection.dropped || output.empty() || !output.front().resolve()) return;
+
+        int ops = 0;
+        io_uring_sqe* last = nullptr;
+        bool fileFollows = false;
+        connection.chainMemory = 0;
+        connection.chainFile = 0;
+        connection.chainFileTarget = nullptr;
+        if (!output.front().memoryDone()) {
+            int partsAmount = connection.gatherMemory(connection.parts, MAX_IOVECS, fileFollows);
+            for (int i = 0; i < partsAmount; i++) connection.chainMemory += connection.parts[i].iov_len;
+            connection.message = msghdr{};
+            connection.message.msg_iov = connection.parts;
+            connection.message.msg_iovlen = partsAmount;
+            last = m_ring->sendmsg(static_cast<int>(connection.slot), true, &connection.message,
+                MSG_NOSIGNAL | MSG_WAITALL | (fileFollows ? MSG_MORE : 0), userData(OP_WRITE, connection.slot));
+            ops++;
+        }
+        else {
+            fileFollows = true;
+        }
+
+        if (fileFollows) {
+            PendingResponse& target = *std::find_if(output.begin(), output.end(),
+                [](const PendingResponse& pending) { return pending.fileSent < pending.response.fileLength; });
+            if (connection.buffer < 0) connection.buffer = m_ring->acquire_buffer();
+            int openSlot = -1;
+            if (target.file < 0 && connection.buffer >= 0) openSlot = m_ring->acquire_file_slot();
+            if (connection.buffer < 0 || (target.file < 0 && openSlot < 0)) {
+                // Out of buffers or file slots: try again when another connection
+                // returns one, after sending the head if there is one to send.
+                if (connection.buffer >= 0) {
+                    m_ring->release_buffer(static_cast<unsigned>(connection.buffer));
+                    connection.buffer = -1;
+                }
+                m_waiting.push_back(connection.slot);
+            }
+            else {
+                if (openSlot >= 0) {
+                    if (last != nullptr) last->flags |= IOSQE_IO_LINK;
+                    last = m_ring->open_direct(target.response.filePath.c_str(), O_RDONLY, static_cast<unsigned>(openSlot), userData(OP_WRITE, connection.slot));
+                    target.file = openSlot;
+                    ops++;
+                }
+                uint64_t planned = target.fileSent;
+                for (int i = 0; i < FILE_CHUNKS_PER_CHAIN && planned < target.response.fileLength; i++) {
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(target.response.fileLength - planned, FILE_BUFFER_SIZE));
+                    if (last != nullptr) last->flags |= IOSQE_IO_LINK;
+                    m_ring->read_fixed(target.file, true, static_cast<unsigned>(connection.buffer), length,
+                        target.response.fileOffset + planned, userData(OP_WRITE, connection.slot))->flags |= IOSQE_IO_LINK;
+                    planned += length;
+                    last = m_ring->send(static_cast<int>(connection.slot), true, m_ring->buffer(static_cast<unsigned>(connection.buffer)), length,
+                        MSG_NOSIGNAL | MSG_WAITALL | (planned < target.response.fileLength ? MSG_MORE : 0), userData(OP_WRITE, connection.slot));
+                    ops += 2;
+                }
+                connection.chainFileTarget = &target;
+                connection.chainFile = planned - target.fileSent;
+            }
+        }
+        connection.chainOps = ops;
+        connection.chainFailed = false;
+    }
+
+    void written(UringConnection& connection, const io_uring_cqe& cqe) {
+        connection.chainOps--;
+        if (cqe.res < 0) connection.chainFailed = true;
+        if (connection.chainOps > 0) return;
+        if (connection.dropped) {
+            settle(connection);
+            return;
+        }
+        if (connection.chainFailed) {
+            drop(connection);
+            return;
+        }
+        connection.lastActive = Clock::now();
+        connection.memorySent(connection.chainMemory);
+        if (connection.chainFileTarget != nullptr) connection.fileSent(*connection.chainFileTarget, connection.chainFile);
+        releaseBuffer(connection);
+        connection.popDone([this](PendingResponse& pending) { closeFile(pending); });
+        service(connection);
+    }
+
+    void closeFile(PendingResponse& pending) {
+        if (pending.file < 0) return;
+        m_ring->close_direct(static_cast<unsigned>(pending.file), userData(OP_IGNORE, 0));
+        m_ring->release_file_slot(static_cast<unsigned>(pending.file));
+        pending.file = -1;
+        wakeWaiting();
+    }
+
+    void releaseBuffer(UringConnection& connection) {
+        if (connection.buffer < 0) return;
+        m_ring->release_buffer(static_cast<unsigned>(connection.buffer));
+        connection.buffer = -1;
+        wakeWaiting();
+    }
+
+    void wakeWaiting() {
+        std::deque<unsigned> waiting;
+        waiting.swap(m_waiting);
+        for (unsigned slot : waiting) {
+            // The slot may have been closed, or even reused, since; startWrite only does
+            // what the connection there needs.
+            if (m_connections[slot] != nullptr) startWrite(*m_connections[slot]);
+        }
+    }
+
+    void dropIdle(Clock::time_point now) {
+        for (auto& connection : m_connections) {
+            if (connection != nullptr && !connection->dropped && now - connection->lastActive >= m_idleTimeout && !connection->computing()) {
+                drop(*connection);
+            }
+        }
+    }
+
+    void drop(UringConnection& connection) {
+        if (connection.dropped) return;
+        connection.dropped = true;
+        serverLog().log("Socket closed: slot %u", connection.slot);
+        if (connection.recvArmed || connection.chainOps > 0) {
+            m_ring->cancel_fd(static_cast<int>(connection.slot), true, userData(OP_IGNORE, 0));
+        }
+        settle(connection);
+    }
+
+    // Frees a dropped connection once nothing of it is in flight.
+    void settle(UringConnection& connection) {
+        if (connection.recvArmed || connection.chainOps > 0) return;
+        releaseBuffer(connection);
+        for (PendingResponse& pending : connection.output()) closeFile(pending);
+        m_ring->close_direct(connection.slot, userData(OP_IGNORE, 0));
+        m_connections[connection.slot].reset();
+    }
+
+    int m_listenFd;
+    Clock::duration m_idleTimeout;
+    std::unique_ptr<io_ring> m_ring;
+    std::shared_ptr<ReadyConnections> m_ready; // shared with the wake-ups of pending computations
+    uint64_t m_readyCount = 0;
+    bool m_acceptArmed = false;
+    Clock::time_point m_acceptRetry;
+    std::vector<std::unique_ptr<UringConnection>> m_connections; // by socket slot
+    std::deque<unsigned> m_waiting; // slots waiting for a file buffer or file slot
+};
+
+}
+
+bool runUringServer(uint16_t port, size_t reactorsAmount, int idleTimeoutMs) {
+    if (reactorsAmount == 0) reactorsAmount = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<UringReactor>> reactors;
+    for (size_t i = 0; i < reactorsAmount; i++) {
+        int listenFd = openListenSocket(port);
+        if (listenFd < 0) return false;
+        // Sockets in the file table take no setsockopt; they inherit this.
+        int enable = 1;
+        setsockopt(listenFd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        reactors.push_back(std::make_unique<UringReactor>(listenFd, idleTimeoutMs));
+    }
+
+    std::cout << "Server listening on port " << port << " (io_uring, " << reactorsAmount << " reactors)...\n";
+
+    std::vector<std::thread> threads;
+    for (auto& reactor : reactors) {
+        threads.emplace_back([&reactor]() { reactor->run(); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return true;
+}
+
+#endif
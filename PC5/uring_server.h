@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+
+// The reactor server on io_uring (see common/io_ring.h) instead of epoll: the same
+// per-core reactors with their own SO_REUSEPORT sockets, but a reactor submits its I/O
+// and reaps the results in one syscall per loop iteration instead of one per recv and
+// send. Sockets are accepted by a multishot accept straight into the ring's file table
+// and read by multishot recv into a shared pool of provided buffers. Files above the
+// cache's inline limit are opened through the ring and streamed as linked read→send
+// pairs through registered buffers, so a chunk goes out without a round trip through
+// the reactor. Needs Linux 6.0; call only when io_ring::enabled().
+bool runUringServer(uint16_t port, size_t reactorsAmount, int idleTimeoutMs);
+
+#endif
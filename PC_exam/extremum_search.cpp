@@ -0,0 +1,158 @@
+#include "extremum_search.h"
+#include <algorithm>
+
+namespace {
+
+// Below this many elements the caller scans alone, waking the workers costs more.
+const size_t minParallelSize = 1 << 15;
+const size_t minChunkSize = 1 << 12;
+// Chunks per thread: enough slack for dynamic scheduling to even out uneven threads.
+const size_t chunksPerThread = 8;
+
+}
+
+ExtremumSearch::ExtremumSearch(size_t threadsAmount) {
+    if (threadsAmount == 0) threadsAmount = 1;
+    m_candidates.resize(threadsAmount);
+    for (size_t slot = 1; slot < threadsAmount; slot++) {
+        m_workers.emplace_back([this, slot]() { routine(slot); });
+    }
+}
+
+ExtremumSearch::~ExtremumSearch() {
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_terminated = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+Extremum ExtremumSearch::findMin(const Matrix& matrix, const MatrixRange& range, int lowerBound) {
+    return run(matrix, range, lowerBound, false);
+}
+
+Extremum ExtremumSearch::findMax(const Matrix& matrix, const MatrixRange& range, int upperBound) {
+    return run(matrix, range, upperBound, true);
+}
+
+Extremum ExtremumSearch::run(const Matrix& matrix, const MatrixRange& range, int bound, bool searchMax) {
+    std::unique_lock<std::mutex> search(m_searchLock);
+
+    size_t lastRow = std::min(range.lastRow, matrix.getRows());
+    size_t lastColumn = std::min(range.lastColumn, matrix.getColumns());
+    size_t height = lastRow > range.firstRow ? lastRow - range.firstRow : 0;
+    size_t width = lastColumn > range.firstColumn ? lastColumn - range.firstColumn : 0;
+
+    m_data = matrix.data();
+    m_stride = matrix.getColumns();
+    m_range = range;
+    m_width = width;
+    m_bound = bound;
+    m_searchMax = searchMax;
+    m_size = height * width;
+    m_nextChunk.store(0, std::memory_order_relaxed);
+    m_boundHit.store(false, std::memory_order_relaxed);
+    for (auto& candidate : m_candidates) {
+        candidate.value = Candidate{ 0, 0, false };
+    }
+
+    bool parallel = !m_workers.empty() && m_size >= minParallelSize;
+    if (parallel) {
+        size_t threadsAmount = m_workers.size() + 1;
+        m_chunkSize = std::max(minChunkSize, m_size / (threadsAmount * chunksPerThread));
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_generation++;
+            m_running = m_workers.size();
+        }
+        m_wake.notify_all();
+    }
+    else {
+        m_chunkSize = std::max<size_t>(m_size, 1);
+    }
+
+    processChunks(0);
+
+    if (parallel) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_finished.wait(lock, [this]() { return m_running == 0; });
+    }
+
+    Candidate best{ 0, 0, false };
+    for (auto& padded : m_candidates) {
+        const Candidate& candidate = padded.value;
+        if (!candidate.found) continue;
+        bool better = searchMax ? candidate.value > best.value : candidate.value < best.value;
+        if (!best.found || better || (candidate.value == best.value && candidate.index < best.index)) {
+            best = candidate;
+        }
+    }
+    if (!best.found) {
+        return Extremum{ 0, 0, 0, false };
+    }
+    return Extremum{ best.value, range.firstRow + best.index / width, range.firstColumn + best.index % width, true };
+}
+
+void ExtremumSearch::routine(size_t slot) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_wake.wait(lock, [this, seenGeneration]() { return m_terminated || m_generation != seenGeneration; });
+            if (m_terminated) return;
+            seenGeneration = m_generation;
+        }
+
+        processChunks(slot);
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (--m_running == 0) {
+            m_finished.notify_one();
+        }
+    }
+}
+
+void ExtremumSearch::processChunks(size_t slot) {
+    Candidate& best = m_candidates[slot].value;
+    while (!m_boundHit.load(std::memory_order_relaxed)) {
+        size_t begin = m_nextChunk.fetch_add(1, std::memory_order_relaxed) * m_chunkSize;
+        if (begin >= m_size) break;
+        size_t end = std::min(begin + m_chunkSize, m_size);
+        if (m_searchMax) {
+            scanChunk<true>(begin, end, best);
+        }
+        else {
+            scanChunk<false>(begin, end, best);
+        }
+    }
+}
+
+// Walks the chunk one row segment at a time: a branch-free pass finds the segment's
+// extremum, and only when it beats the current candidate is the position looked up.
+template <bool searchMax>
+void ExtremumSearch::scanChunk(size_t begin, size_t end, Candidate& best) {
+    for (size_t index = begin; index < end;) {
+        size_t row = index / m_width;
+        size_t column = index % m_width;
+        size_t length = std::min(m_width - column, end - index);
+        const int* segment = m_data + (m_range.firstRow + row) * m_stride + m_range.firstColumn + column;
+
+        int value = segment[0];
+        for (size_t i = 1; i < length; i++) {
+            value = searchMax ? std::max(value, segment[i]) : std::min(value, segment[i]);
+        }
+
+        if (!best.found || (searchMax ? value > best.value : value < best.value)) {
+            size_t offset = std::find(segment, segment + length, value) - segment;
+            best = Candidate{ value, index + offset, true };
+            if (searchMax ? value >= m_bound : value <= m_bound) {
+                m_boundHit.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+        index += length;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "matrix.h"
+#include "../common/cache_line.h"
+
+// Rectangle [firstRow, lastRow) x [firstColumn, lastColumn) of a Matrix.
+struct MatrixRange {
+    size_t firstRow;
+    size_t lastRow;
+    size_t firstColumn;
+    size_t lastColumn;
+
+    static MatrixRange all(const Matrix& matrix) { return { 0, matrix.getRows(), 0, matrix.getColumns() }; }
+    static MatrixRange rows(const Matrix& matrix, size_t first, size_t last) { return { first, last, 0, matrix.getColumns() }; }
+    static MatrixRange columns(const Matrix& matrix, size_t first, size_t last) { return { 0, matrix.getRows(), first, last }; }
+};
+
+struct Extremum {
+    int value;
+    size_t row;
+    size_t column;
+    bool found; // false only for an empty range
+};
+
+// Parallel argmin/argmax over matrix ranges. The worker threads are started once and
+// reused by every search; the calling thread works too. Chunks are handed out from a
+// shared counter, so a slow thread does not hold up the others, and a search stops as
+// soon as any thread sees the bound value (nothing can beat it). Without an early exit
+// ties go to the first position in row-major order. One search runs at a time per
+// object; calls from several threads queue up.
+class ExtremumSearch {
+public:
+    explicit ExtremumSearch(size_t threadsAmount);
+    ~ExtremumSearch();
+    ExtremumSearch(const ExtremumSearch&) = delete;
+    ExtremumSearch& operator=(const ExtremumSearch&) = delete;
+
+    // lowerBound: the smallest value the data can hold (0 for the 0..9 matrices).
+    Extremum findMin(const Matrix& matrix, const MatrixRange& range, int lowerBound = INT_MIN);
+    Extremum findMax(const Matrix& matrix, const MatrixRange& range, int upperBound = INT_MAX);
+
+private:
+    struct Candidate {
+        int value;
+        size_t index; // row-major position inside the range
+        bool found;
+    };
+
+    Extremum run(const Matrix& matrix, const MatrixRange& range, int bound, bool searchMax);
+    void routine(size_t slot);
+    void processChunks(size_t slot);
+    template <bool searchMax>
+    void scanChunk(size_t begin, size_t end, Candidate& best);
+
+    std::mutex m_searchLock;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+    std::vector<std::thread> m_workers;
+    uint64_t m_generation = 0;
+    size_t m_running = 0;
+    bool m_terminated = false;
+
+    // current search, written by the caller before the workers are woken up
+    const int* m_data = nullptr;
+    size_t m_stride = 0;
+    MatrixRange m_range{};
+    size_t m_width = 0;
+    int m_bound = 0;
+    bool m_searchMax = false;
+    size_t m_size = 0;
+    size_t m_chunkSize = 0;
+    std::atomic<size_t> m_nextChunk{ 0 };
+    std::atomic<bool> m_boundHit{ false };
+    std::vector<cache_padded<Candidate>> m_candidates;
+};
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <vector>
+#include <random>
+#include <iostream>
+
+class Matrix { // клас матриці
+private:
+    std::vector<int> mat; 
+    size_t rows;
+    size_t columns;
+public:
+    size_t getRows() const { return rows; }
+    size_t getColumns() const { return columns; }
+    size_t getSize() const { return rows * columns; }
+
+    Matrix(size_t r, size_t c) {
+        rows = r;
+        columns = c;
+        std::random_device dev; 
+        std::mt19937 rng(dev());
+        std::uniform_int_distribution<std::mt19937::result_type> dist6(0, 9); // повертає випадкові числа в межах від 0 до 9. Взяв десь на stackoverflow, якщо чесно
+        mat.resize(r * c);
+        for (int i = 0; i < r * c; i++) { mat[i] = dist6(rng); } // заповнюємо матрицю
+    }
+
+    int at_line(int i) const { return mat[i]; }
+    int at(size_t row, size_t column) const { return mat[row * columns + column]; }
+    const int* data() const { return mat.data(); }
+
+    friend std::ostream& operator<<(std::ostream& os, Matrix A) { // перевантажуємо оператор виводу для зручного відображення в консолі
+        for (int i = 0; i < A.rows; i++) {
+            for (int j = 0; j < A.columns; j++) {
+                os << A.mat[i * A.columns + j] << ' ';
+            }
+            os << '\n';
+        }
+        return os;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+class buffer_pool;
+
+// Byte buffer with cache-line alignment, so it can be viewed as an int32/int64 array
+// in place. Move-only; the storage goes back to its pool on destruction.
+class pooled_buffer {
+public:
+    pooled_buffer() = default;
+    pooled_buffer(pooled_buffer&& other) noexcept { swap(other); }
+    pooled_buffer& operator=(pooled_buffer&& other) noexcept;
+    pooled_buffer(const pooled_buffer&) = delete;
+    pooled_buffer& operator=(const pooled_buffer&) = delete;
+    ~pooled_buffer() { reset(); }
+
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    template <typename value_t>
+    value_t* as() { return reinterpret_cast<value_t*>(m_data); }
+    template <typename value_t>
+    const value_t* as() const { return reinterpret_cast<const value_t*>(m_data); }
+
+    void reset();
+    void swap(pooled_buffer& other) noexcept;
+
+private:
+    friend class buffer_pool;
+    pooled_buffer(buffer_pool* pool, uint8_t* data, size_t size, size_t capacity)
+        : m_pool(pool), m_data(data), m_size(size), m_capacity(capacity) {}
+
+    buffer_pool* m_pool = nullptr;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+};
+
+// Free lists of aligned buffers in power-of-two size classes. Large matrix payloads are
+// received into and computed in these buffers, so a steady stream of same-sized
+// requests stops going to the allocator (and stops faulting fresh pages in) after the
+// first few. At most `max_retained_bytes` sit idle in the pool; anything released
+// beyond that is freed.
+class buffer_pool {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t min_capacity = 4096;
+
+    explicit buffer_pool(size_t max_retained_bytes);
+    ~buffer_pool();
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    // Contents are uninitialized.
+    pooled_buffer acquire(size_t size);
+    size_t retained_bytes() const;
+
+    // Process-wide pool; never destroyed, so buffers may outlive static destructors.
+    static buffer_pool& shared();
+
+private:
+    friend class pooled_buffer;
+    void release(uint8_t* data, size_t capacity);
+    static size_t size_class(size_t capacity) { return std::bit_width(capacity - 1); }
+
+    mutable std::mutex m_lock;
+    std::vector<std::vector<uint8_t*>> m_free;
+    size_t m_retained = 0;
+    size_t m_max_retained;
+};
+
+inline pooled_buffer& pooled_buffer::operator=(pooled_buffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        swap(other);
+    }
+    return *this;
+}
+
+inline void pooled_buffer::reset() {
+    if (m_pool != nullptr) {
+        m_pool->release(m_data, m_capacity);
+    }
+    m_pool = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+inline void pooled_buffer::swap(pooled_buffer& other) noexcept {
+    std::swap(m_pool, other.m_pool);
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_capacity, other.m_capacity);
+}
+
+inline buffer_pool::buffer_pool(size_t max_retained_bytes)
+    : m_free(sizeof(size_t) * 8 + 1), m_max_retained(max_retained_bytes) {}
+
+inline buffer_pool::~buffer_pool() {
+    for (auto& list : m_free) {
+        for (uint8_t* data : list) {
+            ::operator delete(data, std::align_val_t(alignment));
+        }
+    }
+}
+
+inline pooled_buffer buffer_pool::acquire(size_t size) {
+    if (size == 0) return pooled_buffer();
+    size_t capacity = std::bit_ceil(size < min_capacity ? min_capacity : size);
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        auto& list = m_free[size_class(capacity)];
+        if (!list.empty()) {
+            uint8_t* data = list.back();
+            list.pop_back();
+            m_retained -= capacity;
+            return pooled_buffer(this, data, size, capacity);
+        }
+    }
+    auto* data = static_cast<uint8_t*>(::operator new(capacity, std::align_val_t(alignment)));
+    return pooled_buffer(this, data, size, capacity);
+}
+
+inline size_t buffer_pool::retained_bytes() const {
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_retained;
+}
+
+inline void buffer_pool::release(uint8_t* data, size_t capacity) {
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_retained + capacity <= m_max_retained) {
+            m_free[size_class(capacity)].push_back(data);
+            m_retained += capacity;
+            return;
+        }
+    }
+    ::operator delete(data, std::align_val_t(alignment));
+}
+
+inline buffer_pool& buffer_pool::shared() {
+    static buffer_pool* pool = new buffer_pool(size_t(1) << 30);
+    return *pool;
+}
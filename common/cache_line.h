@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+// Per-thread state that sits next to other threads' state in memory is padded to
+// this size so neighbouring writers do not invalidate each other's lines.
+constexpr std::size_t cache_line_size = 64;
+
+template <typename value_t>
+struct alignas(cache_line_size) cache_padded {
+    value_t value{};
+};
@@ -0,0 +1,157 @@
+#include "compute_scheduler.h"
+#include <algorithm>
+
+compute_scheduler::compute_scheduler(const config& settings) : m_config(settings) {
+    if (m_config.workers == 0) {
+        m_config.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_config.tile_size = std::max<size_t>(m_config.tile_size, 1);
+    m_workers.reserve(m_config.workers);
+    for (size_t i = 0; i < m_config.workers; i++) {
+        m_workers.emplace_back([this]() { routine(); });
+    }
+}
+
+compute_scheduler::~compute_scheduler() {
+    shutdown();
+}
+
+bool compute_scheduler::try_submit(uint64_t owner, size_t size, kernel_t kernel, done_t done) {
+    auto task = std::make_shared<job>();
+    task->owner = owner;
+    task->size = size;
+    task->kernel = std::move(kernel);
+    task->done = std::move(done);
+    size_t tile = size <= m_config.batch_size ? std::max<size_t>(size, 1) : m_config.tile_size;
+    task->tiles_left = std::max<size_t>((size + tile - 1) / tile, 1);
+
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_terminated || m_jobs >= m_config.max_jobs) {
+            return false;
+        }
+        m_jobs++;
+        auto& queue = m_queues[owner];
+        if (queue.empty()) {
+            m_ring.push_back(owner);
+        }
+        queue.push_back(std::move(task));
+    }
+
+    size_t wakeups = std::min((size + m_config.tile_size - 1) / m_config.tile_size, m_workers.size());
+    if (wakeups <= 1) {
+        m_work_waiter.notify_one();
+    }
+    else {
+        m_work_waiter.notify_all();
+    }
+    return true;
+}
+
+void compute_scheduler::shutdown() {
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_terminated) return;
+        m_terminated = true;
+    }
+    m_work_waiter.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+size_t compute_scheduler::jobs_in_system() const {
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_jobs;
+}
+
+bool compute_scheduler::take_tile(work_item& item, size_t tiny_limit) {
+    if (m_ring.empty()) return false;
+
+    // Owners in ring order; the first whose front job is below its fair share of workers
+    // wins. If every job is at its share, the front one runs anyway: no worker idles
+    // while there is work.
+    size_t fair_share = (m_workers.size() + m_ring.size() - 1) / m_ring.size();
+    size_t pick = m_ring.size();
+    size_t fallback = m_ring.size();
+    for (size_t i = 0; i < m_ring.size(); i++) {
+        const job& candidate = *m_queues[m_ring[i]].front();
+        if (tiny_limit != 0 && (candidate.size > tiny_limit || candidate.next_begin != 0)) continue;
+        if (candidate.running < fair_share) {
+            pick = i;
+            break;
+        }
+        if (fallback == m_ring.size()) fallback = i;
+    }
+    if (pick == m_ring.size()) pick = fallback;
+    if (pick == m_ring.size()) return false;
+
+    uint64_t owner = m_ring[pick];
+    m_ring.erase(m_ring.begin() + pick);
+    auto& queue = m_queues[owner];
+    std::shared_ptr<job> task = queue.front();
+
+    size_t tile = task->size <= m_config.batch_size ? task->size : m_config.tile_size;
+    item.task = task;
+    item.begin = task->next_begin;
+    item.end = std::min(task->size, item.begin + tile);
+    task->next_begin = item.end;
+    task->running++;
+
+    if (task->next_begin >= task->size) {
+        queue.pop_front();
+    }
+    if (queue.empty()) {
+        m_queues.erase(owner);
+    }
+    else {
+        m_ring.push_back(owner);
+    }
+    return true;
+}
+
+bool compute_scheduler::next_batch(std::vector<work_item>& batch) {
+    work_item item;
+    if (!take_tile(item, 0)) return false;
+    size_t total = item.end - item.begin;
+    bool tiny = item.task->size <= m_config.batch_size;
+    batch.push_back(std::move(item));
+
+    while (tiny && total < m_config.batch_size && take_tile(item, m_config.batch_size - total)) {
+        total += item.end - item.begin;
+        batch.push_back(std::move(item));
+    }
+    return true;
+}
+
+void compute_scheduler::routine() {
+    std::vector<work_item> batch;
+    std::vector<std::shared_ptr<job>> finished;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            for (auto& item : batch) {
+                item.task->running--;
+                if (--item.task->tiles_left == 0) {
+                    finished.push_back(std::move(item.task));
+                    m_jobs--;
+                }
+            }
+            batch.clear();
+            if (finished.empty()) {
+                m_work_waiter.wait(lock, [this]() { return m_terminated || !m_ring.empty(); });
+            }
+            if (!next_batch(batch) && finished.empty() && m_terminated) {
+                return;
+            }
+        }
+
+        for (auto& task : finished) {
+            task->done();
+        }
+        finished.clear();
+        for (auto& item : batch) {
+            item.task->kernel(item.begin, item.end);
+        }
+    }
+}
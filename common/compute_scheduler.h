@@ -0,0 +1,83 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Shared worker pool for data-parallel requests. A job is `size` independent elements
+// and a kernel that processes any [begin, end) range of them; the scheduler cuts it into
+// tiles and runs them on whichever workers are free, then calls `done` once, on the
+// worker that finished the last tile.
+//
+//  - fairness: jobs queue per owner (a client), and workers take one tile at a time
+//    from the owners in round-robin order, so a client with a 400 MB job and a client
+//    with a 3x3 job both make progress;
+//  - concurrency from load: a job may occupy at most workers / active owners workers
+//    while other owners are waiting, and all of them when it is alone;
+//  - batching: jobs no larger than `batch_size` run whole, and a worker that picks one
+//    keeps picking tiny jobs up to `batch_size` elements under the same lock, so a burst
+//    of small requests does not cost a lock round trip and a wakeup each;
+//  - admission: at most `max_jobs` accepted and unfinished; try_submit returns false
+//    beyond that and the caller rejects the request.
+class compute_scheduler {
+public:
+    using kernel_t = std::function<void(size_t begin, size_t end)>;
+    using done_t = std::function<void()>;
+
+    struct config {
+        size_t workers = 0; // 0: hardware concurrency
+        size_t max_jobs = 1024;
+        size_t tile_size = size_t(1) << 16; // elements per tile
+        size_t batch_size = size_t(1) << 14;
+    };
+
+    explicit compute_scheduler(const config& settings);
+    ~compute_scheduler();
+    compute_scheduler(const compute_scheduler&) = delete;
+    compute_scheduler& operator=(const compute_scheduler&) = delete;
+
+    bool try_submit(uint64_t owner, size_t size, kernel_t kernel, done_t done);
+    // Finishes all accepted jobs, then joins the workers. Later submits are refused.
+    void shutdown();
+
+    size_t workers() const { return m_workers.size(); }
+    size_t jobs_in_system() const;
+
+private:
+    struct job {
+        uint64_t owner;
+        size_t size;
+        size_t next_begin = 0;
+        size_t tiles_left; // dispatched or not, guarded by m_lock
+        size_t running = 0;
+        kernel_t kernel;
+        done_t done;
+    };
+
+    struct work_item {
+        std::shared_ptr<job> task;
+        size_t begin;
+        size_t end;
+    };
+
+    // Picks the next batch under the lock; false when there is nothing to run.
+    bool next_batch(std::vector<work_item>& batch);
+    // tiny_limit != 0: only untouched jobs of at most that many elements, for batching.
+    bool take_tile(work_item& item, size_t tiny_limit);
+    void routine();
+
+    config m_config;
+    mutable std::mutex m_lock;
+    std::condition_variable m_work_waiter;
+    std::unordered_map<uint64_t, std::deque<std::shared_ptr<job>>> m_queues;
+    std::deque<uint64_t> m_ring; // owners with undispatched tiles, next one in front
+    size_t m_jobs = 0;
+    bool m_terminated = false;
+    std::vector<std::thread> m_workers;
+};
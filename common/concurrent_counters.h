@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "cache_line.h"
+
+// Stable small index for the calling thread, handed out on first use.
+inline size_t this_thread_slot() {
+    static std::atomic<size_t> next_slot{ 0 };
+    thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+// Counter split into cache-line-sized shards. Every thread adds to the shard picked by
+// its slot, so with at least as many shards as threads no two writers share a line;
+// load() sums the shards and is only as fresh as a relaxed read. Use it where a
+// std::atomic<int> is only ever incremented and read at the end (above_n_amount).
+class sharded_counter {
+public:
+    explicit sharded_counter(size_t shards = default_shards());
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    void add(int64_t value = 1);
+    int64_t load() const;
+    void reset();
+
+    sharded_counter& operator++() { add(1); return *this; }
+    sharded_counter& operator+=(int64_t value) { add(value); return *this; }
+    operator int64_t() const { return load(); }
+
+    // Smallest power of two not below hardware_concurrency (at least 1), so slots map onto
+    // shards with a mask.
+    static size_t default_shards();
+
+private:
+    size_t m_mask;
+    std::unique_ptr<cache_padded<std::atomic<int64_t>>[]> m_shards;
+};
+
+// Register that only moves in one direction: update(v) stores v when it beats the
+// current value under `compare_t`. A value that cannot win is rejected after a plain
+// load, so once the register settles (max found early, min reached 0) threads only
+// read the line and stop bouncing it between cores with failed CAS attempts.
+template <typename value_t, typename compare_t>
+class monotone_register {
+public:
+    explicit monotone_register(value_t initial) : m_value(initial) {}
+    monotone_register(const monotone_register&) = delete;
+    monotone_register& operator=(const monotone_register&) = delete;
+
+    // True if this call changed the value.
+    bool update(value_t value);
+    value_t load() const { return m_value.load(std::memory_order_relaxed); }
+    void reset(value_t initial) { m_value.store(initial, std::memory_order_relaxed); }
+    operator value_t() const { return load(); }
+
+private:
+    alignas(cache_line_size) std::atomic<value_t> m_value;
+};
+
+template <typename value_t>
+using max_register = monotone_register<value_t, std::greater<value_t>>;
+
+template <typename value_t>
+using min_register = monotone_register<value_t, std::less<value_t>>;
+
+inline sharded_counter::sharded_counter(size_t shards) {
+    size_t rounded = 1;
+    while (rounded < shards) {
+        rounded *= 2;
+    }
+    m_mask = rounded - 1;
+    m_shards.reset(new cache_padded<std::atomic<int64_t>>[rounded]);
+    reset();
+}
+
+inline void sharded_counter::add(int64_t value) {
+    m_shards[this_thread_slot() & m_mask].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline int64_t sharded_counter::load() const {
+    int64_t sum = 0;
+    for (size_t i = 0; i <= m_mask; i++) {
+        sum += m_shards[i].value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+inline void sharded_counter::reset() {
+    for (size_t i = 0; i <= m_mask; i++) {
+        m_shards[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline size_t sharded_counter::default_shards() {
+    size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    size_t shards = 1;
+    while (shards < threads) {
+        shards *= 2;
+    }
+    return shards;
+}
+
+template <typename value_t, typename compare_t>
+bool monotone_register<value_t, compare_t>::update(value_t value) {
+    compare_t better;
+    value_t current = m_value.load(std::memory_order_relaxed);
+    while (better(value, current)) {
+        if (m_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
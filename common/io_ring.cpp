@@ -0,0 +1,358 @@
+#include "io_ring.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+// Operations the backends submit; a kernel missing any of them gets the epoll backend.
+const uint8_t required_ops[] = {
+    IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SENDMSG, IORING_OP_READ,
+    IORING_OP_READ_FIXED, IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL,
+};
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+void* map_anonymous(size_t size) {
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+std::bitset<256> probe_ops(int fd) {
+    std::bitset<256> supported;
+    std::vector<uint8_t> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) != 0) return supported;
+    for (unsigned op = 0; op <= probe->last_op; op++) {
+        if (probe->ops[op].flags & IO_URING_OP_SUPPORTED) supported.set(op);
+    }
+    return supported;
+}
+
+}
+
+std::unique_ptr<io_ring> io_ring::create(const config& settings) {
+    std::unique_ptr<io_ring> ring(new io_ring());
+    if (!ring->setup(settings)) return nullptr;
+    return ring;
+}
+
+bool io_ring::supported() {
+    config probe;
+    probe.entries = 8;
+    probe.direct_sockets = 4;
+    probe.direct_files = 4;
+    probe.recv_buffers = 2;
+    probe.recv_buffer_size = 4096;
+    return create(probe) != nullptr;
+}
+
+bool io_ring::enabled() {
+    const char* engine = std::getenv("IO_ENGINE");
+    if (engine != nullptr && std::strcmp(engine, "epoll") == 0) return false;
+    return supported();
+}
+
+bool io_ring::setup(const config& settings) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = settings.entries * 4;
+    m_fd = io_uring_setup(settings.entries, &params);
+    if (m_fd < 0 && errno == EINVAL) {
+        // Before 6.1: completions are then run as task work, at the cost of an
+        // interrupt when they arrive.
+        params = io_uring_params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = settings.entries * 4;
+        m_fd = io_uring_setup(settings.entries, &params);
+    }
+    if (m_fd < 0) return false;
+    const unsigned required_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL |
+        IORING_FEAT_EXT_ARG | IORING_FEAT_LINKED_FILE;
+    if ((params.features & required_features) != required_features) return false;
+    m_supported_ops = probe_ops(m_fd);
+    for (uint8_t op : required_ops) {
+        if (!m_supported_ops.test(op)) return false;
+    }
+
+    m_ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_ring_memory = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_ring_memory == MAP_FAILED) {
+        m_ring_memory = nullptr;
+        return false;
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto* base = static_cast<uint8_t*>(m_ring_memory);
+    m_sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+    // SQE i always sits in array slot i.
+    auto* sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; i++) sq_array[i] = i;
+    m_cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    unsigned table_size = settings.direct_sockets + settings.direct_files;
+    if (table_size > 0) {
+        std::vector<int> sparse(table_size, -1);
+        if (io_uring_register(m_fd, IORING_REGISTER_FILES, sparse.data(), table_size) != 0) return false;
+        io_uring_file_index_range range{};
+        range.off = 0;
+        range.len = settings.direct_sockets;
+        if (io_uring_register(m_fd, IORING_REGISTER_FILE_ALLOC_RANGE, &range, 0) != 0) return false;
+        m_direct_sockets = settings.direct_sockets;
+        for (unsigned slot = table_size; slot > settings.direct_sockets; slot--) m_free_file_slots.push_back(slot - 1);
+    }
+
+    if (settings.fixed_buffers > 0) {
+        m_buffer_size = settings.fixed_buffer_size;
+        m_buffer_region = settings.fixed_buffers * m_buffer_size;
+        m_buffer_memory = static_cast<uint8_t*>(map_anonymous(m_buffer_region));
+        if (m_buffer_memory == nullptr) return false;
+        std::vector<iovec> buffers(settings.fixed_buffers);
+        for (unsigned i = 0; i < settings.fixed_buffers; i++) buffers[i] = { buffer(i), m_buffer_size };
+        // Pinning counts against RLIMIT_MEMLOCK; over it the same memory is read into
+        // with plain reads.
+        m_buffers_registered = io_uring_register(m_fd, IORING_REGISTER_BUFFERS, buffers.data(), settings.fixed_buffers) == 0;
+        for (unsigned i = settings.fixed_buffers; i > 0; i--) m_free_buffers.push_back(i - 1);
+    }
+
+    if (settings.recv_buffers > 0) {
+        unsigned entries = 1;
+        while (entries < settings.recv_buffers) entries <<= 1;
+        m_recv_mask = entries - 1;
+        m_recv_buffer_size = settings.recv_buffer_size;
+        m_recv_ring_size = entries * sizeof(io_uring_buf);
+        m_recv_ring = static_cast<io_uring_buf_ring*>(map_anonymous(m_recv_ring_size));
+        m_recv_region = entries * m_recv_buffer_size;
+        m_recv_memory = static_cast<uint8_t*>(map_anonymous(m_recv_region));
+        if (m_recv_ring == nullptr || m_recv_memory == nullptr) return false;
+        io_uring_buf_reg registration{};
+        registration.ring_addr = reinterpret_cast<uint64_t>(m_recv_ring);
+        registration.ring_entries = entries;
+        registration.bgid = 0;
+        if (io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) return false;
+        for (unsigned id = 0; id < entries; id++) {
+            recycle_recv_buffer(id);
+        }
+    }
+    return true;
+}
+
+io_ring::~io_ring() {
+    // Closing the ring first ends every operation that could still write into the buffers.
+    if (m_fd >= 0) close(m_fd);
+    if (m_recv_memory != nullptr) munmap(m_recv_memory, m_recv_region);
+    if (m_recv_ring != nullptr) munmap(m_recv_ring, m_recv_ring_size);
+    if (m_buffer_memory != nullptr) munmap(m_buffer_memory, m_buffer_region);
+    if (m_sqes != nullptr) munmap(m_sqes, m_sqes_size);
+    if (m_ring_memory != nullptr) munmap(m_ring_memory, m_ring_size);
+}
+
+bool io_ring::submit_and_wait(int timeout_ms) {
+    std::atomic_ref<unsigned>(*m_sq_tail).store(m_sq_local_tail, std::memory_order_release);
+    unsigned to_submit = m_sq_local_tail - std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    }
+    if (io_uring_enter(m_fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) >= 0) return true;
+    // EBUSY/EAGAIN: completions are backed up in the kernel until some are reaped.
+    return errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN;
+}
+
+io_uring_sqe* io_ring::next_sqe() {
+    if (m_sq_local_tail - std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire) == m_sq_entries) {
+        // Full: hand the queued batch over without waiting.
+        std::atomic_ref<unsigned>(*m_sq_tail).store(m_sq_local_tail, std::memory_order_release);
+        while (io_uring_enter(m_fd, m_sq_entries, 0, 0, nullptr, 0) < 0 && (errno == EINTR || errno == EBUSY || errno == EAGAIN)) {
+        }
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sq_local_tail & m_sq_mask];
+    m_sq_local_tail++;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+io_uring_sqe* io_ring::multishot_accept(int listen_fd, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    if (m_direct_sockets > 0) {
+        sqe->file_index = IORING_FILE_INDEX_ALLOC; // CLOEXEC does not apply to slots
+    }
+    else {
+        sqe->accept_flags = SOCK_CLOEXEC;
+    }
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::multishot_recv(int fd, bool fixed, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT | (fixed ? IOSQE_FIXED_FILE : 0);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::send(int fd, bool fixed, const void* data, size_t length, int flags, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::sendmsg(int fd, bool fixed, const msghdr* message, int flags, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+    sqe->addr = reinterpret_cast<uint64_t>(message);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::sendmsg_zc(int fd, bool fixed, const msghdr* message, int flags, uint64_t user_data) {
+    io_uring_sqe* sqe = sendmsg(fd, fixed, message, flags, user_data);
+    sqe->opcode = IORING_OP_SENDMSG_ZC;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::read(int fd, bool fixed, void* data, size_t length, uint64_t offset, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::read_fixed(int fd, bool fixed, unsigned buffer_index, size_t length, uint64_t offset, uint64_t user_data) {
+    io_uring_sqe* sqe = read(fd, fixed, buffer(buffer_index), length, offset, user_data);
+    if (m_buffers_registered) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = static_cast<uint16_t>(buffer_index);
+    }
+    return sqe;
+}
+
+io_uring_sqe* io_ring::open_direct(const char* path, int flags, unsigned slot, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->open_flags = static_cast<uint32_t>(flags & ~O_CLOEXEC);
+    sqe->file_index = slot + 1;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::close_direct(unsigned slot, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::cancel_fd(int fd, bool fixed, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL | (fixed ? IORING_ASYNC_CANCEL_FD_FIXED : 0);
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+io_uring_sqe* io_ring::cancel(uint64_t target, uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+int io_ring::acquire_buffer() {
+    if (m_free_buffers.empty()) return -1;
+    unsigned index = m_free_buffers.back();
+    m_free_buffers.pop_back();
+    return static_cast<int>(index);
+}
+
+void io_ring::release_buffer(unsigned index) {
+    m_free_buffers.push_back(index);
+}
+
+int io_ring::acquire_file_slot() {
+    if (m_free_file_slots.empty()) return -1;
+    unsigned slot = m_free_file_slots.back();
+    m_free_file_slots.pop_back();
+    return static_cast<int>(slot);
+}
+
+void io_ring::release_file_slot(unsigned slot) {
+    m_free_file_slots.push_back(slot);
+}
+
+void io_ring::recycle_recv_buffer(unsigned id) {
+    std::atomic_ref<uint16_t> tail(m_recv_ring->tail);
+    uint16_t position = tail.load(std::memory_order_relaxed);
+    // Not m_recv_ring->bufs: the kernel header's flexible array sits 8 bytes off in C++.
+    // The ring's tail overlays the reserved field of entry 0, so that is not written.
+    io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(m_recv_ring)[position & m_recv_mask];
+    entry.addr = reinterpret_cast<uint64_t>(recv_buffer(id));
+    entry.len = static_cast<uint32_t>(m_recv_buffer_size);
+    entry.bid = static_cast<uint16_t>(id);
+    tail.store(static_cast<uint16_t>(position + 1), std::memory_order_release);
+}
+
+#endif
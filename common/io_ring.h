@@ -0,0 +1,158 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/socket.h>
+#include <vector>
+
+// io_uring on raw syscalls, shared by the socket backends of PC4 and PC5. A ring
+// belongs to one I/O thread, which creates it, submits to it and reaps it, so it is set
+// up single-issuer with task work deferred to the reap and nothing in here locks.
+// Submissions only queue SQEs; they reach the kernel in one io_uring_enter per loop
+// iteration together with the wait for completions.
+//
+// Besides the queues a ring may own:
+//  - a fixed file table: the kernel accepts sockets straight into its first
+//    `direct_sockets` slots, and acquire_file_slot hands out the rest for files opened
+//    through the ring, so ops on either skip the fd table;
+//  - `fixed_buffers` registered buffers, pinned once, that READ_FIXED fills without
+//    mapping pages per request;
+//  - a ring of `recv_buffers` provided buffers that multishot recv picks from, so a
+//    connection waiting for data holds no receive buffer.
+class io_ring {
+public:
+    struct config {
+        unsigned entries = 256; // submission queue; the completion queue is 4x
+        unsigned direct_sockets = 0;
+        unsigned direct_files = 0;
+        unsigned fixed_buffers = 0;
+        size_t fixed_buffer_size = 65536;
+        unsigned recv_buffers = 0; // rounded up to a power of two
+        size_t recv_buffer_size = 16384;
+    };
+
+    // Null when io_uring is missing, disabled, or lacks something the ring relies on
+    // (multishot accept and recv, buffer rings and allocated direct descriptors need
+    // Linux 6.0). Must be called on the thread that will use the ring.
+    static std::unique_ptr<io_ring> create(const config& settings);
+    // Whether create succeeds with every feature in use.
+    static bool supported();
+    // Whether the servers should run on io_uring: supported, and not turned off by
+    // setting IO_ENGINE=epoll in the environment.
+    static bool enabled();
+
+    ~io_ring();
+    io_ring(const io_ring&) = delete;
+    io_ring& operator=(const io_ring&) = delete;
+
+    // Submits the queued SQEs and waits up to `timeout_ms` (-1: no limit) for at least
+    // one completion. False on an error other than a timeout or a signal.
+    bool submit_and_wait(int timeout_ms);
+
+    // Calls handler(const io_uring_cqe&) for every completion ready. The handler may
+    // queue new SQEs.
+    template <typename handler_t>
+    unsigned reap(handler_t&& handler) {
+        unsigned reaped = 0;
+        while (true) {
+            unsigned head = *m_cq_head;
+            if (head == std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire)) return reaped;
+            io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+            std::atomic_ref<unsigned>(*m_cq_head).store(head + 1, std::memory_order_release);
+            handler(cqe);
+            reaped++;
+        }
+    }
+
+    // The SQE helpers below queue one operation and return it, so callers can add
+    // flags such as IOSQE_IO_LINK. `fixed` means `fd` is a slot of the file table.
+
+    // Sockets land in the direct socket slots when the ring has them; cqe.res is the
+    // socket (or slot), and IORING_CQE_F_MORE is clear once the accept stops.
+    io_uring_sqe* multishot_accept(int listen_fd, uint64_t user_data);
+    // Every completion carries up to recv_buffer_size bytes in a provided buffer.
+    io_uring_sqe* multishot_recv(int fd, bool fixed, uint64_t user_data);
+    io_uring_sqe* send(int fd, bool fixed, const void* data, size_t length, int flags, uint64_t user_data);
+    // `message` and what it points to must stay valid until the completion.
+    io_uring_sqe* sendmsg(int fd, bool fixed, const msghdr* message, int flags, uint64_t user_data);
+    // Zero-copy sendmsg (Linux 6.1, see supports). The data must stay valid until a
+    // second completion with IORING_CQE_F_NOTIF, which follows when the first has
+    // IORING_CQE_F_MORE set.
+    io_uring_sqe* sendmsg_zc(int fd, bool fixed, const msghdr* message, int flags, uint64_t user_data);
+    io_uring_sqe* read(int fd, bool fixed, void* data, size_t length, uint64_t offset, uint64_t user_data);
+    // Reads into registered buffer `buffer_index`; a plain read into the same memory
+    // when the kernel refused to pin the buffers.
+    io_uring_sqe* read_fixed(int fd, bool fixed, unsigned buffer_index, size_t length, uint64_t offset, uint64_t user_data);
+    // Opens `path` into file table slot `slot`; `path` must outlive the completion.
+    io_uring_sqe* open_direct(const char* path, int flags, unsigned slot, uint64_t user_data);
+    io_uring_sqe* close_direct(unsigned slot, uint64_t user_data);
+    // Cancels every operation on `fd`.
+    io_uring_sqe* cancel_fd(int fd, bool fixed, uint64_t user_data);
+    // Cancels the operation submitted with `target` as its user_data.
+    io_uring_sqe* cancel(uint64_t target, uint64_t user_data);
+
+    // Whether the kernel knows `opcode`, for operations beyond the required ones.
+    bool supports(uint8_t opcode) const { return m_supported_ops.test(opcode); }
+
+    // Registered buffers; -1 when all are in use.
+    int acquire_buffer();
+    void release_buffer(unsigned index);
+    uint8_t* buffer(unsigned index) const { return m_buffer_memory + index * m_buffer_size; }
+    size_t buffer_size() const { return m_buffer_size; }
+
+    // File table slots outside the socket range; -1 when all are in use.
+    int acquire_file_slot();
+    void release_file_slot(unsigned slot);
+
+    // Provided buffers: a recv completion with IORING_CQE_F_BUFFER owns buffer
+    // recv_buffer_id(cqe) until it is recycled.
+    static unsigned recv_buffer_id(const io_uring_cqe& cqe) { return cqe.flags >> IORING_CQE_BUFFER_SHIFT; }
+    const uint8_t* recv_buffer(unsigned id) const { return m_recv_memory + id * m_recv_buffer_size; }
+    void recycle_recv_buffer(unsigned id);
+
+private:
+    io_ring() = default;
+    bool setup(const config& settings);
+    io_uring_sqe* next_sqe();
+
+    int m_fd = -1;
+    std::bitset<256> m_supported_ops;
+    void* m_ring_memory = nullptr;
+    size_t m_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sq_local_tail = 0; // queued, not yet published to the kernel
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    uint8_t* m_buffer_memory = nullptr;
+    size_t m_buffer_size = 0;
+    size_t m_buffer_region = 0;
+    bool m_buffers_registered = false;
+    std::vector<unsigned> m_free_buffers;
+
+    unsigned m_direct_sockets = 0;
+    std::vector<unsigned> m_free_file_slots;
+
+    io_uring_buf_ring* m_recv_ring = nullptr;
+    size_t m_recv_ring_size = 0;
+    unsigned m_recv_mask = 0;
+    uint8_t* m_recv_memory = nullptr;
+    size_t m_recv_buffer_size = 0;
+    size_t m_recv_region = 0;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram for latencies (or any non-negative integer samples). Values
+// below 32 get their own bucket, above that every power of two is split into 16
+// sub-buckets, so percentiles are within ~6% of the recorded value. The counters are
+// plain integers: keep one histogram per thread and merge() them when reading.
+class latency_histogram {
+public:
+    static constexpr size_t sub_bucket_bits = 4;
+    static constexpr size_t sub_buckets = size_t(1) << sub_bucket_bits;
+    static constexpr size_t linear_limit = sub_buckets * 2;
+    static constexpr size_t bucket_count = linear_limit + (64 - sub_bucket_bits - 1) * sub_buckets;
+
+    void record(uint64_t value);
+    void merge(const latency_histogram& other);
+    void reset();
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    double mean() const;
+    // Upper bound of the bucket holding the given percentile, 0 when empty.
+    uint64_t percentile(double percent) const;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    std::array<uint64_t, bucket_count> m_counts{};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_max = 0;
+};
+
+inline size_t latency_histogram::bucket_index(uint64_t value) {
+    if (value < linear_limit) {
+        return static_cast<size_t>(value);
+    }
+    size_t exponent = std::bit_width(value) - 1;
+    size_t top = static_cast<size_t>(value >> (exponent - sub_bucket_bits));
+    return linear_limit + (exponent - sub_bucket_bits - 1) * sub_buckets + (top - sub_buckets);
+}
+
+inline uint64_t latency_histogram::bucket_upper_bound(size_t index) {
+    if (index < linear_limit) {
+        return index;
+    }
+    size_t exponent = (index - linear_limit) / sub_buckets + sub_bucket_bits + 1;
+    uint64_t top = (index - linear_limit) % sub_buckets + sub_buckets;
+    uint64_t width = uint64_t(1) << (exponent - sub_bucket_bits);
+    return top * width + (width - 1);
+}
+
+inline void latency_histogram::record(uint64_t value) {
+    m_counts[bucket_index(value)]++;
+    m_count++;
+    m_sum += value;
+    if (value > m_max) m_max = value;
+}
+
+inline void latency_histogram::merge(const latency_histogram& other) {
+    for (size_t i = 0; i < bucket_count; i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    if (other.m_max > m_max) m_max = other.m_max;
+}
+
+inline void latency_histogram::reset() {
+    m_counts.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+inline double latency_histogram::mean() const {
+    return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / m_count;
+}
+
+inline uint64_t latency_histogram::percentile(double percent) const {
+    if (m_count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * m_count + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > m_count) rank = m_count;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += m_counts[i];
+        if (seen >= rank) {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < m_max ? bound : m_max;
+        }
+    }
+    return m_max;
+}
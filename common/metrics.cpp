@@ -0,0 +1,256 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+// Slots in every thread's block; registering more is a programming error.
+constexpr size_t MAX_VALUES = 128; // counters and gauges
+constexpr size_t MAX_HISTOGRAMS = 32;
+
+constexpr int64_t BUCKET_BOUNDS_NS[] = {
+    5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000,
+    1'000'000, 2'500'000, 5'000'000, 10'000'000, 25'000'000, 50'000'000, 100'000'000, 250'000'000, 500'000'000,
+    1'000'000'000, 2'500'000'000, 5'000'000'000, 10'000'000'000,
+};
+constexpr size_t BUCKETS = std::size(BUCKET_BOUNDS_NS) + 1; // the last one is +Inf
+
+enum metric_kind {
+    KIND_COUNTER,
+    KIND_GAUGE,
+    KIND_SAMPLED,
+    KIND_HISTOGRAM,
+};
+
+struct metric_info {
+    metric_kind kind;
+    std::string name;
+    std::string help;
+    std::string labels;
+    size_t slot = 0;
+    std::function<double()> sample;
+};
+
+// Per-bucket counts, not cumulative; the count is their sum.
+template <typename cell_t>
+struct histogram_cells {
+    cell_t buckets[BUCKETS];
+    cell_t sum_ns;
+};
+
+template <typename cell_t>
+struct metric_cells {
+    cell_t values[MAX_VALUES];
+    histogram_cells<cell_t> histograms[MAX_HISTOGRAMS];
+};
+
+// Written only by its thread, read by scrapes.
+using thread_block = metric_cells<std::atomic<int64_t>>;
+using totals = metric_cells<int64_t>;
+
+struct registry {
+    std::mutex lock;
+    std::vector<metric_info> metrics;
+    size_t values = 0;
+    size_t histograms = 0;
+    std::vector<thread_block*> blocks;
+    totals retired{}; // what exited threads recorded
+};
+
+// Never destroyed: detached threads may still exit, and fold their block in, while
+// static destructors run.
+registry& metrics_registry() {
+    static registry* instance = new registry;
+    return *instance;
+}
+
+// The metric's slot in the thread blocks, or for a sampled gauge its index in `metrics`.
+size_t register_metric(metric_kind kind, const char* name, const char* help, const char* labels, std::function<double()> sample = nullptr) {
+    registry& metrics = metrics_registry();
+    std::lock_guard<std::mutex> guard(metrics.lock);
+    metric_info info{ kind, name, help, labels, 0, std::move(sample) };
+    if (kind == KIND_COUNTER || kind == KIND_GAUGE) {
+        if (metrics.values == MAX_VALUES) throw std::length_error("too many counters and gauges");
+        info.slot = metrics.values++;
+    }
+    else if (kind == KIND_HISTOGRAM) {
+        if (metrics.histograms == MAX_HISTOGRAMS) throw std::length_error("too many histograms");
+        info.slot = metrics.histograms++;
+    }
+    else {
+        info.slot = metrics.metrics.size();
+    }
+    metrics.metrics.push_back(std::move(info));
+    return metrics.metrics.back().slot;
+}
+
+template <typename cell_t>
+int64_t read(const cell_t& cell) {
+    if constexpr (std::is_same_v<cell_t, int64_t>) return cell;
+    else return cell.load(std::memory_order_relaxed);
+}
+
+template <typename cell_t>
+void add_cells(const metric_cells<cell_t>& from, totals& to) {
+    for (size_t i = 0; i < MAX_VALUES; i++) to.values[i] += read(from.values[i]);
+    for (size_t h = 0; h < MAX_HISTOGRAMS; h++) {
+        for (size_t b = 0; b < BUCKETS; b++) to.histograms[h].buckets[b] += read(from.histograms[h].buckets[b]);
+        to.histograms[h].sum_ns += read(from.histograms[h].sum_ns);
+    }
+}
+
+class block_owner {
+public:
+    block_owner() : m_block(new thread_block()) {
+        registry& metrics = metrics_registry();
+        std::lock_guard<std::mutex> guard(metrics.lock);
+        metrics.blocks.push_back(m_block);
+    }
+
+    ~block_owner() {
+        registry& metrics = metrics_registry();
+        std::lock_guard<std::mutex> guard(metrics.lock);
+        add_cells(*m_block, metrics.retired);
+        metrics.blocks.erase(std::find(metrics.blocks.begin(), metrics.blocks.end(), m_block));
+        delete m_block;
+    }
+
+    thread_block& block() { return *m_block; }
+
+private:
+    thread_block* m_block;
+};
+
+thread_block& local_block() {
+    thread_local block_owner owner;
+    return owner.block();
+}
+
+// The only writer of the cell, so a plain load and store do.
+void bump(std::atomic<int64_t>& cell, int64_t value) {
+    cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void append_number(std::string& out, double value) {
+    char text[64];
+    auto result = std::to_chars(text, text + sizeof(text), value, std::chars_format::fixed);
+    out.append(text, result.ptr);
+}
+
+void append_number(std::string& out, int64_t value) {
+    char text[24];
+    auto result = std::to_chars(text, text + sizeof(text), value);
+    out.append(text, result.ptr);
+}
+
+// name{labels} or name{labels,extra}, braces left out when there is nothing in them.
+void append_series(std::string& out, const metric_info& info, const char* suffix, const std::string& extra = std::string()) {
+    out += info.name;
+    out += suffix;
+    if (!info.labels.empty() || !extra.empty()) {
+        out += '{';
+        out += info.labels;
+        if (!info.labels.empty() && !extra.empty()) out += ',';
+        out += extra;
+        out += '}';
+    }
+    out += ' ';
+}
+
+void append_histogram(std::string& out, const metric_info& info, const histogram_cells<int64_t>& cells) {
+    int64_t cumulative = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        cumulative += cells.buckets[b];
+        std::string bound = "le=\"";
+        if (b + 1 < BUCKETS) append_number(bound, static_cast<double>(BUCKET_BOUNDS_NS[b]) / 1e9);
+        else bound += "+Inf";
+        bound += '"';
+        append_series(out, info, "_bucket", bound);
+        append_number(out, cumulative);
+        out += '\n';
+    }
+    append_series(out, info, "_sum");
+    append_number(out, static_cast<double>(cells.sum_ns) / 1e9);
+    out += '\n';
+    append_series(out, info, "_count");
+    append_number(out, cumulative);
+    out += '\n';
+}
+
+}
+
+metric_counter::metric_counter(const char* name, const char* help, const char* labels)
+    : m_slot(register_metric(KIND_COUNTER, name, help, labels)) {}
+
+void metric_counter::add(int64_t value) const {
+    bump(local_block().values[m_slot], value);
+}
+
+metric_gauge::metric_gauge(const char* name, const char* help, const char* labels)
+    : m_slot(register_metric(KIND_GAUGE, name, help, labels)) {}
+
+void metric_gauge::add(int64_t value) const {
+    bump(local_block().values[m_slot], value);
+}
+
+sampled_gauge::sampled_gauge(const char* name, const char* help, std::function<double()> sample, const char* labels)
+    : m_index(register_metric(KIND_SAMPLED, name, help, labels, std::move(sample))) {}
+
+sampled_gauge::~sampled_gauge() {
+    registry& metrics = metrics_registry();
+    std::lock_guard<std::mutex> guard(metrics.lock);
+    metrics.metrics[m_index].sample = nullptr;
+}
+
+metric_histogram::metric_histogram(const char* name, const char* help, const char* labels)
+    : m_slot(register_metric(KIND_HISTOGRAM, name, help, labels)) {}
+
+void metric_histogram::record(clock::duration elapsed) const {
+    int64_t nanoseconds = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0);
+    size_t bucket = 0;
+    while (bucket + 1 < BUCKETS && nanoseconds > BUCKET_BOUNDS_NS[bucket]) bucket++;
+    histogram_cells<std::atomic<int64_t>>& cells = local_block().histograms[m_slot];
+    bump(cells.buckets[bucket], 1);
+    bump(cells.sum_ns, nanoseconds);
+}
+
+std::string metrics_text() {
+    std::vector<metric_info> metrics;
+    auto sums = std::make_unique<totals>();
+    {
+        registry& registered = metrics_registry();
+        std::lock_guard<std::mutex> guard(registered.lock);
+        metrics = registered.metrics;
+        add_cells(registered.retired, *sums);
+        for (const thread_block* block : registered.blocks) add_cells(*block, *sums);
+    }
+    // Members of a family next to each other, in the order they were registered.
+    std::stable_sort(metrics.begin(), metrics.end(), [](const metric_info& a, const metric_info& b) { return a.name < b.name; });
+
+    static const char* const TYPE_NAMES[] = { "counter", "gauge", "gauge", "histogram" };
+    std::string out;
+    for (size_t i = 0; i < metrics.size(); i++) {
+        const metric_info& info = metrics[i];
+        if (info.kind == KIND_SAMPLED && !info.sample) continue;
+        if (i == 0 || metrics[i - 1].name != info.name) {
+            out += "# HELP " + info.name + ' ' + info.help + '\n';
+            out += "# TYPE " + info.name + ' ' + TYPE_NAMES[info.kind] + '\n';
+        }
+        if (info.kind == KIND_HISTOGRAM) {
+            append_histogram(out, info, sums->histograms[info.slot]);
+            continue;
+        }
+        append_series(out, info, "");
+        if (info.kind == KIND_SAMPLED) append_number(out, info.sample());
+        else append_number(out, sums->values[info.slot]);
+        out += '\n';
+    }
+    return out;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Process-wide server metrics, cheap enough for the request path. Every thread records
+// into a block of its own, allocated on its first use and only ever written by it, with
+// relaxed loads and stores: no locked instruction, no line shared with another writer.
+// A scrape sums the blocks of the live threads under a lock, plus the totals of the
+// threads that have exited, which fold theirs in on the way out.
+//
+// Metrics are objects constructed once, at namespace scope or in a long-lived owner, and
+// registered for good by their constructor. Several may share a name with different
+// labels (`labels` is what goes between the braces, e.g. `phase="parse"`); a scrape
+// renders each name as one family in the Prometheus text format.
+class metric_counter {
+public:
+    metric_counter(const char* name, const char* help, const char* labels = "");
+    metric_counter(const metric_counter&) = delete;
+    metric_counter& operator=(const metric_counter&) = delete;
+
+    void add(int64_t value = 1) const;
+
+private:
+    size_t m_slot;
+};
+
+// A level that moves both ways (open connections, bytes queued). Any thread may add and
+// any may take away; only the sum over all threads means anything.
+class metric_gauge {
+public:
+    metric_gauge(const char* name, const char* help, const char* labels = "");
+    metric_gauge(const metric_gauge&) = delete;
+    metric_gauge& operator=(const metric_gauge&) = delete;
+
+    void add(int64_t value = 1) const;
+    void sub(int64_t value = 1) const { add(-value); }
+
+private:
+    size_t m_slot;
+};
+
+// A level kept by someone else (a queue), read by calling `sample` at scrape time, on
+// the scraping thread and outside the metrics lock. Stops being reported when destroyed.
+class sampled_gauge {
+public:
+    sampled_gauge(const char* name, const char* help, std::function<double()> sample, const char* labels = "");
+    ~sampled_gauge();
+    sampled_gauge(const sampled_gauge&) = delete;
+    sampled_gauge& operator=(const sampled_gauge&) = delete;
+
+private:
+    size_t m_index;
+};
+
+// Durations in fixed buckets, 5 us to 10 s in 1-2.5-5 steps plus +Inf, reported in
+// seconds. Fixed bounds keep a record() to a short scan and make histograms of any
+// thread, or any process, add up bucket by bucket.
+class metric_histogram {
+public:
+    using clock = std::chrono::steady_clock;
+
+    metric_histogram(const char* name, const char* help, const char* labels = "");
+    metric_histogram(const metric_histogram&) = delete;
+    metric_histogram& operator=(const metric_histogram&) = delete;
+
+    void record(clock::duration elapsed) const;
+    void record_since(clock::time_point start) const { record(clock::now() - start); }
+
+private:
+    size_t m_slot;
+};
+
+// Records the lifetime of the scope into a histogram.
+class metric_timer {
+public:
+    explicit metric_timer(const metric_histogram& histogram) : m_histogram(histogram), m_start(metric_histogram::clock::now()) {}
+    ~metric_timer() { m_histogram.record_since(m_start); }
+    metric_timer(const metric_timer&) = delete;
+    metric_timer& operator=(const metric_timer&) = delete;
+
+private:
+    const metric_histogram& m_histogram;
+    metric_histogram::clock::time_point m_start;
+};
+
+// Every registered metric in the Prometheus text exposition format, version 0.0.4.
+std::string metrics_text();
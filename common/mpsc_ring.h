@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "cache_line.h"
+
+// Bounded lock-free queue for many producers and one consumer (Vyukov's sequenced
+// ring). Producers claim a slot with one CAS on the shared tail and never wait for each
+// other; a full ring makes try_push fail instead of blocking, so callers on a hot path
+// decide themselves whether to drop or retry. Slots are written in place through the
+// callback, so large entries are not copied through the queue.
+template <typename value_t>
+class mpsc_ring {
+public:
+    // `capacity` is rounded up to a power of two.
+    explicit mpsc_ring(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        m_mask = size - 1;
+        m_cells = std::make_unique<cell[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpsc_ring(const mpsc_ring&) = delete;
+    mpsc_ring& operator=(const mpsc_ring&) = delete;
+
+    // Calls fill(value_t&) on a claimed slot and publishes it. False when the ring is full.
+    template <typename fill_t>
+    bool try_push(fill_t&& fill) {
+        size_t position = m_tail.value.load(std::memory_order_relaxed);
+        while (true) {
+            cell& slot = m_cells[position & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (m_tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    fill(slot.value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = m_tail.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only. Calls take(value_t&) on the oldest published entry; false if none.
+    // An entry whose producer has claimed but not yet published it holds back the rest.
+    template <typename take_t>
+    bool try_pop(take_t&& take) {
+        cell& slot = m_cells[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) return false;
+        take(slot.value);
+        slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+    // Consumer only.
+    bool empty() const {
+        return m_cells[m_head & m_mask].sequence.load(std::memory_order_acquire) != m_head + 1;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence{ 0 };
+        value_t value{};
+    };
+
+    std::unique_ptr<cell[]> m_cells;
+    size_t m_mask = 0;
+    cache_padded<std::atomic<size_t>> m_tail;
+    alignas(cache_line_size) size_t m_head = 0;
+};